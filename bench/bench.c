@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/file.h"
+#include "../src/vm.h"
+
+#define DEFAULT_STEPS 50000000UL // per trial, programs that halt earlier stop there
+#define DEFAULT_TRIALS 10
+#define DEFAULT_WARMUPS 2
+#define MAX_TRIALS 1000
+#define MAX_WORKLOADS 64
+
+// one line of the workload list: a name, a program, its input or - for none, and whether the input is fed once
+// followed by EOF or over and over again
+struct workload {
+    char name[64];
+    char program[256];
+    char input[256];
+    bool repeat;
+};
+
+// measured in the child process that ran the trial
+struct trial {
+    unsigned long steps;
+    long nanoseconds;
+    bool halted;
+    long peak_rss_kb;
+};
+
+struct options {
+    unsigned long steps;
+    int trials;
+    int warmups;
+    int cpu; // -1 leaves the trials unpinned
+};
+
+static long elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+// Runs one trial in the calling process and writes its result to fd. Output is written to /dev/null so that
+// output-heavy programs pay for their system calls.
+static void run_trial(const struct workload *workload, const struct program *program, const char *input,
+                      size_t input_length, unsigned long steps, int fd) {
+    const int null = open("/dev/null", O_WRONLY);
+    struct vm vm;
+    if (null < 0 || !vm_init(&vm, program))
+        _exit(EXIT_FAILURE);
+    char output[BUFSIZ];
+    vm_set_output(&vm, output, sizeof(output));
+    vm.step_limit = steps;
+
+    struct trial trial = {.halted = false};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool running = true;
+    while (running) {
+        switch (vm_run(&vm)) {
+        case VM_HALTED:
+            trial.halted = true;
+            running = false;
+            break;
+        case VM_DIVIDE_BY_ZERO: // ends the run like '@' would, without halting
+            running = false;
+            break;
+        case VM_OUTPUT:
+            if (write(null, vm.output, vm.output_length) < 0)
+                _exit(EXIT_FAILURE);
+            vm.output_length = 0;
+            break;
+        case VM_INPUT:
+            if (input == NULL || (!workload->repeat && vm.input == input))
+                vm_close_input(&vm);
+            else
+                vm_set_input(&vm, input, input_length);
+            break;
+        case VM_BREAK: // breakpoints are not timed apart from the rest of the program
+        case VM_MISMATCH:
+        case VM_OVERFLOW:
+            break;
+        case VM_YIELD:
+            running = false;
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    trial.steps = vm.steps;
+    trial.nanoseconds = elapsed_ns(&start, &end);
+    if (write(fd, &trial, sizeof(trial)) != sizeof(trial))
+        _exit(EXIT_FAILURE);
+    exit(EXIT_SUCCESS); // rather than _exit(), so that profiling builds write out their counters
+}
+
+// runs a trial in a fresh process, so that its peak RSS is its own
+static bool measure(const struct workload *workload, const struct program *program, const char *input,
+                    size_t input_length, unsigned long steps, struct trial *trial) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    const pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        run_trial(workload, program, input, input_length, steps, fds[1]);
+    }
+    close(fds[1]);
+    const bool received = read(fds[0], trial, sizeof(*trial)) == sizeof(*trial);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) != pid)
+        return false;
+    trial->peak_rss_kb = usage.ru_maxrss;
+    return received && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    const double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// the value at rank ceil(percentile * count) of sorted values
+static double percentile(const double *sorted, int count, double percentile) {
+    int rank = (int)ceil(percentile * count);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static double median(const double *sorted, int count) {
+    return count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+static bool run_workload(const struct workload *workload, const struct options *options, bool first) {
+    size_t length;
+    char *source = read_file(workload->program, &length);
+    struct program program;
+    if (source == NULL || !parse_program(&program, source, length)) {
+        fprintf(stderr, "%s: error reading %s\n", workload->name, workload->program);
+        free(source);
+        return false;
+    }
+    free(source);
+    char *input = NULL;
+    size_t input_length = 0;
+    if (strcmp(workload->input, "-") != 0) {
+        input = read_file(workload->input, &input_length);
+        if (input == NULL || input_length == 0) {
+            fprintf(stderr, "%s: error reading %s\n", workload->name, workload->input);
+            free(input);
+            free_program(&program);
+            return false;
+        }
+    }
+
+    double ns_per_step[MAX_TRIALS];
+    unsigned long steps = 0;
+    bool halted = false;
+    long peak_rss_kb = 0;
+    bool success = true;
+    for (int i = 0; success && i < options->warmups + options->trials; i++) {
+        struct trial trial;
+        success = measure(workload, &program, input, input_length, options->steps, &trial);
+        if (!success) {
+            fprintf(stderr, "%s: trial %d failed\n", workload->name, i + 1);
+        } else if (i >= options->warmups) {
+            ns_per_step[i - options->warmups] = (double)trial.nanoseconds / (trial.steps ? trial.steps : 1);
+            steps = trial.steps;
+            halted = trial.halted;
+            if (trial.peak_rss_kb > peak_rss_kb)
+                peak_rss_kb = trial.peak_rss_kb;
+        }
+    }
+    free(input);
+    free_program(&program);
+    if (!success)
+        return false;
+
+    qsort(ns_per_step, options->trials, sizeof(double), compare_doubles);
+    const double typical = median(ns_per_step, options->trials);
+    fprintf(stderr, "%-12s %12lu steps %8.2f ns/step\n", workload->name, steps, typical);
+    printf("%s\n    {\n", first ? "" : ",");
+    printf("      \"name\": \"%s\",\n", workload->name);
+    printf("      \"program\": \"%s\",\n", workload->program);
+    printf("      \"steps\": %lu,\n", steps);
+    printf("      \"halted\": %s,\n", halted ? "true" : "false");
+    printf("      \"steps_per_second\": %.0f,\n", 1e9 / typical);
+    printf("      \"ns_per_step\": {\"median\": %.3f, \"p99\": %.3f, \"min\": %.3f, \"max\": %.3f},\n", typical,
+           percentile(ns_per_step, options->trials, 0.99), ns_per_step[0], ns_per_step[options->trials - 1]);
+    printf("      \"peak_rss_kb\": %ld\n", peak_rss_kb);
+    printf("    }");
+    return true;
+}
+
+// reads the workload list, skipping blank lines and # comments
+static int read_workloads(const char *filename, struct workload *workloads) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL)
+        return -1;
+    int count = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        struct workload workload;
+        char feed[8];
+        if (line[0] == '#' || sscanf(line, "%63s %255s %255s %7s", workload.name, workload.program, workload.input,
+                                     feed) != 4)
+            continue;
+        workload.repeat = strcmp(feed, "repeat") == 0;
+        if (count == MAX_WORKLOADS)
+            break;
+        workloads[count++] = workload;
+    }
+    fclose(file);
+    return count;
+}
+
+// the highest numbered CPU the process may run on, which tends to see the fewest interrupts
+static int default_cpu(void) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0)
+        return -1;
+    for (int cpu = CPU_SETSIZE - 1; cpu >= 0; cpu--) {
+        if (CPU_ISSET(cpu, &set))
+            return cpu;
+    }
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    struct options options = {
+        .steps = DEFAULT_STEPS,
+        .trials = DEFAULT_TRIALS,
+        .warmups = DEFAULT_WARMUPS,
+        .cpu = default_cpu(),
+    };
+    int first_argument = 1;
+    for (; first_argument + 1 < argc && strncmp(argv[first_argument], "--", 2) == 0; first_argument += 2) {
+        const char *value = argv[first_argument + 1];
+        if (strcmp(argv[first_argument], "--steps") == 0) {
+            options.steps = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[first_argument], "--trials") == 0) {
+            options.trials = atoi(value);
+        } else if (strcmp(argv[first_argument], "--warmups") == 0) {
+            options.warmups = atoi(value);
+        } else if (strcmp(argv[first_argument], "--cpu") == 0) {
+            options.cpu = atoi(value);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[first_argument]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (first_argument >= argc || options.steps == 0 || options.trials <= 0 || options.trials > MAX_TRIALS ||
+        options.warmups < 0) {
+        fputs("Usage: bench [--steps N] [--trials N] [--warmups N] [--cpu N] WORKLOADS [NAME...]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    struct workload workloads[MAX_WORKLOADS];
+    const int count = read_workloads(argv[first_argument], workloads);
+    if (count < 0) {
+        perror("Error reading workloads");
+        return EXIT_FAILURE;
+    }
+    // trials inherit the pinning
+    if (options.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(options.cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            perror("Error pinning to CPU");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("{\n");
+    printf("  \"steps_per_trial\": %lu,\n", options.steps);
+    printf("  \"trials\": %d,\n", options.trials);
+    printf("  \"warmups\": %d,\n", options.warmups);
+    printf("  \"cpu\": %d,\n", options.cpu);
+    printf("  \"workloads\": [");
+    fflush(stdout);
+    bool success = true;
+    bool first = true;
+    for (int i = 0; i < count; i++) {
+        bool selected = first_argument + 1 == argc;
+        for (int j = first_argument + 1; j < argc; j++)
+            selected |= strcmp(argv[j], workloads[i].name) == 0;
+        if (!selected)
+            continue;
+        if (run_workload(workloads + i, &options, first))
+            first = false;
+        else
+            success = false;
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
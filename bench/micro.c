@@ -0,0 +1,302 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "../src/vm.h"
+
+#define CALLS (1 << 16)   // calls per measurement, cycling through the pattern
+#define REPEATS 21        // measurements per function and pattern, the median is reported
+#define RADIUS 256        // how far from the origin the patterns reach
+#define PROGRAM_RINGS 16  // size of the hexagon axial_to_index() is measured on
+#define GROWTH_RINGS 128  // how far realloc_memory() growth is driven
+
+enum pattern { STRAIGHT, ZIGZAG, RANDOM, SPIRAL, PATTERNS };
+
+static const char *pattern_name[] = {
+    [STRAIGHT] = "straight",
+    [ZIGZAG] = "zigzag",
+    [RANDOM] = "random",
+    [SPIRAL] = "spiral",
+};
+
+struct coordinate {
+    long p, q;
+};
+
+// inputs for every pattern, generated before anything is timed
+static struct coordinate coordinates[PATTERNS][CALLS];
+static struct coordinate program_coordinates[PATTERNS][CALLS];
+static struct memory_pointer pointers[PATTERNS][CALLS];
+static enum neighbor moves[PATTERNS][CALLS];
+static long dividends[CALLS], divisors[CALLS];
+
+// results are summed into this so that the calls cannot be optimized away
+static volatile long sink;
+
+static uint64_t random_state = 0x9E3779B97F4A7C15;
+
+static uint64_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+// Cycles of the time stamp counter where there is one, nanoseconds otherwise. The time stamp counter ticks at a
+// constant rate close to the nominal clock, so it is stable across frequency changes.
+static uint64_t cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+#endif
+}
+
+static long distance(long p, long q) {
+    return (labs(p) + labs(q) + labs(p + q)) / 2;
+}
+
+// Fills a coordinate list with a pattern that stays within radius of the origin. Straight walks go out along one
+// direction and start over, zig-zags alternate between two neighbouring directions, random jumps are uniform over
+// the hexagon and spirals visit ring after ring.
+static void generate_coordinates(struct coordinate *list, enum pattern pattern, long radius) {
+    long p = 0, q = 0;
+    long ring = 0, side = 0, position = 0;
+    for (size_t i = 0; i < CALLS; i++) {
+        switch (pattern) {
+        case STRAIGHT:
+            p += direction_offset[E].dp;
+            q += direction_offset[E].dq;
+            if (distance(p, q) > radius)
+                p = q = 0;
+            break;
+        case ZIGZAG: {
+            const enum direction direction = i % 2 ? NE : E;
+            p += direction_offset[direction].dp;
+            q += direction_offset[direction].dq;
+            if (distance(p, q) > radius)
+                p = q = 0;
+        }   break;
+        case RANDOM:
+            do {
+                p = (long)(next_random() % (2 * radius + 1)) - radius;
+                q = (long)(next_random() % (2 * radius + 1)) - radius;
+            } while (distance(p, q) > radius);
+            break;
+        case SPIRAL:
+            // ring r starts r steps to the SW of the origin and walks r steps in each direction from NW around it
+            if (ring == 0 || position == ring) {
+                position = 0;
+                if (ring == 0 || ++side == 6) {
+                    side = 0;
+                    ring = ring == radius ? 1 : ring + 1;
+                    p = ring * direction_offset[SW].dp;
+                    q = ring * direction_offset[SW].dq;
+                }
+            }
+            p += direction_offset[side].dp;
+            q += direction_offset[side].dq;
+            position++;
+            break;
+        case PATTERNS:
+            break;
+        }
+        list[i] = (struct coordinate){p, q};
+    }
+}
+
+// Moves of the memory pointer in the same shapes. Alternating left and right walks in a straight line, pairs of
+// the same move zig-zag, and longer and longer runs of one move wind around hexagons of memory.
+static void generate_moves(enum neighbor *list, enum pattern pattern) {
+    size_t run = 1, left = 1;
+    for (size_t i = 0; i < CALLS; i++) {
+        switch (pattern) {
+        case STRAIGHT: list[i] = i % 2 ? LEFT : RIGHT; break;
+        case ZIGZAG: list[i] = i / 2 % 2 ? LEFT : RIGHT; break;
+        case RANDOM: list[i] = next_random() % 2 ? LEFT : RIGHT; break;
+        case SPIRAL:
+            list[i] = run % 2 ? LEFT : RIGHT;
+            if (--left == 0)
+                left = run = run % 12 + 1;
+            break;
+        case PATTERNS: break;
+        }
+    }
+}
+
+static void generate(void) {
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++) {
+        generate_coordinates(coordinates[pattern], pattern, RADIUS);
+        generate_coordinates(program_coordinates[pattern], pattern, PROGRAM_RINGS - 1);
+        generate_moves(moves[pattern], pattern);
+        for (size_t i = 0; i < CALLS; i++) {
+            pointers[pattern][i] = (struct memory_pointer){
+                .p = coordinates[pattern][i].p,
+                .q = coordinates[pattern][i].q,
+                .axis = next_random() % 3,
+                .direction = next_random() % 2 ? IN : OUT,
+            };
+        }
+    }
+    // edge values as they reach modulo() from ';', '#' and the corner checks: mostly small, of both signs
+    for (size_t i = 0; i < CALLS; i++) {
+        dividends[i] = (long)(next_random() % 2001) - 1000;
+        divisors[i] = i % 2 ? 256 : 6;
+    }
+}
+
+static int compare_cycles(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// per call figures of the repeated measurements
+static void report(const char *function, const char *pattern, uint64_t *measurements, size_t calls) {
+    qsort(measurements, REPEATS, sizeof(uint64_t), compare_cycles);
+    printf("%-20s %-10s %10.2f %10.2f\n", function, pattern, (double)measurements[REPEATS / 2] / calls,
+           (double)measurements[0] / calls);
+}
+
+static void measure_axial_to_mem_index(enum pattern pattern) {
+    uint64_t measurements[REPEATS];
+    const struct coordinate *list = coordinates[pattern];
+    for (int r = 0; r < REPEATS; r++) {
+        long sum = 0;
+        const uint64_t start = cycles();
+        for (size_t i = 0; i < CALLS; i++)
+            sum += axial_to_mem_index(list[i].p, list[i].q);
+        measurements[r] = cycles() - start;
+        sink += sum;
+    }
+    report("axial_to_mem_index", pattern_name[pattern], measurements, CALLS);
+}
+
+static void measure_axial_to_index(enum pattern pattern) {
+    uint64_t measurements[REPEATS];
+    const struct coordinate *list = program_coordinates[pattern];
+    for (int r = 0; r < REPEATS; r++) {
+        long sum = 0;
+        const uint64_t start = cycles();
+        for (size_t i = 0; i < CALLS; i++)
+            sum += axial_to_index(list[i].p, list[i].q, PROGRAM_RINGS);
+        measurements[r] = cycles() - start;
+        sink += sum;
+    }
+    report("axial_to_index", pattern_name[pattern], measurements, CALLS);
+}
+
+// memory is grown in advance so that only the lookup is measured
+static void measure_get_neighbor(enum pattern pattern, struct memory_cell **memory, long *rings) {
+    uint64_t measurements[REPEATS];
+    const struct memory_pointer *list = pointers[pattern];
+    for (int r = 0; r < REPEATS; r++) {
+        long sum = 0;
+        const uint64_t start = cycles();
+        for (size_t i = 0; i < CALLS; i++)
+            sum += *get_neighbor(list[i], i % 2 ? LEFT : RIGHT, memory, rings);
+        measurements[r] = cycles() - start;
+        sink += sum;
+    }
+    report("get_neighbor", pattern_name[pattern], measurements, CALLS);
+}
+
+static void measure_move_mp(enum pattern pattern) {
+    uint64_t measurements[REPEATS];
+    const enum neighbor *list = moves[pattern];
+    for (int r = 0; r < REPEATS; r++) {
+        struct memory_pointer mp = {0, 0, Z, OUT};
+        const uint64_t start = cycles();
+        for (size_t i = 0; i < CALLS; i++)
+            move_mp(&mp, list[i]);
+        measurements[r] = cycles() - start;
+        sink += mp.p + mp.q;
+    }
+    report("move_mp", pattern_name[pattern], measurements, CALLS);
+}
+
+static void measure_modulo(void) {
+    uint64_t measurements[REPEATS];
+    for (int r = 0; r < REPEATS; r++) {
+        long sum = 0;
+        const uint64_t start = cycles();
+        for (size_t i = 0; i < CALLS; i++)
+            sum += modulo(dividends[i], divisors[i]);
+        measurements[r] = cycles() - start;
+        sink += sum;
+    }
+    report("modulo", "edges", measurements, CALLS);
+}
+
+// Grows memory from nothing by touching cells in the pattern until GROWTH_RINGS rings exist, the way
+// get_memory_cell() grows it during a run. Reported per realloc_memory() call, including the lookups in between.
+static void measure_growth(enum pattern pattern) {
+    static struct coordinate list[CALLS];
+    generate_coordinates(list, pattern, GROWTH_RINGS - 1);
+    uint64_t measurements[REPEATS];
+    size_t calls = 0;
+    for (int r = 0; r < REPEATS; r++) {
+        struct memory_cell *memory = calloc(1, sizeof(struct memory_cell));
+        long rings = 1;
+        calls = 0;
+        const uint64_t start = cycles();
+        for (size_t i = 0; rings < GROWTH_RINGS; i = (i + 1) % CALLS) {
+            const long before = rings;
+            get_memory_cell(list[i].p, list[i].q, &memory, &rings);
+            calls += rings - before;
+        }
+        measurements[r] = cycles() - start;
+        sink += memory[0].value[X];
+        free(memory);
+    }
+    report("realloc_memory", pattern_name[pattern], measurements, calls);
+}
+
+int main(int argc, char **argv) {
+    // pinned to one CPU so that the time stamp counter and caches stay the same, -1 leaves it unpinned
+    const int cpu = argc > 1 ? atoi(argv[1]) : 0;
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            perror("Error pinning to CPU");
+            return EXIT_FAILURE;
+        }
+    }
+    generate();
+    struct memory_cell *memory = calloc(1, sizeof(struct memory_cell));
+    long rings = 1;
+    get_memory_cell(RADIUS + 2, 0, &memory, &rings);
+
+#if defined(__x86_64__) || defined(__i386__)
+    const char *unit = "cycles";
+#else
+    const char *unit = "ns";
+#endif
+    printf("%-20s %-10s %10s %10s\n", "function", "pattern", "median", "min");
+    printf("%-20s %-10s %10s %10s\n", "", "", unit, unit);
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++)
+        measure_axial_to_mem_index(pattern);
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++)
+        measure_axial_to_index(pattern);
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++)
+        measure_get_neighbor(pattern, &memory, &rings);
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++)
+        measure_move_mp(pattern);
+    measure_modulo();
+    for (enum pattern pattern = 0; pattern < PATTERNS; pattern++)
+        measure_growth(pattern);
+    free(memory);
+    return EXIT_SUCCESS;
+}
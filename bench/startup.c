@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <spawn.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS 1000
+#define WARMUPS 20 // runs before the measured ones, to get the binary into the page cache
+#define MAX_RUNS 100000
+
+extern char **environ;
+
+static long elapsed_ns(const struct timespec *start, const struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+// Time from just before the process is spawned until it has been reaped. Its stdin and stdout are /dev/null.
+static bool run(const char *interpreter, const char *program, const posix_spawn_file_actions_t *actions,
+                long *nanoseconds) {
+    char *const argv[] = {(char *)interpreter, (char *)program, NULL};
+    struct timespec start, end;
+    pid_t pid;
+    int status;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (posix_spawn(&pid, interpreter, actions, NULL, argv, environ) != 0 || waitpid(pid, &status, 0) != pid)
+        return false;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *nanoseconds = elapsed_ns(&start, &end);
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+static int compare_longs(const void *a, const void *b) {
+    const long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static bool measure(const char *interpreter, const char *program, int runs, bool first) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    static long nanoseconds[MAX_RUNS];
+    bool success = true;
+    for (int i = 0; success && i < WARMUPS + runs; i++) {
+        success = run(interpreter, program, &actions, nanoseconds + (i < WARMUPS ? 0 : i - WARMUPS));
+        if (!success)
+            fprintf(stderr, "%s: run %d failed\n", interpreter, i + 1);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    if (!success)
+        return false;
+
+    qsort(nanoseconds, runs, sizeof(long), compare_longs);
+    const long median = runs % 2 ? nanoseconds[runs / 2] : (nanoseconds[runs / 2 - 1] + nanoseconds[runs / 2]) / 2;
+    const int p99 = (int)ceil(0.99 * runs);
+    fprintf(stderr, "%-32s %8.1f us\n", interpreter, median / 1e3);
+    printf("%s\n    {\n", first ? "" : ",");
+    printf("      \"interpreter\": \"%s\",\n", interpreter);
+    printf("      \"us\": {\"median\": %.1f, \"p99\": %.1f, \"min\": %.1f, \"max\": %.1f}\n", median / 1e3,
+           nanoseconds[p99 > 0 ? p99 - 1 : 0] / 1e3, nanoseconds[0] / 1e3, nanoseconds[runs - 1] / 1e3);
+    printf("    }");
+    return true;
+}
+
+// Measures exec-to-exit latency: how long it takes each interpreter to start, run a program and exit, as seen by
+// the process that spawned it.
+int main(int argc, char **argv) {
+    int runs = DEFAULT_RUNS;
+    int first_argument = 1;
+    if (argc > 2 && strcmp(argv[1], "--runs") == 0) {
+        runs = atoi(argv[2]);
+        first_argument = 3;
+    }
+    if (argc - first_argument < 2 || runs <= 0 || runs > MAX_RUNS) {
+        fputs("Usage: startup [--runs N] PROGRAM INTERPRETER...\n", stderr);
+        return EXIT_FAILURE;
+    }
+    const char *program = argv[first_argument];
+
+    printf("{\n");
+    printf("  \"program\": \"%s\",\n", program);
+    printf("  \"runs\": %d,\n", runs);
+    printf("  \"interpreters\": [");
+    fflush(stdout);
+    bool success = true;
+    bool first = true;
+    for (int i = first_argument + 1; i < argc; i++) {
+        if (measure(argv[i], program, runs, first))
+            first = false;
+        else
+            success = false;
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,752 @@
+#include "concolic.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TERMS 8               // expressions of more inputs than this are treated as concrete
+#define VALUE_LIMIT (1L << 30)    // larger coefficients and constants are treated as concrete, so nothing overflows
+#define NUMBER_LIMIT (1L << 24)   // the largest number the solver gives to a '?'
+#define INITIAL_CAPACITY 64
+
+enum branch_kind {
+    MIRROR, // '<' entered from the west or '>' from the east
+    CORNER, // an IP leaving the hexagon through a corner
+    MOVE,   // '^'
+    COPY,   // '&'
+    SWITCH, // '#', which goes one of six ways
+    BRANCH_KINDS,
+    // Not a branch, but the quotient of ':' or '%' by a constant. Fixing the quotient keeps the remainder linear,
+    // and solving for the quotients next to it moves inputs across the ranges a program dispatches on by dividing.
+    QUOTIENT = BRANCH_KINDS,
+    CONSTRAINT_KINDS
+};
+
+// constant + the sum of coefficient * variable over the terms
+struct expression {
+    long constant;
+    int term_count;
+    struct {
+        size_t variable;
+        long coefficient;
+    } terms[MAX_TERMS];
+};
+
+// a value read from the input
+struct variable {
+    bool number; // read by '?', otherwise a byte read by ','
+    long value;
+    size_t start, end; // the input it was read from, empty at EOF
+};
+
+// a branch on an edge that depends on input and the way it went, or the quotient of a division of one
+struct constraint {
+    size_t expression;
+    enum branch_kind kind;
+    size_t site;
+    long outcome; // the quotient for QUOTIENT
+    long divisor; // for QUOTIENT
+};
+
+// what one run found out about its input
+struct run {
+    struct expression *expressions; // [0] is unused, so that 0 marks an edge as concrete
+    size_t expression_count, expression_capacity;
+    size_t *shadow; // expression of every memory edge, indexed like the memory
+    size_t shadow_size;
+    struct variable *variables;
+    size_t variable_count, variable_capacity;
+    struct constraint *constraints;
+    size_t constraint_count, constraint_capacity;
+    bool new_coverage; // took a branch a way no earlier run did
+};
+
+// The instruction vm_run() is about to execute. What it reads and how the IP wraps afterwards is only known once
+// it has.
+struct pending {
+    int IP;
+    long p, q;
+    char instruction;
+    size_t location;       // edge a read writes
+    size_t input_position; // before a read
+};
+
+struct queued {
+    char *input;
+    size_t length;
+    size_t bound; // constraints before this were already flipped by the run this input was solved from
+};
+
+struct queue {
+    struct queued *items;
+    size_t head, count, capacity;
+};
+
+// Inputs solved to take a branch a way no run took yet run first. Then come the ones solved to take a known way on a
+// new path, which can lead to branches no run reached yet, first from runs that took new ways themselves.
+enum priority { NEW_WAY, NEW_PATH_FROM_NEW_WAY, NEW_PATH, PRIORITIES };
+
+struct explorer {
+    const struct concolic *concolic;
+    unsigned char *covered; // bit set of the ways every branch went
+    unsigned long *tried;   // the last run that solved for every way of every branch
+    struct run run;
+    char *output;
+    size_t output_capacity;
+    struct queue queues[PRIORITIES];
+    uint64_t *seen; // hash set of the inputs queued so far, 0 marks an empty slot
+    size_t seen_count, seen_capacity;
+    uint64_t random; // xorshift state, fixed so that explorations repeat
+};
+
+// Returns array grown to hold at least needed elements, or NULL, leaving it as it was, if that fails.
+static void *reserve(void *array, size_t *capacity, size_t needed, size_t size) {
+    if (needed <= *capacity)
+        return array;
+    size_t grown = *capacity > 0 ? *capacity : INITIAL_CAPACITY;
+    while (grown < needed)
+        grown *= 2;
+    array = realloc(array, grown * size);
+    if (array != NULL)
+        *capacity = grown;
+    return array;
+}
+
+// the way a branch goes on a value, which is the IP for '#' and whether the value is positive otherwise
+static int outcome_of(enum branch_kind kind, long value) {
+    return kind == SWITCH ? (int)modulo(value, 6) : value > 0;
+}
+
+static int outcome_count(enum branch_kind kind) {
+    return kind == SWITCH ? 6 : 2;
+}
+
+// the value of an expression with the values of the run, except that variable has value
+static long evaluate(const struct expression *expression, const struct variable *variables, size_t variable,
+                     long value) {
+    long result = expression->constant;
+    for (int i = 0; i < expression->term_count; i++) {
+        const size_t term_variable = expression->terms[i].variable;
+        const long term_value = term_variable == variable ? value : variables[term_variable].value;
+        result += expression->terms[i].coefficient * term_value;
+    }
+    return result;
+}
+
+// result = a * ka + b * kb. Returns false if that has too many terms or too large values to track.
+static bool combine(const struct expression *a, long ka, const struct expression *b, long kb,
+                    struct expression *result) {
+    if (labs(ka) > VALUE_LIMIT || labs(kb) > VALUE_LIMIT)
+        return false;
+    struct expression sum = {.constant = a->constant * ka + b->constant * kb};
+    for (int operand = 0; operand < 2; operand++) {
+        const struct expression *expression = operand == 0 ? a : b;
+        const long k = operand == 0 ? ka : kb;
+        for (int i = 0; i < expression->term_count; i++) {
+            int j = 0;
+            while (j < sum.term_count && sum.terms[j].variable != expression->terms[i].variable)
+                j++;
+            if (j == sum.term_count) {
+                if (j == MAX_TERMS)
+                    return false;
+                sum.terms[sum.term_count].variable = expression->terms[i].variable;
+                sum.terms[sum.term_count++].coefficient = 0;
+            }
+            sum.terms[j].coefficient += expression->terms[i].coefficient * k;
+        }
+    }
+    // terms that cancelled out leave the expression
+    int kept = 0;
+    for (int i = 0; i < sum.term_count; i++) {
+        if (labs(sum.terms[i].coefficient) > VALUE_LIMIT)
+            return false;
+        if (sum.terms[i].coefficient != 0)
+            sum.terms[kept++] = sum.terms[i];
+    }
+    sum.term_count = kept;
+    if (labs(sum.constant) > VALUE_LIMIT)
+        return false;
+    *result = sum;
+    return true;
+}
+
+// the index of an edge in memory, which the shadow is indexed by as well
+static size_t location_of(const struct vm *vm, const memory_edge *edge) {
+    return edge - vm->memory[0].value;
+}
+
+static memory_edge value_at(const struct vm *vm, size_t location) {
+    return vm->memory[location / 3].value[location % 3];
+}
+
+// grows the shadow along with the memory of the vm
+static bool cover_memory(struct run *run, const struct vm *vm) {
+    const size_t size = 3 * (3 * vm->memory_rings * (vm->memory_rings - 1) + 1);
+    if (size <= run->shadow_size)
+        return true;
+    size_t *shadow = realloc(run->shadow, size * sizeof(size_t));
+    if (shadow == NULL)
+        return false;
+    memset(shadow + run->shadow_size, 0, (size - run->shadow_size) * sizeof(size_t));
+    run->shadow = shadow;
+    run->shadow_size = size;
+    return true;
+}
+
+// The expression of an edge, or 0 if it does not depend on input. An expression that no longer gives the value of
+// the edge went through an overflow, which the expressions do not model, so the edge is taken as concrete.
+static size_t symbolic(const struct run *run, size_t location, memory_edge value) {
+    const size_t expression = run->shadow[location];
+    if (expression == 0 || evaluate(run->expressions + expression, run->variables, SIZE_MAX, 0) != value)
+        return 0;
+    return expression;
+}
+
+// the expression of an edge as an operand, a constant if it does not depend on input
+static bool operand(const struct run *run, size_t location, memory_edge value, struct expression *result) {
+    const size_t expression = symbolic(run, location, value);
+    *result = expression != 0 ? run->expressions[expression] : (struct expression){.constant = value};
+    return expression != 0;
+}
+
+// makes an edge depend on input through an expression, or on nothing if it is NULL or constant
+static bool assign(struct run *run, size_t location, const struct expression *expression) {
+    if (expression == NULL || expression->term_count == 0) {
+        run->shadow[location] = 0;
+        return true;
+    }
+    struct expression *expressions =
+        reserve(run->expressions, &run->expression_capacity, run->expression_count + 1, sizeof(struct expression));
+    if (expressions == NULL)
+        return false;
+    run->expressions = expressions;
+    expressions[run->expression_count] = *expression;
+    run->shadow[location] = run->expression_count++;
+    return true;
+}
+
+// records the way a branch on the edge at location went, and the constraint on the input if the edge depends on it
+static bool branch(struct explorer *explorer, enum branch_kind kind, size_t cell, enum direction direction,
+                   size_t location, memory_edge value) {
+    struct run *run = &explorer->run;
+    const size_t site = (kind * explorer->concolic->program->size + cell) * 6 + direction;
+    const long outcome = outcome_of(kind, value);
+    if (!(explorer->covered[site] & 1 << outcome)) {
+        explorer->covered[site] |= 1 << outcome;
+        run->new_coverage = true;
+    }
+    const size_t expression = symbolic(run, location, value);
+    if (expression == 0)
+        return true;
+    struct constraint *constraints = reserve(run->constraints, &run->constraint_capacity, run->constraint_count + 1,
+                                             sizeof(struct constraint));
+    if (constraints == NULL)
+        return false;
+    run->constraints = constraints;
+    constraints[run->constraint_count++] = (struct constraint){expression, kind, site, outcome, 0};
+    return true;
+}
+
+// Records the quotient of a division of an edge that depends on input by a constant, which fixes the value of ':' and
+// makes the value of '%' linear. Sets remainder to the expression of the remainder.
+static bool record_quotient(struct explorer *explorer, size_t cell, size_t expression, memory_edge dividend,
+                     memory_edge divisor, struct expression *remainder) {
+    struct run *run = &explorer->run;
+    struct constraint *constraints = reserve(run->constraints, &run->constraint_capacity, run->constraint_count + 1,
+                                             sizeof(struct constraint));
+    if (constraints == NULL)
+        return false;
+    run->constraints = constraints;
+    // in long, where the smallest edge by -1 does not overflow
+    const long value = (long)dividend / divisor;
+    const size_t site = (QUOTIENT * explorer->concolic->program->size + cell) * 6;
+    constraints[run->constraint_count++] = (struct constraint){expression, QUOTIENT, site, value, divisor};
+    const struct expression product = {.constant = value * divisor};
+    if (!combine(run->expressions + expression, 1, &product, -1, remainder))
+        *remainder = (struct expression){.constant = (long)dividend % divisor};
+    return true;
+}
+
+// Tracks the instruction vm_run() is about to execute, which it has returned VM_BREAK for.
+static bool before_instruction(struct explorer *explorer, struct vm *vm, struct pending *pending) {
+    struct run *run = &explorer->run;
+    const struct IP *IP = vm->IPs + vm->IP_index;
+    const size_t cell = axial_to_index(IP->p, IP->q, vm->program->rings);
+    const char instruction = vm->program->cells[cell].value;
+    *pending = (struct pending){vm->IP_index, IP->p, IP->q, instruction, 0, 0};
+
+    const size_t current = location_of(vm, get_memory_edge(vm->MP, &vm->memory, &vm->memory_rings));
+    size_t left = current, right = current;
+    if (instruction != '\0' && strchr("+-*:%&", instruction) != NULL) {
+        left = location_of(vm, get_neighbor(vm->MP, LEFT, &vm->memory, &vm->memory_rings));
+        right = location_of(vm, get_neighbor(vm->MP, RIGHT, &vm->memory, &vm->memory_rings));
+    }
+    if (!cover_memory(run, vm))
+        return false;
+    const memory_edge value = value_at(vm, current);
+
+    struct expression a, b, result;
+    const struct expression zero = {0};
+    if (isalpha((unsigned char)instruction))
+        return assign(run, current, NULL);
+    if (isdigit((unsigned char)instruction)) {
+        // the digit is added or subtracted depending on the sign of the edge times 10, which the constraints of the
+        // run do not cover, so this only holds for inputs that keep that sign
+        const memory_edge shifted = (memory_edge)((unsigned)value * 10);
+        const struct expression digit = {.constant = (shifted < 0 ? -1 : 1) * (instruction - '0')};
+        const bool tracked = operand(run, current, value, &a) && combine(&a, 10, &digit, 1, &result);
+        return assign(run, current, tracked ? &result : NULL);
+    }
+    switch (instruction) {
+    case ')':
+    case '(': {
+        const struct expression one = {.constant = instruction == ')' ? 1 : -1};
+        const bool tracked = operand(run, current, value, &a) && combine(&a, 1, &one, 1, &result);
+        return assign(run, current, tracked ? &result : NULL);
+    }
+    case '~': {
+        const bool tracked = operand(run, current, value, &a) && combine(&a, -1, &zero, 0, &result);
+        return assign(run, current, tracked ? &result : NULL);
+    }
+    case '+':
+    case '-':
+    case '*': {
+        const bool left_symbolic = operand(run, left, value_at(vm, left), &a);
+        const bool right_symbolic = operand(run, right, value_at(vm, right), &b);
+        bool tracked = false;
+        if (instruction != '*')
+            tracked = (left_symbolic || right_symbolic) && combine(&a, 1, &b, instruction == '+' ? 1 : -1, &result);
+        else if (left_symbolic != right_symbolic) // a product of two inputs is not linear
+            tracked = left_symbolic ? combine(&a, b.constant, &zero, 0, &result)
+                                    : combine(&b, a.constant, &zero, 0, &result);
+        return assign(run, current, tracked ? &result : NULL);
+    }
+    case ':':
+    case '%': {
+        const memory_edge dividend = value_at(vm, left), divisor = value_at(vm, right);
+        const size_t expression = symbolic(run, left, dividend);
+        // a division by zero ends the run, and a symbolic divisor would not be linear
+        if (expression == 0 || divisor == 0 || symbolic(run, right, divisor) != 0)
+            return assign(run, current, NULL);
+        return record_quotient(explorer, cell, expression, dividend, divisor, &result) &&
+               assign(run, current, instruction == '%' ? &result : NULL);
+    }
+    case '&': {
+        const size_t source = value <= 0 ? left : right;
+        const bool tracked = operand(run, source, value_at(vm, source), &a);
+        return branch(explorer, COPY, cell, 0, current, value) && assign(run, current, tracked ? &a : NULL);
+    }
+    case ',':
+    case '?':
+        pending->location = current;
+        pending->input_position = vm->input_position;
+        return assign(run, current, NULL);
+    case '<':
+        return IP->direction != E || branch(explorer, MIRROR, cell, E, current, value);
+    case '>':
+        return IP->direction != W || branch(explorer, MIRROR, cell, W, current, value);
+    case '^':
+        return branch(explorer, MOVE, cell, 0, current, value);
+    case '#':
+        return branch(explorer, SWITCH, cell, 0, current, value);
+    }
+    return true;
+}
+
+// Tracks what the pending instruction read, and the corners the IP went through after it.
+static bool after_instruction(struct explorer *explorer, struct vm *vm, const struct pending *pending) {
+    struct run *run = &explorer->run;
+    if (pending->instruction == ',' || pending->instruction == '?') {
+        struct variable *variables = reserve(run->variables, &run->variable_capacity, run->variable_count + 1,
+                                             sizeof(struct variable));
+        if (variables == NULL)
+            return false;
+        run->variables = variables;
+        size_t start = pending->input_position;
+        // the number starts at its sign or first digit, what '?' skipped before that is kept as it is
+        while (pending->instruction == '?' && start < vm->input_position && vm->input[start] != '+' &&
+               vm->input[start] != '-' && !isdigit((unsigned char)vm->input[start]))
+            start++;
+        variables[run->variable_count] = (struct variable){
+            .number = pending->instruction == '?',
+            .value = value_at(vm, pending->location),
+            .start = start,
+            .end = vm->input_position,
+        };
+        const struct expression read = {.term_count = 1, .terms = {{run->variable_count++, 1}}};
+        if (!assign(run, pending->location, &read))
+            return false;
+    }
+
+    // '$' moves the IP twice, over the instruction it skips
+    const long rings = vm->program->rings;
+    const enum direction direction = vm->IPs[pending->IP].direction;
+    const size_t current = location_of(vm, get_memory_edge(vm->MP, &vm->memory, &vm->memory_rings));
+    if (!cover_memory(run, vm))
+        return false;
+    struct IP IP = {pending->p, pending->q, direction, false};
+    for (int move = 0; move < (pending->instruction == '$' ? 2 : 1); move++) {
+        const size_t cell = axial_to_index(IP.p, IP.q, rings);
+        if (ip_step(rings, &IP) != IP_CORNER)
+            continue;
+        ip_wrap(&IP, value_at(vm, current) > 0);
+        if (!branch(explorer, CORNER, cell, direction, current, value_at(vm, current)))
+            return false;
+    }
+    return true;
+}
+
+// Runs the program on an input, recording the ways its branches went and the constraints they put on the input.
+static bool run_input(struct explorer *explorer, struct vm *vm, const char *input, size_t length,
+                      enum concolic_end *end) {
+    struct run *run = &explorer->run;
+    run->expression_count = 1;
+    run->variable_count = 0;
+    run->constraint_count = 0;
+    run->new_coverage = false;
+    memset(run->shadow, 0, run->shadow_size * sizeof(size_t));
+    if (!vm_reset(vm))
+        return false;
+    vm_set_input(vm, input, length);
+    vm_close_input(vm);
+    vm_set_output(vm, explorer->output, explorer->output_capacity);
+    vm->step_limit = explorer->concolic->step_limit;
+    vm->force_debug = true;
+    bool has_pending = false;
+    struct pending pending;
+    while (true) {
+        const enum vm_status status = vm_run(vm);
+        if (status == VM_OUTPUT) { // the instruction is run again with more room, so it is still pending
+            char *output = reserve(explorer->output, &explorer->output_capacity, explorer->output_capacity + 1, 1);
+            if (output == NULL)
+                return false;
+            explorer->output = vm->output = output;
+            vm->output_capacity = explorer->output_capacity;
+            continue;
+        }
+        if (status == VM_HALTED) {
+            *end = CONCOLIC_HALTED;
+            return true;
+        }
+        if (status == VM_DIVIDE_BY_ZERO) {
+            *end = CONCOLIC_DIVISION_BY_ZERO;
+            return true;
+        }
+        if (has_pending && !after_instruction(explorer, vm, &pending))
+            return false;
+        has_pending = false;
+        if (status == VM_YIELD) {
+            *end = CONCOLIC_STEP_LIMIT;
+            return true;
+        }
+        // an instruction grows memory by at most one ring, so this stops a run right past the limit
+        if (vm->memory_rings > explorer->concolic->memory_limit) {
+            *end = CONCOLIC_MEMORY_LIMIT;
+            return true;
+        }
+        if (!before_instruction(explorer, vm, &pending))
+            return false;
+        has_pending = true;
+    }
+}
+
+// Narrows [lo, hi] to the values of x for which a * x + b > 0, or a * x + b <= 0 if positive is false.
+static void narrow_linear(long a, long b, bool positive, long *lo, long *hi) {
+    const long quotient = -b / a, remainder = -b % a;
+    const long rounded_down = quotient - (remainder != 0 && (remainder < 0) != (a < 0));
+    const long rounded_up = quotient + (remainder != 0 && (remainder < 0) == (a < 0));
+    if (positive && a > 0 && rounded_down + 1 > *lo)
+        *lo = rounded_down + 1;
+    if (positive && a < 0 && rounded_up - 1 < *hi)
+        *hi = rounded_up - 1;
+    if (!positive && a > 0 && rounded_down < *hi)
+        *hi = rounded_down;
+    if (!positive && a < 0 && rounded_up > *lo)
+        *lo = rounded_up;
+}
+
+// Narrows [lo, hi] to the values of variable that satisfy a constraint, with the other variables keeping their
+// values. '#' does not give an interval and is checked value by value instead.
+static void narrow(const struct run *run, const struct constraint *constraint, size_t variable, long *lo, long *hi) {
+    const struct expression *expression = run->expressions + constraint->expression;
+    long a = 0;
+    for (int i = 0; i < expression->term_count; i++) {
+        if (expression->terms[i].variable == variable)
+            a = expression->terms[i].coefficient;
+    }
+    if (constraint->kind == SWITCH || a == 0)
+        return;
+    const long b = evaluate(expression, run->variables, variable, 0);
+    if (constraint->kind != QUOTIENT) {
+        narrow_linear(a, b, constraint->outcome == 1, lo, hi);
+        return;
+    }
+    // division truncates, so the dividends with a quotient are a range of |divisor| values, or 2 |divisor| - 1
+    // around 0
+    const long divisor = labs(constraint->divisor);
+    const long scaled = constraint->outcome * (constraint->divisor < 0 ? -1 : 1) * divisor;
+    const long first = scaled > 0 ? scaled : scaled - (divisor - 1);
+    const long last = scaled < 0 ? scaled : scaled + (divisor - 1);
+    narrow_linear(a, b - first + 1, true, lo, hi);
+    narrow_linear(a, b - last, false, lo, hi);
+}
+
+static bool holds(const struct run *run, const struct constraint *constraint, size_t variable, long value) {
+    const long result = evaluate(run->expressions + constraint->expression, run->variables, variable, value);
+    if (constraint->kind == QUOTIENT)
+        return result / constraint->divisor == constraint->outcome;
+    return outcome_of(constraint->kind, result) == constraint->outcome;
+}
+
+static bool satisfies(const struct run *run, size_t count, const struct constraint *target, size_t variable,
+                      long value) {
+    if (!holds(run, target, variable, value))
+        return false;
+    for (size_t i = 0; i < count; i++) {
+        if (!holds(run, run->constraints + i, variable, value))
+            return false;
+    }
+    return true;
+}
+
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+// Finds a new value for one of the variables of the target that satisfies it, while the constraints before it still
+// go the way they went. Every other variable keeps the value it had in the run. The value is the closest one to the
+// old value, or a random one if random is not NULL, which spreads the paths out more than solving for the edges of
+// the ranges a program dispatches on.
+static bool solve(const struct run *run, size_t count, const struct constraint *target, uint64_t *random,
+                  size_t *variable, long *value) {
+    const struct expression *expression = run->expressions + target->expression;
+    for (int t = 0; t < expression->term_count; t++) {
+        const size_t v = expression->terms[t].variable;
+        long lo = run->variables[v].number ? -NUMBER_LIMIT : EOF;
+        long hi = run->variables[v].number ? NUMBER_LIMIT : UCHAR_MAX;
+        narrow(run, target, v, &lo, &hi);
+        for (size_t i = 0; i < count && lo <= hi; i++)
+            narrow(run, run->constraints + i, v, &lo, &hi);
+        if (lo > hi)
+            continue;
+        // '#' repeats every six values, so the value closest to the start that satisfies it is among these
+        const long old = run->variables[v].value;
+        const long start = random != NULL ? lo + (long)(next_random(random) % (uint64_t)(hi - lo + 1))
+                           : old < lo     ? lo
+                           : old > hi     ? hi
+                                          : old;
+        for (long k = 0; k < 11; k++) {
+            const long x = start + (k + 1) / 2 * (k % 2 == 1 ? 1 : -1);
+            if (x >= lo && x <= hi && satisfies(run, count, target, v, x)) {
+                *variable = v;
+                *value = x;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// FNV-1a, which is never 0 so that 0 can mark empty slots
+static uint64_t hash_input(const char *input, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)input[i]) * 1099511628211ULL;
+    return hash != 0 ? hash : 1;
+}
+
+// Adds an input to the inputs seen so far. Returns false if it was already there, or in errors.
+static bool see_input(struct explorer *explorer, const char *input, size_t length, bool *failed) {
+    if (2 * (explorer->seen_count + 1) > explorer->seen_capacity) {
+        // rehashing into a table twice the size keeps it at most half full
+        const size_t capacity = explorer->seen_capacity > 0 ? 2 * explorer->seen_capacity : INITIAL_CAPACITY;
+        uint64_t *seen = calloc(capacity, sizeof(uint64_t));
+        if (seen == NULL) {
+            *failed = true;
+            return false;
+        }
+        for (size_t i = 0; i < explorer->seen_capacity; i++) {
+            size_t slot = explorer->seen[i] & (capacity - 1);
+            while (explorer->seen[i] != 0 && seen[slot] != 0)
+                slot = (slot + 1) & (capacity - 1);
+            seen[slot] = explorer->seen[i];
+        }
+        free(explorer->seen);
+        explorer->seen = seen;
+        explorer->seen_capacity = capacity;
+    }
+    const uint64_t hash = hash_input(input, length);
+    size_t slot = hash & (explorer->seen_capacity - 1);
+    while (explorer->seen[slot] != 0) {
+        if (explorer->seen[slot] == hash)
+            return false;
+        slot = (slot + 1) & (explorer->seen_capacity - 1);
+    }
+    explorer->seen[slot] = hash;
+    explorer->seen_count++;
+    return true;
+}
+
+// Queues an input it has not seen before, taking it over.
+static bool push_input(struct explorer *explorer, enum priority priority, char *input, size_t length, size_t bound) {
+    struct queue *queue = explorer->queues + priority;
+    bool failed = false;
+    if (!see_input(explorer, input, length, &failed)) {
+        free(input);
+        return !failed;
+    }
+    struct queued *items = reserve(queue->items, &queue->capacity, queue->count + 1, sizeof(struct queued));
+    if (items == NULL) {
+        free(input);
+        return false;
+    }
+    queue->items = items;
+    items[queue->count++] = (struct queued){input, length, bound};
+    return true;
+}
+
+// Queues the input the run read with one variable changed to value, for a run that flips constraints from bound on.
+static bool queue_input(struct explorer *explorer, enum priority priority, const char *input, size_t length,
+                        size_t variable, long value, size_t bound) {
+    const struct variable *read = explorer->run.variables + variable;
+    char decimal[DECIMAL_LENGTH + 1];
+    size_t replacement_length = 0;
+    size_t end = read->end;
+    if (read->number) {
+        // an empty span is at EOF, and a number inserted there needs to end before whatever another '?' inserts
+        replacement_length = snprintf(decimal, sizeof(decimal), read->start == read->end ? "%ld\n" : "%ld", value);
+    } else if (value == EOF) {
+        end = length; // the input ends where the byte was read
+    } else {
+        decimal[0] = (char)value;
+        replacement_length = 1;
+    }
+    const size_t new_length = read->start + replacement_length + (length - end);
+    char *new_input = malloc(new_length > 0 ? new_length : 1);
+    if (new_input == NULL)
+        return false;
+    memcpy(new_input, input, read->start);
+    memcpy(new_input + read->start, decimal, replacement_length);
+    memcpy(new_input + read->start + replacement_length, input + end, length - end);
+    return push_input(explorer, priority, new_input, new_length, bound);
+}
+
+// Solves for the ways the constraints of the last run did not go. Flipping constraint i keeps the ones before it, so
+// the runs of the new inputs only need to flip the ones after it. Only the first constraint of a run at a branch is
+// solved for each way, as loops repeat the rest.
+static bool flip_constraints(struct explorer *explorer, const struct queued *item, unsigned long run_number,
+                             struct concolic_statistics *statistics) {
+    const struct run *run = &explorer->run;
+    for (size_t i = item->bound; i < run->constraint_count; i++) {
+        const struct constraint *constraint = run->constraints + i;
+        // a quotient goes one lower or one higher
+        for (int way = 0; way < outcome_count(constraint->kind); way++) {
+            struct constraint target = *constraint;
+            target.outcome = constraint->kind == QUOTIENT ? constraint->outcome + (way == 0 ? -1 : 1) : way;
+            if (target.outcome == constraint->outcome || explorer->tried[constraint->site * 6 + way] == run_number)
+                continue;
+            explorer->tried[constraint->site * 6 + way] = run_number;
+            const bool new_way = constraint->kind != QUOTIENT && !(explorer->covered[constraint->site] & 1 << way);
+            size_t variable;
+            long value;
+            if (!solve(run, i, &target, new_way ? NULL : &explorer->random, &variable, &value)) {
+                statistics->unsolved++;
+                continue;
+            }
+            statistics->solved++;
+            const enum priority priority = new_way                ? NEW_WAY
+                                           : run->new_coverage ? NEW_PATH_FROM_NEW_WAY
+                                                               : NEW_PATH;
+            if (!queue_input(explorer, priority, item->input, item->length, variable, value, i + 1))
+                return false;
+        }
+    }
+    return true;
+}
+
+// takes the next input to run, or returns false if there are none left
+static bool next_input(struct explorer *explorer, struct queued *item) {
+    for (int priority = 0; priority < PRIORITIES; priority++) {
+        struct queue *queue = explorer->queues + priority;
+        if (queue->head < queue->count) {
+            *item = queue->items[queue->head++];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool run_concolic(const struct concolic *concolic, struct concolic_statistics *statistics) {
+    const size_t site_count = CONSTRAINT_KINDS * concolic->program->size * 6;
+    struct explorer explorer = {
+        .concolic = concolic,
+        .covered = calloc(site_count, 1),
+        .tried = calloc(site_count * 6, sizeof(unsigned long)),
+        .output = malloc(BUFSIZ),
+        .output_capacity = BUFSIZ,
+        .random = 88172645463325252ULL,
+    };
+    struct vm vm = {0};
+    bool success = explorer.covered != NULL && explorer.tried != NULL && explorer.output != NULL
+                   && vm_init(&vm, concolic->program);
+
+    // without seeds the exploration starts from empty input
+    const struct seed empty = {"", 0};
+    const struct seed *seeds = concolic->seed_count > 0 ? concolic->seeds : &empty;
+    const size_t seed_count = concolic->seed_count > 0 ? concolic->seed_count : 1;
+    for (size_t i = 0; success && i < seed_count; i++) {
+        char *input = malloc(seeds[i].length > 0 ? seeds[i].length : 1);
+        success = input != NULL;
+        if (success) {
+            memcpy(input, seeds[i].input, seeds[i].length);
+            success = push_input(&explorer, NEW_WAY, input, seeds[i].length, 0);
+        }
+    }
+
+    struct queued item;
+    while (success && (concolic->max_runs == 0 || statistics->runs < concolic->max_runs) &&
+           next_input(&explorer, &item)) {
+        enum concolic_end end;
+        success = run_input(&explorer, &vm, item.input, item.length, &end);
+        statistics->runs++;
+        // the first run is kept even if the program has no branches, so that there is an input to test it with
+        if (success && (explorer.run.new_coverage || statistics->runs == 1)) {
+            statistics->inputs++;
+            concolic->found(concolic->context, item.input, item.length, vm.output, vm.output_length, end);
+        }
+        success = success && flip_constraints(&explorer, &item, statistics->runs, statistics);
+        free(item.input);
+    }
+
+    for (size_t site = 0; success && site < site_count; site++) {
+        if (explorer.covered[site] == 0)
+            continue;
+        statistics->branches++;
+        statistics->outcomes += outcome_count(site / 6 / concolic->program->size);
+        for (int outcome = 0; outcome < 6; outcome++)
+            statistics->covered_outcomes += explorer.covered[site] >> outcome & 1;
+    }
+
+    for (int priority = 0; priority < PRIORITIES; priority++) {
+        struct queue *queue = explorer.queues + priority;
+        for (size_t i = queue->head; i < queue->count; i++)
+            free(queue->items[i].input);
+        free(queue->items);
+    }
+    vm_free(&vm);
+    free(explorer.seen);
+    free(explorer.covered);
+    free(explorer.tried);
+    free(explorer.output);
+    free(explorer.run.expressions);
+    free(explorer.run.shadow);
+    free(explorer.run.variables);
+    free(explorer.run.constraints);
+    return success;
+}
@@ -0,0 +1,52 @@
+#ifndef HEXAGONY_CONCOLIC_H
+#define HEXAGONY_CONCOLIC_H
+
+#include "vm.h"
+
+// an input to start exploring from
+struct seed {
+    const char *input;
+    size_t length;
+};
+
+// how a run ended
+enum concolic_end {
+    CONCOLIC_HALTED,
+    CONCOLIC_STEP_LIMIT,
+    CONCOLIC_MEMORY_LIMIT,
+    CONCOLIC_DIVISION_BY_ZERO,
+};
+
+// What to explore. Every run has its input followed by EOF and stops after step_limit steps or once its memory grows
+// past memory_limit rings.
+struct concolic {
+    const struct program *program;
+    const struct seed *seeds;
+    size_t seed_count;
+    unsigned long step_limit;
+    long memory_limit;
+    unsigned long max_runs;
+    // called for every input that takes a branch the way no earlier input did, with the output of its run
+    void (*found)(void *context, const char *input, size_t input_length, const char *output, size_t output_length,
+                  enum concolic_end end);
+    void *context;
+};
+
+struct concolic_statistics {
+    unsigned long runs;
+    unsigned long inputs;    // passed to found
+    unsigned long solved;    // branches the solver found an input to flip
+    unsigned long unsolved;  // branches it could not
+    size_t branches;         // data-dependent branches some run reached
+    size_t outcomes;         // ways those branches can go
+    size_t covered_outcomes; // ways some run took
+};
+
+// Explores the branches of a program from the seeds. Each run is concrete, and alongside it every memory edge that
+// depends on input is tracked as a linear expression of the bytes that ',' and the numbers that '?' read. Every
+// branch on such an edge adds a constraint on the input: the '<' and '>' branches, corners, '^', '&' and '#'. For
+// every constraint that went a way no run took yet, the other ways are solved for with the constraints before it
+// still holding, which gives new inputs to run. Division by zero ends a run instead of crashing the process.
+bool run_concolic(const struct concolic *concolic, struct concolic_statistics *statistics);
+
+#endif
@@ -0,0 +1,37 @@
+#include "file.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Regular files are read into a buffer of their size in one go, anything else into a buffer that grows as needed.
+char *read_file(const char *filename, size_t *length) {
+    const int fd = open(filename, O_RDONLY);
+    struct stat stat;
+    if (fd < 0 || fstat(fd, &stat) != 0) {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    size_t capacity = S_ISREG(stat.st_mode) && stat.st_size > 0 ? (size_t)stat.st_size + 1 : BUFSIZ;
+    char *buffer = malloc(capacity);
+    *length = 0;
+    ssize_t n = 0;
+    while (buffer != NULL && (n = read(fd, buffer + *length, capacity - *length)) > 0) {
+        *length += n;
+        if (*length == capacity) {
+            char *grown = realloc(buffer, capacity *= 2);
+            if (grown == NULL)
+                free(buffer);
+            buffer = grown;
+        }
+    }
+    close(fd);
+    if (n < 0) {
+        free(buffer);
+        return NULL;
+    }
+    return buffer;
+}
@@ -0,0 +1,10 @@
+#ifndef HEXAGONY_FILE_H
+#define HEXAGONY_FILE_H
+
+#include <stddef.h>
+
+// Reads the whole file into a heap buffer and sets length to its size. Returns NULL with errno set if it could not
+// be opened or read, or memory ran out.
+char *read_file(const char *filename, size_t *length);
+
+#endif
@@ -0,0 +1,142 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "concolic.h"
+#include "file.h"
+#include "vm.h"
+
+#define DEFAULT_STEPS 100000
+#define DEFAULT_RUNS 10000
+#define DEFAULT_MEMORY 256 // rings, about a million edges
+
+static const char *end_name[] = {
+    [CONCOLIC_HALTED] = "halted",
+    [CONCOLIC_STEP_LIMIT] = "step limit",
+    [CONCOLIC_MEMORY_LIMIT] = "memory limit",
+    [CONCOLIC_DIVISION_BY_ZERO] = "division by zero",
+};
+
+// where the inputs that cover new branches go
+struct corpus {
+    const char *directory;
+    unsigned long count;
+    bool failed;
+};
+
+static bool write_file(const char *filename, const char *data, size_t length) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL)
+        return false;
+    const bool written = fwrite(data, 1, length, file) == length;
+    return fclose(file) == 0 && written;
+}
+
+// writes an input and the output of its run as NNNNNN.in and NNNNNN.out, and lists it on stdout
+static void save_input(void *context, const char *input, size_t input_length, const char *output,
+                       size_t output_length, enum concolic_end end) {
+    struct corpus *corpus = context;
+    const size_t size = strlen(corpus->directory) + 16;
+    char *filename = malloc(size);
+    if (filename == NULL) {
+        corpus->failed = true;
+        return;
+    }
+    corpus->count++;
+    snprintf(filename, size, "%s/%06lu.in", corpus->directory, corpus->count);
+    bool written = write_file(filename, input, input_length);
+    snprintf(filename, size, "%s/%06lu.out", corpus->directory, corpus->count);
+    written = written && write_file(filename, output, output_length);
+    if (written) {
+        printf("%s/%06lu.in: %s\n", corpus->directory, corpus->count, end_name[end]);
+    } else {
+        perror(filename);
+        corpus->failed = true;
+    }
+    free(filename);
+}
+
+int main(int argc, char **argv) {
+    unsigned long steps = DEFAULT_STEPS, runs = DEFAULT_RUNS;
+    long memory = DEFAULT_MEMORY;
+    int first_argument = 1;
+    for (; first_argument + 1 < argc && strncmp(argv[first_argument], "--", 2) == 0; first_argument += 2) {
+        if (strcmp(argv[first_argument], "--steps") == 0) {
+            steps = strtoul(argv[first_argument + 1], NULL, 10);
+        } else if (strcmp(argv[first_argument], "--runs") == 0) {
+            runs = strtoul(argv[first_argument + 1], NULL, 10);
+        } else if (strcmp(argv[first_argument], "--memory") == 0) {
+            memory = atol(argv[first_argument + 1]);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[first_argument]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (first_argument + 2 > argc || steps == 0 || memory < 1) {
+        fputs("Usage: hexagony-concolic [--steps N] [--runs N] [--memory RINGS] PROGRAM CORPUS [SEED...]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    size_t length;
+    char *source = read_file(argv[first_argument], &length);
+    struct program program;
+    if (source == NULL || !parse_program(&program, source, length)) {
+        perror("Error reading program");
+        free(source);
+        return EXIT_FAILURE;
+    }
+    free(source);
+    struct corpus corpus = {.directory = argv[first_argument + 1]};
+    if (mkdir(corpus.directory, 0777) != 0 && errno != EEXIST) {
+        perror(corpus.directory);
+        free_program(&program);
+        return EXIT_FAILURE;
+    }
+
+    const int seed_count = argc - first_argument - 2;
+    struct seed *seeds = calloc(seed_count > 0 ? seed_count : 1, sizeof(struct seed));
+    bool success = seeds != NULL;
+    for (int i = 0; success && i < seed_count; i++) {
+        seeds[i].input = read_file(argv[first_argument + 2 + i], &seeds[i].length);
+        if (seeds[i].input == NULL) {
+            perror(argv[first_argument + 2 + i]);
+            success = false;
+        }
+    }
+
+    struct concolic_statistics statistics = {0};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (success) {
+        const struct concolic concolic = {
+            .program = &program,
+            .seeds = seeds,
+            .seed_count = seed_count,
+            .step_limit = steps,
+            .memory_limit = memory,
+            .max_runs = runs,
+            .found = save_input,
+            .context = &corpus,
+        };
+        success = run_concolic(&concolic, &statistics);
+        if (!success)
+            perror("Error exploring program");
+        success = success && !corpus.failed;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%lu runs, %lu inputs kept in %.2f s\n", statistics.runs, statistics.inputs, seconds);
+    fprintf(stderr, "%zu of %zu ways of the %zu branches reached were taken\n", statistics.covered_outcomes,
+            statistics.outcomes, statistics.branches);
+    fprintf(stderr, "%lu branches flipped by the solver, %lu could not be\n", statistics.solved, statistics.unsolved);
+
+    for (int i = 0; seeds != NULL && i < seed_count; i++)
+        free((char *)seeds[i].input);
+    free(seeds);
+    free_program(&program);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,88 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "file.h"
+#include "optimize.h"
+#include "vm.h"
+
+#define DEFAULT_STEPS 100000000UL // the original program has to halt within this on every input
+
+// writes the program as a hexagon, one row per line
+static void print_hexagon(const struct program *program) {
+    size_t i = 0;
+    for (long z = -(program->rings - 1); z < program->rings; z++) {
+        printf("%*s", (int)labs(z), "");
+        for (long x = 0; x < 2 * program->rings - 1 - labs(z); x++)
+            printf(x > 0 ? " %c" : "%c", program->cells[i++].value);
+        putchar('\n');
+    }
+}
+
+int main(int argc, char **argv) {
+    unsigned long step_limit = DEFAULT_STEPS;
+    int first_argument = 1;
+    if (argc > 2 && strcmp(argv[1], "--steps") == 0) {
+        step_limit = strtoul(argv[2], NULL, 10);
+        first_argument = 3;
+    }
+    if (first_argument >= argc || step_limit == 0) {
+        fputs("Usage: hexagony-optimize [--steps N] PROGRAM [INPUT...]\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    size_t length;
+    char *source = read_file(argv[first_argument], &length);
+    struct program program;
+    if (source == NULL || !parse_program(&program, source, length)) {
+        perror("Error reading program");
+        free(source);
+        return EXIT_FAILURE;
+    }
+    free(source);
+
+    // without input files the program is run once on empty input
+    const int count = argc - first_argument - 1 > 0 ? argc - first_argument - 1 : 1;
+    struct sample *samples = calloc(count, sizeof(struct sample));
+    bool success = samples != NULL;
+    for (int i = 0; success && first_argument + 1 + i < argc; i++) {
+        samples[i].input = read_file(argv[first_argument + 1 + i], &samples[i].input_length);
+        if (samples[i].input == NULL) {
+            perror(argv[first_argument + 1 + i]);
+            success = false;
+        }
+    }
+    if (success && !record_samples(&program, samples, count, step_limit)) {
+        fprintf(stderr, "The program does not halt within %lu steps on every input\n", step_limit);
+        success = false;
+    }
+
+    unsigned long *original_steps = success ? malloc(count * sizeof(unsigned long)) : NULL;
+    const long original_rings = program.rings;
+    if (original_steps == NULL)
+        success = false;
+    for (int i = 0; success && i < count; i++)
+        original_steps[i] = samples[i].steps;
+    if (success && !optimize_program(&program, samples, count)) {
+        perror("Error optimizing program");
+        success = false;
+    }
+    if (success) {
+        print_hexagon(&program);
+        fprintf(stderr, "rings: %ld -> %ld\n", original_rings, program.rings);
+        for (int i = 0; i < count; i++) {
+            const char *input = first_argument + 1 + i < argc ? argv[first_argument + 1 + i] : "(no input)";
+            fprintf(stderr, "%s: %lu -> %lu steps\n", input, original_steps[i], samples[i].steps);
+        }
+    }
+
+    for (int i = 0; samples != NULL && i < count; i++) {
+        free((char *)samples[i].input);
+        free(samples[i].output);
+    }
+    free(samples);
+    free(original_steps);
+    free_program(&program);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
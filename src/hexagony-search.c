@@ -0,0 +1,237 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "search.h"
+#include "vm.h"
+
+// every instruction except the letters, which only differ in the value they set
+#define DEFAULT_ALPHABET ".@)(+-*:%~,?;!$/\\_|<>[]#{}\"'=^&0123456789"
+#define DEFAULT_RINGS 2
+#define DEFAULT_STEPS 1000
+#define DEFAULT_WILDCARD 'X'
+
+struct options {
+    long rings;
+    const char *template_file;
+    char wildcard;
+    const char *alphabet;
+    unsigned long steps;
+    int threads;
+    unsigned long solutions;
+};
+
+// Undoes the escapes \n, \t and \\ in place and returns the new length. Returns -1 for any other escape.
+static long unescape(char *text) {
+    size_t length = 0;
+    for (size_t i = 0; text[i] != '\0'; i++) {
+        if (text[i] != '\\') {
+            text[length++] = text[i];
+            continue;
+        }
+        switch (text[++i]) {
+        case 'n': text[length++] = '\n'; break;
+        case 't': text[length++] = '\t'; break;
+        case '\\': text[length++] = '\\'; break;
+        default: return -1;
+        }
+    }
+    return length;
+}
+
+// Reads examples, one per line as the input and the expected output separated by a tab, skipping blank lines and
+// # comments. Returns the number read or -1 on errors, which are reported to stderr.
+static long read_examples(const char *filename, struct example **examples) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        perror("Error opening examples");
+        return -1;
+    }
+    *examples = NULL;
+    long count = 0;
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    for (long number = 1; (length = getline(&line, &capacity, file)) >= 0; number++) {
+        if (length > 0 && line[length - 1] == '\n')
+            line[--length] = '\0';
+        if (length == 0 || line[0] == '#')
+            continue;
+        char *tab = strchr(line, '\t');
+        struct example *grown = realloc(*examples, (count + 1) * sizeof(struct example));
+        if (grown == NULL) {
+            perror("Error allocating memory");
+            count = -1;
+            break;
+        }
+        *examples = grown;
+        long input_length = -1, output_length = -1;
+        if (tab != NULL) {
+            *tab = '\0';
+            input_length = unescape(line);
+            output_length = unescape(tab + 1);
+        }
+        if (input_length < 0 || output_length < 0) {
+            fprintf(stderr, "%s:%ld: expected INPUT<tab>OUTPUT with only \\n, \\t and \\\\ escaped\n", filename,
+                    number);
+            count = -1;
+            break;
+        }
+        grown[count++] = (struct example){
+            .input = strndup(line, input_length),
+            .input_length = input_length,
+            .output = strndup(tab + 1, output_length),
+            .output_length = output_length,
+        };
+    }
+    free(line);
+    fclose(file);
+    return count;
+}
+
+// Lays out the hexagon to search. With a template, its wildcard cells are free and the rest keep their instruction,
+// otherwise every cell of a hexagon with the given number of rings is free.
+static bool make_template(const struct options *options, struct program *template, size_t **free_cells,
+                          size_t *free_count) {
+    if (options->template_file != NULL) {
+        FILE *file = fopen(options->template_file, "r");
+        if (file == NULL) {
+            perror("Error opening template");
+            return false;
+        }
+        char *source = NULL;
+        size_t capacity = 0;
+        const ssize_t length = getdelim(&source, &capacity, '\0', file);
+        fclose(file);
+        const bool parsed = length >= 0 && parse_program(template, source, length);
+        free(source);
+        if (!parsed) {
+            perror("Error reading template");
+            return false;
+        }
+    } else {
+        template->rings = options->rings;
+        template->size = 3 * options->rings * (options->rings - 1) + 1;
+        template->cells = malloc(template->size * sizeof(struct program_cell));
+        if (template->cells == NULL) {
+            perror("Error allocating memory");
+            return false;
+        }
+        for (size_t i = 0; i < template->size; i++)
+            template->cells[i] = (struct program_cell){options->wildcard, false};
+    }
+    *free_cells = malloc(template->size * sizeof(size_t));
+    if (*free_cells == NULL) {
+        perror("Error allocating memory");
+        free_program(template);
+        return false;
+    }
+    *free_count = 0;
+    for (size_t i = 0; i < template->size; i++) {
+        if (template->cells[i].value == options->wildcard)
+            (*free_cells)[(*free_count)++] = i;
+    }
+    return true;
+}
+
+// prints a solution on one line, without the no-ops it ends in
+static void print_solution(void *context, const struct program *program) {
+    (void)context;
+    size_t length = program->size;
+    while (length > 0 && program->cells[length - 1].value == '.')
+        length--;
+    for (size_t i = 0; i < length; i++)
+        putchar(program->cells[i].value);
+    putchar('\n');
+    fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+    struct options options = {
+        .rings = DEFAULT_RINGS,
+        .wildcard = DEFAULT_WILDCARD,
+        .alphabet = DEFAULT_ALPHABET,
+        .steps = DEFAULT_STEPS,
+        .threads = sysconf(_SC_NPROCESSORS_ONLN),
+        .solutions = 0,
+    };
+    int first_argument = 1;
+    for (; first_argument + 1 < argc && strncmp(argv[first_argument], "--", 2) == 0; first_argument += 2) {
+        const char *value = argv[first_argument + 1];
+        if (strcmp(argv[first_argument], "--rings") == 0) {
+            options.rings = atol(value);
+        } else if (strcmp(argv[first_argument], "--template") == 0) {
+            options.template_file = value;
+        } else if (strcmp(argv[first_argument], "--wildcard") == 0 && value[0] != '\0' && value[1] == '\0') {
+            options.wildcard = value[0];
+        } else if (strcmp(argv[first_argument], "--alphabet") == 0) {
+            options.alphabet = value;
+        } else if (strcmp(argv[first_argument], "--steps") == 0) {
+            options.steps = strtoul(value, NULL, 10);
+        } else if (strcmp(argv[first_argument], "--threads") == 0) {
+            options.threads = atoi(value);
+        } else if (strcmp(argv[first_argument], "--solutions") == 0) {
+            options.solutions = strtoul(value, NULL, 10);
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[first_argument]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (first_argument + 1 != argc || options.rings < 1 || options.alphabet[0] == '\0' || options.steps == 0 ||
+        options.threads < 1) {
+        fputs("Usage: hexagony-search [--rings N] [--template FILE] [--wildcard C] [--alphabet CHARS] [--steps N]\n"
+              "                       [--threads N] [--solutions N] EXAMPLES\n",
+              stderr);
+        return EXIT_FAILURE;
+    }
+    if (strchr(options.alphabet, '`') != NULL) {
+        fputs("The alphabet cannot contain `, which marks breakpoints\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    struct example *examples;
+    const long example_count = read_examples(argv[first_argument], &examples);
+    if (example_count < 0)
+        return EXIT_FAILURE;
+    struct program template;
+    size_t *free_cells = NULL;
+    size_t free_count = 0;
+    bool success = make_template(&options, &template, &free_cells, &free_count);
+
+    struct search_statistics statistics = {0};
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (success) {
+        const struct search search = {
+            .template = &template,
+            .free_cells = free_cells,
+            .free_count = free_count,
+            .alphabet = options.alphabet,
+            .examples = examples,
+            .example_count = example_count,
+            .step_limit = options.steps,
+            .threads = options.threads,
+            .max_solutions = options.solutions,
+            .found = print_solution,
+        };
+        success = run_search(&search, &statistics);
+        if (!success)
+            perror("Error running search");
+        free_program(&template);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    const double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(stderr, "%lu solutions, %lu candidates run in %.2f s (%.0f per second)\n", statistics.solutions,
+            statistics.candidates, seconds, statistics.candidates / (seconds > 0 ? seconds : 1));
+
+    for (long i = 0; i < example_count; i++) {
+        free(examples[i].input);
+        free(examples[i].output);
+    }
+    free(examples);
+    free(free_cells);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,163 +1,79 @@
-
 #include <ctype.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#ifndef HEXAGONY_NO_DEBUGGER
 #include <math.h>
+#endif
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "file.h"
+#include "io.h"
+#include "pipeline.h"
+#include "records.h"
+#include "sandbox.h"
+#include "trace.h"
+#include "workers.h"
+#include "vm.h"
+#include "watch.h"
+#include "width.h"
 
 #define STRINGIFY(x) #x
 #define STRINGIZE(x) STRINGIFY(x)
 
-#define MEM_FMT_LEN 2 // digits per cell in memory debug view
-#define MEM_FMT "%" STRINGIZE(MEM_FMT_LEN) "d"
-
-enum axis { X, Y, Z };
-enum direction { NW, NE, E, SE, SW, W };
-enum neighbor { LEFT = -1, RIGHT = 1 };
-
-struct program_cell {
-    char value;
-    bool debug;
-};
-
-// Memory is defined as an infinite hexagonal grid where each egde is a value.
-// see https://www.redblobgames.com/grids/hexagons/ for terminology
-
-// In this implementation, memory is indexed with the axial coordinates of a
-// hexagonal grid. Each hexagon in the grid stores 3 values, one for each cubic
-// axis.
-
-typedef int memory_edge;
-
-struct memory_cell {
-    memory_edge value[3];
-};
+#define EXIT_MISMATCH 3 // the output differs from the --expect file
+#define DEFAULT_WATCH_STEPS 100000000
 
-struct memory_pointer {
-    long p, q;
-    enum axis axis;
-    enum { IN, OUT } direction;
-};
+// width of the memory edges of a single run, auto starts with 32 bits and carries on with 64 once a value overflows
+enum width { WIDTH_32, WIDTH_64, WIDTH_AUTO };
 
-// axial offests for each hexagonal direction
-const struct {
-    long dp, dq;
-} direction_offset[] = {
-    [NW] = { 0, -1},
-    [NE] = {-1,  0},
-    [ E] = {-1,  1}, 
-    [SE] = { 0,  1},
-    [SW] = { 1,  0},
-    [ W] = { 1, -1},
+// output a run is judged against
+struct expectation {
+    const char *data;
+    size_t length;
+    bool matched;
+    size_t offset; // of the first byte that differs
 };
 
-const char *direction_name[] = {
-    [NW] = "NORTH WEST", 
-    [NE] = "NORTH EAST", 
-    [ E] = "EAST",
-    [SE] = "SOUTH EAST",
-    [SW] = "SOUTH WEST",
-    [ W] = "WEST",
-};
+// Builds with HEXAGONY_NO_DEBUGGER defined leave out the debugger, and with it the ANSI rendering and libm. They
+// run through breakpoints and do their I/O without stdio, so that they start as quickly as possible.
+#ifndef HEXAGONY_NO_DEBUGGER
 
-const char *axis_name[] = {
-    [X] = "X",
-    [Y] = "Y",
-    [Z] = "Z",
+#define MEM_FMT_LEN 2 // digits per cell in memory debug view
+#define MEM_FMT "%" STRINGIZE(MEM_FMT_LEN) PRId64
+
+// what the debugger shows of a vm of either width
+struct debug_view {
+    const struct program *program;
+    const struct IP *IPs;
+    int IP_index;
+    struct memory_pointer MP;
+    long memory_rings;
+    // the memory of a vm with 32 bit edges, or of one with 64 bit edges
+    const struct memory_cell *memory;
+    const struct wide_memory_cell *wide_memory;
 };
 
-// mathematical modulus
-long modulo(long a, long b) {
-    const long result = a % labs(b);
-    return (result >= 0 ? result : result + b) * (b >= 0 ? 1 : -1);
-}
-
-// convert x,y axial coordinates to index for sequentially stored rows along the z axis
-ssize_t axial_to_index(long p, long q, long rings) {
-    long x = p;
-    long y = q;
-    long z = -p - q;
-    if (labs(x) + labs(y) + labs(z) > 2 * (rings - 1)) return -1;
-    return (3 * rings * (rings - 1)) / 2
-           + y + -z * (rings * 2 - 1)
-           + z * (labs(z) + 1) / 2;
-}
-
-// convert x,y axial coordinate to a radial index
-size_t axial_to_mem_index(long p, long q) {
-    long x = p;
-    long y = q;
-    long z = -p - q;
-    // The ring number is the hexagonal distance from the origin.
-    // This is the same as half the manhattan distance in cubic coordinates.
-    size_t ring = (labs(x) + labs(y) + labs(z)) / 2;
-    size_t i = ring > 0 ? (3 * ring * (ring - 1) + 1) : 0;
-    // find the clockwise offset from the closest corner of the ring
-    if (x <= 0 && y < 0) i += ring * 0 + labs(x);
-    if (y >= 0 && z > 0) i += ring * 1 + labs(y);
-    if (z <= 0 && x < 0) i += ring * 2 + labs(z);
-    if (x >= 0 && y > 0) i += ring * 3 + labs(x);
-    if (y <= 0 && z < 0) i += ring * 4 + labs(y);
-    if (z >= 0 && x > 0) i += ring * 5 + labs(z);
-    return i;
-}
-
-// memory is allocated sequentially and grows outwards in rings
-struct memory_cell *realloc_memory(struct memory_cell *memory, long old_rings, long new_rings) {
-    size_t old_size = (3 * old_rings * (old_rings - 1) + 1);
-    size_t new_size = (3 * new_rings * (new_rings - 1) + 1);
-    memory = realloc(memory, new_size * sizeof(struct memory_cell));
-    for (size_t i = old_size; i < new_size; i++) {
-        memory[i].value[X] = 0;
-        memory[i].value[Y] = 0;
-        memory[i].value[Z] = 0;
-    }
-    return memory;
-}
-
-// gets the memory cell at axial p,q and reallocates memory if the index is out of range
-struct memory_cell *get_memory_cell(long p, long q, struct memory_cell **memory, long *rings) {
-    size_t index = axial_to_mem_index(p, q);
-    while (index >= (3 * *rings * (*rings - 1) + 1)) {
-        *memory = realloc_memory(*memory, *rings, *rings + 1);
-        ++*rings;
-    }
-    return *memory + index;
+static struct debug_view view_vm(const struct vm *vm) {
+    return (struct debug_view){vm->program, vm->IPs, vm->IP_index, vm->MP, vm->memory_rings, vm->memory, NULL};
 }
 
-// get a pointer to the memory edge pointed to by ptr
-memory_edge *get_memory_edge(struct memory_pointer ptr, struct memory_cell **memory, long *rings) {
-    return &get_memory_cell(ptr.p, ptr.q, memory, rings)->value[ptr.axis];
+static struct debug_view view_wide_vm(const struct wide_vm *vm) {
+    return (struct debug_view){vm->program, vm->IPs, vm->IP_index, vm->MP, vm->memory_rings, NULL, vm->memory};
 }
 
-// get a pointer to a neighbor of the edge pointed to by pointer
-memory_edge *get_neighbor(struct memory_pointer ptr, enum neighbor neighbor, struct memory_cell **memory, long *rings) {
-    long xyz[3] = {ptr.p, ptr.q, -ptr.p - ptr.q};
-    enum axis neighbor_axis = modulo(ptr.axis + neighbor, 3);
-    if (ptr.direction == OUT) {
-        ++xyz[ptr.axis];
-        --xyz[neighbor_axis];
-    }
-    struct memory_cell *cell = get_memory_cell(xyz[X], xyz[Y], memory, rings);
-    return &cell->value[neighbor_axis];
-}
-
-// move memory pointer to its left or right neighbor
-void move_mp(struct memory_pointer *ptr, enum neighbor neighbor) {
-    long xyz[3] = {ptr->p, ptr->q, -ptr->p - ptr->q};
-    enum axis neighbor_axis = modulo(ptr->axis + neighbor, 3);
-    if (ptr->direction == OUT) {
-        ++xyz[ptr->axis];
-        --xyz[neighbor_axis];
-        ptr->direction = IN;
-    } else {
-        ptr->direction = OUT;
-    }
-    ptr->axis = neighbor_axis;
-    ptr->p = xyz[X];
-    ptr->q = xyz[Y];
+// the value of an edge of memory, with cells that were never allocated reading as zero
+static int64_t view_edge(const struct debug_view *view, long p, long q, enum axis axis) {
+    if (labs(p) + labs(q) + labs(-p - q) >= 2 * view->memory_rings)
+        return 0;
+    const size_t index = axial_to_mem_index(p, q);
+    return view->wide_memory != NULL ? view->wide_memory[index].value[axis] : view->memory[index].value[axis];
 }
 
 void print_program(struct program_cell *program, long program_rings, ssize_t ip_index[6]) {
@@ -180,12 +96,11 @@ void print_program(struct program_cell *program, long program_rings, ssize_t ip_
     }
 }
 
-void print_memory(struct memory_cell *memory, long rings, const struct memory_pointer *ptr) {
+void print_memory(const struct debug_view *view) {
 
     const long print_rings = 4; // how many rings around ptr to show
-    const struct memory_cell oob = {0, 0, 0};
-    const long ptr_z = -ptr->p - ptr->q;
-    printf("[%ld rings allocated]\n", rings);
+    const struct memory_pointer *ptr = &view->MP;
+    printf("[%ld rings allocated]\n", view->memory_rings);
 
     for (long z = print_rings; z >= -print_rings; z--) {
 
@@ -199,390 +114,559 @@ void print_memory(struct memory_cell *memory, long rings, const struct memory_po
         for (long s = 0; s < labs(z); s++)
             printf("  %*s ", MEM_FMT_LEN, "");
         for (long p = x, q = y; labs(p) + labs(q) + labs(z) <= 2 * print_rings; --p, q++) {
-            const struct memory_cell *cell;
-            if (labs(ptr->p + p) + labs(ptr->q + q) + labs(ptr_z + z) <= 2 * rings)
-                cell = get_memory_cell(ptr->p + p, ptr->q + q, &memory, &rings);
-            else
-                cell = &oob;
-            printf("    \e[0;3%dm" MEM_FMT "\e[0m %*s ", (p == 0 && q == 0 && ptr->axis == Z) ? 1 : 0, cell->value[Z],
-                   MEM_FMT_LEN, "");
+            printf("    \e[0;3%dm" MEM_FMT "\e[0m %*s ", (p == 0 && q == 0 && ptr->axis == Z) ? 1 : 0,
+                   view_edge(view, ptr->p + p, ptr->q + q, Z), MEM_FMT_LEN, "");
         }
         putchar('\n');
 
         for (long s = 0; s < labs(z); s++)
             printf("  %*s ", MEM_FMT_LEN, "");
         for (long p = x, q = y; labs(p) + labs(q) + labs(z) <= 2 * print_rings; --p, q++) {
-            const struct memory_cell *cell;
-            if (labs(ptr->p + p) + labs(ptr->q + q) + labs(ptr_z + z) <= 2 * rings)
-                cell = get_memory_cell(ptr->p + p, ptr->q + q, &memory, &rings);
-            else
-                cell = &oob;
             printf(". \e[0;3%dm" MEM_FMT "\e[0m ' \e[0;3%dm" MEM_FMT "\e[0m ",
-                   (p == 0 && q == 0 && ptr->axis == X) ? 1 : 0, cell->value[X],
-                   (p == 0 && q == 0 && ptr->axis == Y) ? 1 : 0, cell->value[Y]);
+                   (p == 0 && q == 0 && ptr->axis == X) ? 1 : 0, view_edge(view, ptr->p + p, ptr->q + q, X),
+                   (p == 0 && q == 0 && ptr->axis == Y) ? 1 : 0, view_edge(view, ptr->p + p, ptr->q + q, Y));
         }
         puts(".");
     }
 }
 
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        fputs("No filename specified.\n", stderr);
-        return EXIT_FAILURE;
-    }
-    long program_rings = 1;
-    size_t program_size = (3 * program_rings * (program_rings - 1) + 1); // ring'th centered hexagonal number
-    struct program_cell *program = malloc(program_size * sizeof(struct program_cell));
-    
-    {
-        FILE *source = fopen(argv[1], "r");
-        if (source == NULL) {
-            perror("Error opening file");
-            return EXIT_FAILURE;
-        }
-        bool debug_next = false;
-        int c;
-        size_t i = 0;
-        while ((c = fgetc(source)) != EOF) {
-            if (c == '`')
-                debug_next = true;
-            else if (!isspace(c)) {
-                if (i >= program_size) {
-                    ++program_rings;
-                    program_size = (3 * program_rings * (program_rings - 1) + 1);
-                    program = realloc(program, program_size * sizeof(struct program_cell));
-                }
-                program[i].value = c;
-                program[i].debug = debug_next;
-                debug_next = false;
-                i++;
-            }
-        }
-        while (i < program_size) {
-            program[i].value = '.';
-            program[i].debug = false;
-            i++;
+// Prints the state of a vm and prompts for a debugger command, returns false if execution should stop. Sets *step
+// if the vm should pause before the next instruction, and clears it if it should run on to the next breakpoint.
+bool debug_prompt(const struct debug_view *view, bool *step) {
+    const struct program *program = view->program;
+    const struct IP *IP = view->IPs + view->IP_index;
+    const struct program_cell *instruction = program->cells + axial_to_index(IP->p, IP->q, program->rings);
+    if (instruction->debug)
+        puts("break");
+    printf("\nPaused on '%c'\n", instruction->value);
+    ssize_t ips[6];
+    for (unsigned ip = 0; ip < 6; ip++)
+        ips[ip] = axial_to_index(view->IPs[ip].p, view->IPs[ip].q, program->rings);
+    print_program(program->cells, program->rings, ips);
+    printf("Active IP: %d\n", view->IP_index);
+    int digits = log10(program->rings);
+    for (int i = 0; i < 6; i++)
+        printf("IP \e[0;3%dm%d\e[0m (%+*ld, %+*ld) %s\n", i + 1, i, digits, view->IPs[i].p, digits, view->IPs[i].q,
+               direction_name[view->IPs[i].direction]);
+    print_memory(view);
+    printf("MP: (%+ld, %+ld) %s %s = " MEM_FMT "\n", view->MP.p, view->MP.q, axis_name[view->MP.axis],
+           view->MP.direction == IN ? "INWARDS" : "OUTWARDS", view_edge(view, view->MP.p, view->MP.q, view->MP.axis));
+    while (true) {
+        printf(": ");
+        switch (getchar()) {
+        case 's': *step = true; return true;
+        case 'c': *step = false; return true;
+        case 'q':
+        case EOF: return false;
         }
-        fclose(source);
     }
+}
 
-    struct IP {
-        long p, q;
-        enum direction direction;
-        bool ignore_next;
-    } IPs[6] = {
-        {                   0, -(program_rings - 1),  E, false}, // NW
-        {-(program_rings - 1),                    0, SE, false}, // NE
-        {-(program_rings - 1), +(program_rings - 1), SW, false}, // E
-        {                   0, +(program_rings - 1),  W, false}, // SE
-        {+(program_rings - 1),                    0, NW, false}, // SW
-        {+(program_rings - 1), -(program_rings - 1), NE, false}, // W
-    };
-    int IP_index = 0;
-
-    long memory_rings = 1;
-    struct memory_cell *memory = calloc(1, sizeof(struct memory_cell));
-    struct memory_pointer MP = {0, 0, Z, OUT};
-
-    bool force_debug = false;
-    struct program_cell *instruction;
-    while (true) {
-        struct IP *IP = IPs + IP_index;
-        if (IP->ignore_next) {
-            IP->ignore_next = false;
-        } else {
-            instruction = program + axial_to_index(IP->p, IP->q, program_rings);
-            if (instruction->debug || force_debug) {
-                if (instruction->debug)
-                    puts("break");
-                printf("\nPaused on '%c'\n", instruction->value);
-                ssize_t ips[6];
-                for (unsigned ip = 0; ip < 6; ip++)
-                    ips[ip] = axial_to_index(IPs[ip].p, IPs[ip].q, program_rings);
-                print_program(program, program_rings, ips);
-                printf("Active IP: %d\n", IP_index);
-                int digits = log10(program_rings);
-                for (int i = 0; i < 6; i++)
-                    printf("IP \e[0;3%dm%d\e[0m (%+*ld, %+*ld) %s\n", i + 1, i, digits, IPs[i].p, digits, IPs[i].q,
-                           direction_name[IPs[i].direction]);
-                print_memory(memory, memory_rings, &MP);
-                printf("MP: (%+ld, %+ld) %s %s = " MEM_FMT "\n", MP.p, MP.q, axis_name[MP.axis],
-                       MP.direction == IN ? "INWARDS" : "OUTWARDS", *get_memory_edge(MP, &memory, &memory_rings));
-            prompt:
-                printf(": ");
-                switch (getchar()) {
-                case 's': force_debug = true; break;
-                case 'c': force_debug = false; break;
-                case 'q': goto done;
-                default: goto prompt;
-                }
-            }
-            if (isalpha(instruction->value)) { // set current memory edge to value
-                *get_memory_edge(MP, &memory, &memory_rings) = instruction->value;
-            
-            } else if (isdigit(instruction->value)) {
-                // multiply the current memory edge by 10 and add the corresponding digit.
-                // if the current edge has a negative value, the digit is subtracted instead of added.
-                memory_edge *edge = get_memory_edge(MP, &memory, &memory_rings);
-                *edge *= 10;
-                *edge += (*edge < 0 ? -1 : 1) * (instruction->value - '0');
-            
-            } else switch (instruction->value) {
-                
-                case '.': // no-op.
-                    break;
-                
-                case '@': // terminates the program.
-                    goto done;
-
-                case ')': // increments the current memory edge. 
-                    ++*get_memory_edge(MP, &memory, &memory_rings); 
-                    break;
-
-                case '(': // decrements the current memory edge.
-                    --*get_memory_edge(MP, &memory, &memory_rings); 
-                    break;
+// pauses in the debugger like debug_prompt(), as a span of the trace if there is one
+bool pause_in_debugger(const struct debug_view *view, bool *step, struct trace *trace) {
+    const double start = trace != NULL ? trace_now(trace) : 0;
+    const bool resume = debug_prompt(view, step);
+    fflush(stdout); // before the program writes more, which may not go through stdio
+    if (trace != NULL)
+        trace_span(trace, TRACE_HOST, "debugger", start, NULL, 0);
+    return resume;
+}
 
-                case '+': // sets the current memory edge to the sum of the left and right neighbours.
-                    *get_memory_edge(MP, &memory, &memory_rings) 
-                        = *get_neighbor(MP,  LEFT, &memory, &memory_rings) 
-                        + *get_neighbor(MP, RIGHT, &memory, &memory_rings);
-                    break;
+bool write_stdout(void *context, const char *output, size_t length) {
+    (void)context;
+    return fwrite(output, 1, length, stdout) == length;
+}
 
-                case '-':  // sets the current memory edge to the difference of the left and right neighbours (left - right).
-                    *get_memory_edge(MP, &memory, &memory_rings) 
-                        = *get_neighbor(MP,  LEFT, &memory, &memory_rings) 
-                        - *get_neighbor(MP, RIGHT, &memory, &memory_rings);
-                    break;
+// Reads up to the end of the next line so interactive programs see each line as it is typed. The context is a
+// buffer of BUFSIZ bytes.
+bool read_stdin(void *context, const char **input, size_t *length) {
+    char *buffer = context;
+    fflush(stdout);
+    *length = 0;
+    int c;
+    while (*length < BUFSIZ && (c = getchar()) != EOF) {
+        buffer[(*length)++] = c;
+        if (c == '\n')
+            break;
+    }
+    *input = buffer;
+    return !ferror(stdin);
+}
 
-                case '*':  // sets the current memory edge to the product of the left and right neighbours.
-                    *get_memory_edge(MP, &memory, &memory_rings) 
-                        = *get_neighbor(MP,  LEFT, &memory, &memory_rings) 
-                        * *get_neighbor(MP, RIGHT, &memory, &memory_rings);
-                    break;
+// the program I/O of a run, through stdio so that it interleaves with the debugger
+bool init_stdio(struct vm_io *io, char *buffer) {
+    return io_init(io, NULL, 0, read_stdin, write_stdout, buffer);
+}
 
-                case ':': // sets the current memory edge to the quotient of the left and right neighbours (left / right).
-                    *get_memory_edge(MP, &memory, &memory_rings) 
-                        = *get_neighbor(MP,  LEFT, &memory, &memory_rings) 
-                        / *get_neighbor(MP, RIGHT, &memory, &memory_rings);
-                    break;
+#else
 
-                case '%': // sets the current memory edge to the modulo of the left and right neighbours (left % right)
-                    *get_memory_edge(MP, &memory, &memory_rings) 
-                        = *get_neighbor(MP,  LEFT, &memory, &memory_rings) 
-                        % *get_neighbor(MP, RIGHT, &memory, &memory_rings);
-                    break;
+// the program I/O of a run, straight on the file descriptors
+bool init_stdio(struct vm_io *io, char *buffer) {
+    (void)buffer;
+    return io_init_fds(io, STDIN_FILENO, STDOUT_FILENO);
+}
 
-                case '~': // multiplies the current memory edge by -1. 
-                    *get_memory_edge(MP, &memory, &memory_rings) *= -1; 
-                    break;
+#endif
 
-                
-                case ',': // reads a single byte from STDIN and sets the current memory edge to its value, or -1 if EOF reached. 
-                    *get_memory_edge(MP, &memory, &memory_rings) = getchar();
-                    break;
+// reads and parses a source file, reporting errors to stderr
+bool load_program(const char *filename, struct program *program) {
+    size_t length;
+    char *source = read_file(filename, &length);
+    if (source == NULL) {
+        perror("Error opening file");
+        return false;
+    }
+    bool parsed = parse_program(program, source, length);
+    free(source);
+    if (!parsed)
+        perror("Error reading program");
+    return parsed;
+}
 
-                // reads and discards from STDIN until a digit, a - or a + is found. Then reads as many characters
-                // as possible to form a valid (signed) decimal integer and sets the current memory edge to its
-                // value. Returns 0 once EOF is reached.
-                case '?': {
-                    int ch = 0;
-                    do {
-                        ch = getchar();
-                    } while (ch != EOF && !isdigit(ch) && ch != '+' && ch != '-');
-                    memory_edge *edge = get_memory_edge(MP, &memory, &memory_rings);
-                    *edge = 0;
-                    if (ch != EOF) {
-                        ungetc(ch, stdin);
-                        scanf("%d", edge);
-                    }
-                }   break;
-
-                case ';': // takes the current memory edge modulo 256 (positive) and writes the corresponding byte to STDOUT. 
-                    printf("%c", (char)modulo(*get_memory_edge(MP, &memory, &memory_rings), 256)); 
-                    break;
+// maps the expected output of a run into memory, reporting errors to stderr
+bool map_expectation(const char *filename, struct expectation *expect) {
+    const int fd = open(filename, O_RDONLY);
+    struct stat stat;
+    if (fd < 0 || fstat(fd, &stat) != 0) {
+        perror("Error opening expected output");
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    *expect = (struct expectation){.data = "", .length = stat.st_size};
+    if (expect->length > 0) {
+        expect->data = mmap(NULL, expect->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (expect->data == MAP_FAILED) {
+            perror("Error mapping expected output");
+            expect->data = NULL; // there is nothing to unmap
+            close(fd);
+            return false;
+        }
+    }
+    close(fd);
+    return true;
+}
 
-                case '!': // writes the decimal representation of the current memory edge to STDOUT. 
-                    printf("%d", *get_memory_edge(MP, &memory, &memory_rings));
-                    break;
+void unmap_expectation(struct expectation *expect) {
+    if (expect->length > 0)
+        munmap((void *)expect->data, expect->length);
+}
 
-                case '$': // is a jump. When executed, the IP completely ignores the next command in its current direction.
-                    IP->ignore_next = true; 
-                    break;
+// Runs a wide vm until it stops, and returns VM_HALTED once it has halted or the debugger quits, VM_MISMATCH if its
+// output differed from the expected output, VM_DIVIDE_BY_ZERO, or VM_INPUT or VM_OUTPUT if its I/O failed. The
+// debugger pauses on breakpoints, and before every instruction if step is set. The value profiler needs the vm to
+// break before every instruction, so with a profile it does whatever the debugger says.
+enum vm_status run_wide(struct wide_vm *vm, struct vm_io *io, struct value_profile *profile, bool step) {
+    vm->force_debug = step || profile != NULL;
+    while (true) {
+        const enum vm_status status = wide_vm_run_io(vm, io);
+        switch (status) {
+        case VM_HALTED:
+        case VM_MISMATCH:
+        case VM_INPUT:
+        case VM_OUTPUT:
+        case VM_DIVIDE_BY_ZERO:
+            return status;
+
+        case VM_BREAK: {
+            if (profile != NULL)
+                profile_instruction(profile, vm);
+#ifndef HEXAGONY_NO_DEBUGGER
+            const struct IP *IP = vm->IPs + vm->IP_index;
+            if (step || vm->program->cells[axial_to_index(IP->p, IP->q, vm->program->rings)].debug) {
+                const struct debug_view view = view_wide_vm(vm);
+                if (!pause_in_debugger(&view, &step, io->trace))
+                    return VM_HALTED;
+                vm->force_debug = step || profile != NULL;
+            }
+#endif
+        }   break;
 
-                // /, \, _, | are mirrors. They reflect the IP in the direction you'd expect. For completeness, the
-                // following table shows how they deflect an incoming IP. The top row corresponds to the current
-                // direction of the IP, the left column to the mirror, and the table cell shows the outgoing
-                // direction of the IP:
-                //        cmd │ NW NE  E SE SW  W
-                //      ──────┼────────────────────
-                //         /  │  E NE NW  W SW SE
-                //         \  │ NW  W SW SE  E NE
-                //         _  │ SW SE  E NE NW  W
-                //         |  │ NE NW  W SW SE  E
-                case '/':
-                    switch (IP->direction) {
-                    case NW: IP->direction =  E; break;
-                    case NE: IP->direction = NE; break;
-                    case  E: IP->direction = NW; break;
-                    case SE: IP->direction =  W; break;
-                    case SW: IP->direction = SW; break;
-                    case  W: IP->direction = SE; break;
-                    }
-                    break;
-                case '\\':
-                    switch (IP->direction) {
-                    case NW: IP->direction = NW; break;
-                    case NE: IP->direction =  W; break;
-                    case  E: IP->direction = SW; break;
-                    case SE: IP->direction = SE; break;
-                    case SW: IP->direction =  E; break;
-                    case  W: IP->direction = NE; break;
-                    }
-                    break;
-                case '_':
-                    switch (IP->direction) {
-                    case NW: IP->direction = SW; break;
-                    case NE: IP->direction = SE; break;
-                    case  E: IP->direction =  E; break;
-                    case SE: IP->direction = NE; break;
-                    case SW: IP->direction = NW; break;
-                    case  W: IP->direction =  W; break;
-                    }
-                    break;
-                case '|':
-                    switch (IP->direction) {
-                    case NW: IP->direction = NE; break;
-                    case NE: IP->direction = NW; break;
-                    case  E: IP->direction =  W; break;
-                    case SE: IP->direction = SW; break;
-                    case SW: IP->direction = SE; break;
-                    case  W: IP->direction =  E; break;
-                    }
-                    break;
+        case VM_OVERFLOW: // cannot happen, overflows are not trapped
+        case VM_YIELD:    // no step limit is set
+            break;
+        }
+    }
+}
 
-                // < and > act as either mirrors or branches, depending on the incoming direction. The cells
-                // indicated as ?? are where they act as branches. In these cases, if the current memory edge is
-                // positive, the IP takes a 60° right turn (e.g. < turns E into SE). If the current memory edge is
-                // zero or negative, the IP takes a 60° left turn (e.g. < turns E into NE).
-                //        cmd │ NW NE  E SE SW  W
-                //      ──────┼────────────────────
-                //         <  │  W SW ?? NW  W  E
-                //         >  │ SE  E  W  E NE ??
-                case '<':
-                    switch (IP->direction) {
-                    case NW: IP->direction =  W; break;
-                    case NE: IP->direction = SW; break;
-                    case  E: IP->direction = *get_memory_edge(MP, &memory, &memory_rings) > 0 ? SE : NE; break;
-                    case SE: IP->direction = NW; break;
-                    case SW: IP->direction =  W; break;
-                    case  W: IP->direction =  E; break;
-                    }
-                    break;
-                case '>':
-                    switch (IP->direction) {
-                    case NW: IP->direction = SE; break;
-                    case NE: IP->direction =  E; break;
-                    case  E: IP->direction =  W; break;
-                    case SE: IP->direction =  E; break;
-                    case SW: IP->direction = NE; break;
-                    case  W: IP->direction = *get_memory_edge(MP, &memory, &memory_rings) > 0 ? NW : SW; break;
-                    }
-                    break;
+// Runs a program on stdin and stdout with the debugger attached. If expect is not NULL, the run stops as soon as the
+// output differs from it, and whether it matched is stored in it. Profiling the values runs the program with 64 bit
+// edges whatever the width. If branches is not NULL, the outcomes of the run are counted into it, one site per cell.
+// With async_output set, stdout is written by a thread of its own. Unless trace_file is NULL, a trace of the run is
+// written to it.
+bool run_interactive(const struct program *program, struct expectation *expect, enum width width,
+                     struct value_profile *profile, struct branch_site *branches, bool async_output,
+                     const char *trace_file) {
+    struct vm vm;
+    struct wide_vm wide;
+    struct vm_io io;
+    struct trace trace;
+    char input[BUFSIZ];
+    bool widened = width == WIDTH_64 || profile != NULL;
+    if (async_output ? !io_init_async(&io, STDIN_FILENO, STDOUT_FILENO) : !init_stdio(&io, input)) {
+        perror("Error allocating memory");
+        return false;
+    }
+    if (widened ? !wide_vm_init(&wide, program) : !vm_init(&vm, program)) {
+        perror("Error allocating memory");
+        io_free(&io);
+        return false;
+    }
+    if (trace_file != NULL && !trace_open(&trace, trace_file)) {
+        perror("Error opening trace file");
+        if (widened)
+            wide_vm_free(&wide);
+        else
+            vm_free(&vm);
+        io_free(&io);
+        return false;
+    }
+    if (trace_file != NULL)
+        io.trace = &trace;
+    if (!widened) {
+        if (expect != NULL)
+            vm_set_expected_output(&vm, expect->data, expect->length);
+        vm.trap_overflow = width == WIDTH_AUTO;
+        vm.branch_profile = branches;
+        vm.event_hook = io.trace != NULL ? trace_event : NULL;
+        vm.event_context = io.trace;
+    } else {
+        if (expect != NULL)
+            wide_vm_set_expected_output(&wide, expect->data, expect->length);
+        wide.branch_profile = branches;
+        wide.event_hook = io.trace != NULL ? trace_event : NULL;
+        wide.event_context = io.trace;
+    }
 
-                
-                case '[': // switches to the previous IP
-                    IP_index = modulo(IP_index - 1, 6); 
-                    break;
+    bool running = !widened;
+    bool step = false;
+    enum vm_status status = VM_HALTED;
+    while (running) {
+        status = vm_run_io(&vm, &io);
+        switch (status) {
+        case VM_HALTED:
+        case VM_INPUT:
+        case VM_OUTPUT:
+        case VM_MISMATCH:
+        case VM_DIVIDE_BY_ZERO:
+            running = false;
+            break;
+
+        case VM_BREAK: {
+#ifndef HEXAGONY_NO_DEBUGGER
+            const struct debug_view view = view_vm(&vm);
+            running = pause_in_debugger(&view, &step, io.trace);
+            vm.force_debug = step;
+            if (!running) // the debugger quit
+                status = VM_HALTED;
+#endif
+        }   break;
+
+        case VM_OVERFLOW: // carry on from the instruction that overflowed with 64 bit edges
+            if (!widen_vm(&wide, &vm)) {
+                perror("Error allocating memory");
+                if (io.trace != NULL)
+                    trace_close(io.trace, vm.steps);
+                vm_free(&vm);
+                io_free(&io);
+                return false;
+            }
+            vm_free(&vm);
+            if (io.trace != NULL)
+                trace_instant(io.trace, TRACE_VM, "widen to 64 bit edges", "steps", wide.steps);
+            widened = true;
+            running = false;
+            break;
+
+        case VM_YIELD: // no step limit is set
+            break;
+        }
+    }
+    if (widened) // a widened run carries on stepping if it was
+        status = run_wide(&wide, &io, profile, step);
+    bool failed = status == VM_INPUT || status == VM_OUTPUT || status == VM_DIVIDE_BY_ZERO;
+    if (status == VM_DIVIDE_BY_ZERO) {
+        fflush(stdout);
+        fputs("Division by zero\n", stderr);
+    } else if (failed) {
+        perror("Error in program I/O");
+    }
+    if (io.trace != NULL && !trace_close(io.trace, widened ? wide.steps : vm.steps)) {
+        perror("Error writing trace file");
+        failed = true;
+    }
+    if (expect != NULL) {
+        // output that stops short of the expected output differs at its end
+        const size_t position = widened ? wide.expect_position : vm.expect_position;
+        expect->matched = status != VM_MISMATCH && position == expect->length;
+        expect->offset = position;
+    }
 
-                case ']': // switches to the next IP 
-                    IP_index = modulo(IP_index + 1, 6);
-                    break;
-  
-                case '#': // takes the current memory edge modulo 6 and switches to the IP with that index.
-                    IP_index = modulo(*get_memory_edge(MP, &memory, &memory_rings), 6); 
-                    break;
-                
-                case '{': // moves the MP to the left neighbour. 
-                    move_mp(&MP, LEFT); 
-                    break;
-                
-                case '}': // moves the MP to the right neighbour.
-                    move_mp(&MP, RIGHT); 
-                    break;
-                
-                case '"': // moves the MP backwards and to the left. This is equivalent to =}=.
-                    MP.direction = MP.direction == IN ? OUT : IN;
-                    move_mp(&MP, RIGHT);
-                    MP.direction = MP.direction == IN ? OUT : IN;
-                    break;
+    if (widened)
+        wide_vm_free(&wide);
+    else
+        vm_free(&vm);
+    io_free(&io);
+    return !failed;
+}
 
-                case '\'': // moves the MP backwards and to the right. This is equivalent to ={=.
-                    MP.direction = MP.direction == IN ? OUT : IN;
-                    move_mp(&MP, LEFT);
-                    MP.direction = MP.direction == IN ? OUT : IN;
-                    break;
+// reports a value profile on stderr
+void print_value_profile(const struct value_profile *profile) {
+    if (profile->stored)
+        fprintf(stderr, "Values stored: %" PRId64 " to %" PRId64 "\n", profile->min, profile->max);
+    else
+        fputs("Values stored: none\n", stderr);
+    fprintf(stderr, "Results that overflow 32 bits: %lu\n", profile->overflows_32);
+    fprintf(stderr, "Results that overflow 64 bits: %lu\n", profile->overflows_64);
+    const int width = narrowest_width(profile);
+    if (width > 0)
+        fprintf(stderr, "Narrowest safe width: %d\n", width);
+    else
+        fputs("Narrowest safe width: none, the values do not fit in 64 bits\n", stderr);
+}
 
-                // reverses the direction of the MP. (This doesn't affect the current memory edge, but changes which
-                // edges are considered the left and right neighbour.)
-                case '=': 
-                    MP.direction = MP.direction == IN ? OUT : IN;
-                    break;
+// reports on stderr how each data-dependent choice went at every cell where one was made
+void print_branch_profile(const struct program *program, const struct branch_site *sites) {
+    size_t count = 0, mixed = 0;
+    for (size_t i = 0; i < program->size; i++) {
+        const unsigned long *instruction = sites[i].instruction, *corner = sites[i].corner;
+        const char value = program->cells[i].value;
+        if (value == '#') {
+            int targets = 0;
+            for (int offset = 0; offset < 6; offset++)
+                targets += instruction[offset] > 0;
+            if (targets > 0) {
+                fprintf(stderr, "Cell %zu '#':", i);
+                for (int offset = 0; offset < 6; offset++) {
+                    if (instruction[offset] > 0)
+                        fprintf(stderr, " %lu to IP +%d", instruction[offset], offset);
+                }
+                fputs(targets > 1 ? ", mixed\n" : "\n", stderr);
+                count++;
+                mixed += targets > 1;
+            }
+        } else if (instruction[0] > 0 || instruction[1] > 0) {
+            fprintf(stderr, "Cell %zu '%c': %lu positive, %lu not%s\n", i, value, instruction[1], instruction[0],
+                    instruction[0] > 0 && instruction[1] > 0 ? ", mixed" : "");
+            count++;
+            mixed += instruction[0] > 0 && instruction[1] > 0;
+        }
+        if (corner[0] > 0 || corner[1] > 0) {
+            fprintf(stderr, "Cell %zu corner: %lu positive, %lu not%s\n", i, corner[1], corner[0],
+                    corner[0] > 0 && corner[1] > 0 ? ", mixed" : "");
+            count++;
+            mixed += corner[0] > 0 && corner[1] > 0;
+        }
+    }
+    fprintf(stderr, "Branch sites reached: %zu, mixed: %zu\n", count, mixed);
+}
 
-                // moves the MP to the left neighbour if the current edge is zero or negative and to the right
-                // neighbour if it's positive.
-                case '^': 
-                    move_mp(&MP, *get_memory_edge(MP, &memory, &memory_rings) <= 0 ? LEFT : RIGHT);
-                    break;
+// parses a single character or one of the escapes \n, \t and \0
+bool parse_delimiter(const char *argument, char *delimiter) {
+    if (argument[0] != '\\') {
+        *delimiter = argument[0];
+        return argument[0] != '\0' && argument[1] == '\0';
+    }
+    switch (argument[1]) {
+    case 'n': *delimiter = '\n'; break;
+    case 't': *delimiter = '\t'; break;
+    case '0': *delimiter = '\0'; break;
+    case '\\': *delimiter = '\\'; break;
+    default: return false;
+    }
+    return argument[2] == '\0';
+}
 
-                // copies the value of left neighbour into the current edge if the current edge is zero or
-                // negative and the value of the right neighbour if it's positive.
-                case '&': {
-                    int *edge = get_memory_edge(MP, &memory, &memory_rings);
-                    *edge = *get_neighbor(MP, *edge <= 0 ? LEFT : RIGHT, &memory, &memory_rings);
-                }   break;
+int main(int argc, char **argv) {
+    bool pipeline = false;
+    bool per_record = false;
+    bool lockstep = false;
+    bool sandbox = false;
+    const char *expect_file = NULL;
+    int workers = 0;
+    bool delimit_output = false;
+    char delimiter = '\n';
+    enum width width = WIDTH_32;
+    bool profile_values = false;
+    bool profile_branches = false;
+    bool async_output = false;
+    bool watch = false;
+    const char *trace_file = NULL;
+    const char *input_file = NULL;
+    unsigned long steps = 0;
+    unsigned long quantum = 0;
+    int first_file = 1;
+    for (; first_file < argc && strncmp(argv[first_file], "--", 2) == 0; first_file++) {
+        if (strcmp(argv[first_file], "--pipeline") == 0) {
+            pipeline = true;
+        } else if (strcmp(argv[first_file], "--per-record") == 0) {
+            per_record = true;
+        } else if (strcmp(argv[first_file], "--workers") == 0 && first_file + 1 < argc) {
+            workers = atoi(argv[++first_file]);
+            if (workers <= 0) {
+                fprintf(stderr, "Invalid worker count %s\n", argv[first_file]);
+                return EXIT_FAILURE;
             }
-        }
-        long np = IP->p + direction_offset[IP->direction].dp;
-        long nq = IP->q + direction_offset[IP->direction].dq;
-        long nr = -np - nq;
-        if (labs(np) + labs(nq) + labs(nr) >= 2 * program_rings) {
-            enum axis reflection;
-            if (np == 0) {
-                reflection = *get_memory_edge(MP, &memory, &memory_rings) > 0 ? Y : Z;
-            } else if (nq == 0) {
-                reflection = *get_memory_edge(MP, &memory, &memory_rings) > 0 ? Z : X;
-            } else if (nr == 0) {
-                reflection = *get_memory_edge(MP, &memory, &memory_rings) > 0 ? X : Y;
-            } else if (nq * nr > 0) {
-                reflection = X;
-            } else if (nr * np > 0) {
-                reflection = Y;
-            } else if (np * nq > 0) {
-                reflection = Z;
+        } else if (strcmp(argv[first_file], "--lockstep") == 0) {
+            lockstep = true;
+        } else if (strcmp(argv[first_file], "--expect") == 0 && first_file + 1 < argc) {
+            expect_file = argv[++first_file];
+        } else if (strcmp(argv[first_file], "--width") == 0 && first_file + 1 < argc) {
+            first_file++;
+            if (strcmp(argv[first_file], "32") == 0) {
+                width = WIDTH_32;
+            } else if (strcmp(argv[first_file], "64") == 0) {
+                width = WIDTH_64;
+            } else if (strcmp(argv[first_file], "auto") == 0) {
+                width = WIDTH_AUTO;
+            } else {
+                fprintf(stderr, "Invalid width %s\n", argv[first_file]);
+                return EXIT_FAILURE;
             }
-            switch (reflection) {
-            case X:
-                np = -IP->p;
-                nq = IP->p + IP->q;
-                break;
-            case Y:
-                np = IP->p + IP->q;
-                nq = -IP->q;
-                break;
-            case Z:
-                np = -IP->q;
-                nq = -IP->p;
-                break;
+        } else if (strcmp(argv[first_file], "--profile-values") == 0) {
+            profile_values = true;
+        } else if (strcmp(argv[first_file], "--profile-branches") == 0) {
+            profile_branches = true;
+        } else if (strcmp(argv[first_file], "--async-output") == 0) {
+            async_output = true;
+        } else if (strcmp(argv[first_file], "--trace-events") == 0 && first_file + 1 < argc) {
+            trace_file = argv[++first_file];
+        } else if (strcmp(argv[first_file], "--watch") == 0) {
+            watch = true;
+        } else if (strcmp(argv[first_file], "--input") == 0 && first_file + 1 < argc) {
+            input_file = argv[++first_file];
+        } else if (strcmp(argv[first_file], "--steps") == 0 && first_file + 1 < argc) {
+            steps = strtoul(argv[++first_file], NULL, 10);
+            if (steps == 0) {
+                fprintf(stderr, "Invalid step count %s\n", argv[first_file]);
+                return EXIT_FAILURE;
             }
+        } else if (strcmp(argv[first_file], "--quantum") == 0 && first_file + 1 < argc) {
+            quantum = strtoul(argv[++first_file], NULL, 10);
+            if (quantum == 0) {
+                fprintf(stderr, "Invalid quantum %s\n", argv[first_file]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[first_file], "--sandbox") == 0) {
+            sandbox = true;
+        } else if (strcmp(argv[first_file], "--delimit-output") == 0) {
+            delimit_output = true;
+        } else if (strcmp(argv[first_file], "--delimiter") == 0 && first_file + 1 < argc) {
+            if (!parse_delimiter(argv[++first_file], &delimiter)) {
+                fprintf(stderr, "Invalid delimiter %s\n", argv[first_file]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[first_file]);
+            return EXIT_FAILURE;
         }
-        IP->p = np;
-        IP->q = nq;
+    }
+    if (first_file >= argc) {
+        fputs("No filename specified.\n", stderr);
+        return EXIT_FAILURE;
     }
 
-done:
-    free(memory);
-    free(program);
+    const int program_count = pipeline ? argc - first_file : 1;
+    struct program *programs = malloc(program_count * sizeof(struct program));
+    if (programs == NULL) {
+        perror("Error allocating memory");
+        return EXIT_FAILURE;
+    }
+    int loaded = 0;
+    while (loaded < program_count && load_program(argv[first_file + loaded], programs + loaded))
+        loaded++;
+
+    bool success = loaded == program_count;
+    struct expectation expect = {.matched = true};
+    if (success && expect_file != NULL && (pipeline || per_record || workers > 0)) {
+        fputs("--expect is only supported for a single run\n", stderr);
+        success = false;
+    } else if (success && expect_file != NULL) {
+        success = map_expectation(expect_file, &expect);
+    }
+    if (success && (width != WIDTH_32 || profile_values || profile_branches)
+        && (pipeline || per_record || workers > 0)) {
+        fputs("--width, --profile-values and --profile-branches are only supported for a single run\n", stderr);
+        success = false;
+    }
+    if (success && watch && (pipeline || per_record || workers > 0 || expect_file != NULL || width != WIDTH_32
+                             || profile_values || profile_branches || async_output || sandbox
+                             || trace_file != NULL)) {
+        fputs("--watch only goes with --input and --steps\n", stderr);
+        success = false;
+    } else if (success && !watch && (input_file != NULL || steps > 0)) {
+        fputs("--input and --steps are only supported with --watch\n", stderr);
+        success = false;
+    }
+    if (success && async_output && (pipeline || per_record || workers > 0)) {
+        fputs("--async-output is only supported for a single run\n", stderr);
+        success = false;
+    } else if (success && async_output && sandbox) {
+        fputs("--async-output is not supported with --sandbox\n", stderr);
+        success = false;
+    }
+    if (success && trace_file != NULL && (pipeline || per_record || workers > 0)) {
+        fputs("--trace-events is only supported for a single run\n", stderr);
+        success = false;
+    } else if (success && trace_file != NULL && sandbox) {
+        fputs("--trace-events is not supported with --sandbox\n", stderr);
+        success = false;
+    }
+    if (success && quantum > 0 && !pipeline) {
+        fputs("--quantum is only supported with --pipeline\n", stderr);
+        success = false;
+    }
+    if (success && sandbox && pipeline) {
+        fputs("--sandbox is not supported with --pipeline\n", stderr);
+        success = false;
+    } else if (success && sandbox && workers == 0 && !enter_sandbox(SANDBOX_STDIO)) {
+        // the workers sandbox themselves, everything else runs in this process
+        perror("Error entering sandbox");
+        success = false;
+    }
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    if (success && watch) {
+        success = run_watch(argv[first_file], input_file, steps > 0 ? steps : DEFAULT_WATCH_STEPS);
+    } else if (success && pipeline) {
+        success = run_pipeline(programs, program_count, quantum);
+    } else if (success && workers > 0) {
+        success = run_workers(programs, workers, delimiter, delimit_output, sandbox);
+    } else if (success && per_record && lockstep) {
+        success = run_per_record_lockstep(programs, delimiter, delimit_output);
+    } else if (success && per_record) {
+        success = run_per_record(programs, delimiter, delimit_output);
+    } else if (success) {
+        struct value_profile profile = {0};
+        struct branch_site *branches = profile_branches ? calloc(programs->size, sizeof(struct branch_site)) : NULL;
+        if (profile_branches && branches == NULL) {
+            perror("Error allocating memory");
+            success = false;
+        } else {
+            success = run_interactive(programs, expect_file != NULL ? &expect : NULL, width,
+                                      profile_values ? &profile : NULL, branches, async_output, trace_file);
+        }
+        if (success && profile_values) {
+            fflush(stdout);
+            print_value_profile(&profile);
+        }
+        if (success && profile_branches) {
+            fflush(stdout);
+            print_branch_profile(programs, branches);
+        }
+        free(branches);
+    }
+    if (success && !expect.matched) {
+        fflush(stdout);
+        fprintf(stderr, "Output differs from %s at byte %zu\n", expect_file, expect.offset);
+    }
+    if (expect_file != NULL && expect.data != NULL)
+        unmap_expectation(&expect);
+
+    for (int i = 0; i < loaded; i++)
+        free_program(programs + i);
+    free(programs);
+
+    if (!success)
+        return EXIT_FAILURE;
+    return expect.matched ? EXIT_SUCCESS : EXIT_MISMATCH;
+}
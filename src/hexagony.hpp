@@ -0,0 +1,733 @@
+#ifndef HEXAGONY_HPP
+#define HEXAGONY_HPP
+
+// A header-only C++20 engine with the semantics of vm.c, put together at compile time from an edge type and policies
+// for memory, I/O and debugging:
+//
+//     hexagony::program program = hexagony::parse(source);
+//     hexagony::vm<int32_t, hexagony::spiral_memory<int32_t>, hexagony::buffer_io> vm(program, {}, {input});
+//     vm.run();
+//     use(vm.io.output);
+//
+// Every policy is a member of the vm and every call into one is inlined into the interpreter loop, so each
+// configuration gets a loop of its own. Features a configuration does not use are not in its loop at all, there are
+// no runtime checks for them. The I/O policies never make the vm wait for input or output space, so unlike vm_run()
+// run() only stops when the program halts or divides by zero, at the step limit or when a debug hook asks it to.
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace hexagony {
+
+enum axis { X, Y, Z };
+enum direction { NW, NE, E, SE, SW, W };
+enum neighbor { LEFT = -1, RIGHT = 1 };
+
+// why run() returned
+enum status {
+    HALTED,  // executed '@'
+    YIELD,   // reached the step limit
+    STOPPED, // a debug hook returned false, run() resumes at the instruction it was called for
+    DIVIDED, // ':' or '%' would divide by zero, the vm stays at the division like vm_run()
+};
+
+struct program_cell {
+    char value;
+    bool debug;
+};
+
+// the source code laid out on a hexagon, stored as sequential rows along the z axis
+struct program {
+    std::vector<program_cell> cells;
+    long rings;
+};
+
+struct memory_pointer {
+    long p, q;
+    enum axis axis;
+    enum { IN, OUT } direction;
+};
+
+struct ip {
+    long p, q;
+    enum direction direction;
+    bool ignore_next;
+};
+
+template <class Edge> using memory_cell = std::array<Edge, 3>;
+
+namespace detail {
+
+// constexpr versions of the helpers in vm.c
+constexpr long absolute(long a) {
+    return a < 0 ? -a : a;
+}
+
+constexpr long modulo(long a, long b) {
+    const long result = a % absolute(b);
+    return (result >= 0 ? result : result + b) * (b >= 0 ? 1 : -1);
+}
+
+constexpr size_t ring_size(long rings) {
+    return 3 * rings * (rings - 1) + 1;
+}
+
+constexpr long axial_to_index(long p, long q, long rings) {
+    const long z = -p - q;
+    if (absolute(p) + absolute(q) + absolute(z) > 2 * (rings - 1))
+        return -1;
+    return (3 * rings * (rings - 1)) / 2 + q + -z * (rings * 2 - 1) + z * (absolute(z) + 1) / 2;
+}
+
+constexpr size_t axial_to_mem_index(long p, long q) {
+    const long x = p, y = q, z = -p - q;
+    const size_t ring = (absolute(x) + absolute(y) + absolute(z)) / 2;
+    size_t i = ring > 0 ? (3 * ring * (ring - 1) + 1) : 0;
+    if (x <= 0 && y < 0) i += ring * 0 + absolute(x);
+    if (y >= 0 && z > 0) i += ring * 1 + absolute(y);
+    if (z <= 0 && x < 0) i += ring * 2 + absolute(z);
+    if (x >= 0 && y > 0) i += ring * 3 + absolute(x);
+    if (y <= 0 && z < 0) i += ring * 4 + absolute(y);
+    if (z >= 0 && x > 0) i += ring * 5 + absolute(z);
+    return i;
+}
+
+// the ring of memory a cell is in, the origin is ring 0
+constexpr long ring_of(long p, long q) {
+    return (absolute(p) + absolute(q) + absolute(-p - q)) / 2;
+}
+
+// isalpha() and isdigit() in the C locale
+constexpr bool is_letter(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr bool is_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Not constexpr on purpose: a constant evaluation that reaches one of these fails to compile with an error that
+// names the function, and anywhere else they throw.
+[[noreturn]] inline void memory_rings_exceeded() {
+    throw std::length_error("the MP left the rings of fixed_memory");
+}
+
+[[noreturn]] inline void output_capacity_exceeded() {
+    throw std::length_error("the output does not fit in the capacity of fixed_io");
+}
+
+[[noreturn]] inline void step_limit_exceeded() {
+    throw std::runtime_error("the program did not halt within the step limit of evaluate()");
+}
+
+[[noreturn]] inline void division_by_zero() {
+    throw std::domain_error("the program divided by zero in evaluate()");
+}
+
+} // namespace detail
+
+// lays out source code on the smallest hexagon that fits it, the same as parse_program()
+constexpr program parse(std::string_view source) {
+    program result{{}, 1};
+    bool debug_next = false;
+    for (const char c : source) {
+        if (c == '`') {
+            debug_next = true;
+        } else if (!detail::is_space(c)) {
+            result.cells.push_back({c, debug_next});
+            debug_next = false;
+        }
+    }
+    while (detail::ring_size(result.rings) < result.cells.size())
+        result.rings++;
+    result.cells.resize(detail::ring_size(result.rings), {'.', false});
+    return result;
+}
+
+// Memory policies hand out the cell at axial p,q, allocating it if needed. peek() reads a cell without allocating
+// it, and rings() is how many rings around the origin hold every cell allocated so far.
+
+// Memory as vm.c lays it out: cells stored ring by ring in a spiral around the origin, growing a ring at a time as
+// the MP moves outwards.
+template <class Edge> struct spiral_memory {
+    using edge = Edge;
+
+    std::vector<memory_cell<Edge>> cells = std::vector<memory_cell<Edge>>(1);
+    long allocated_rings = 1;
+
+    constexpr memory_cell<Edge> &cell(long p, long q) {
+        const size_t index = detail::axial_to_mem_index(p, q);
+        if (index >= cells.size()) [[unlikely]]
+            grow(index);
+        return cells[index];
+    }
+
+    // kept out of line, so that the common case stays small enough to inline
+    [[gnu::noinline]] constexpr void grow(size_t index) {
+        while (index >= cells.size())
+            cells.resize(detail::ring_size(++allocated_rings));
+    }
+
+    constexpr memory_cell<Edge> peek(long p, long q) const {
+        const size_t index = detail::axial_to_mem_index(p, q);
+        return index < cells.size() ? cells[index] : memory_cell<Edge>{};
+    }
+
+    constexpr long rings() const {
+        return allocated_rings;
+    }
+};
+
+// Memory in square tiles of Size by Size axial coordinates, allocated as the MP first enters them. A program that
+// wanders far along one line allocates a strip of tiles instead of every ring out to where it is.
+template <class Edge, long Size = 16> struct tiled_memory {
+    using edge = Edge;
+    using tile = std::array<memory_cell<Edge>, Size * Size>;
+
+    std::unordered_map<uint64_t, std::unique_ptr<tile>> tiles;
+    // the tile the MP was in last, which is nearly always the one it is in now
+    uint64_t last_key = 0;
+    tile *last_tile = nullptr;
+
+    static constexpr long floor_div(long a) {
+        return a >= 0 ? a / Size : -((-a + Size - 1) / Size);
+    }
+
+    static uint64_t key_of(long p, long q) {
+        return (uint64_t)(uint32_t)floor_div(p) << 32 | (uint32_t)floor_div(q);
+    }
+
+    memory_cell<Edge> &cell(long p, long q) {
+        const uint64_t key = key_of(p, q);
+        if (key != last_key || last_tile == nullptr) {
+            std::unique_ptr<tile> &found = tiles[key];
+            if (found == nullptr)
+                found = std::make_unique<tile>();
+            last_key = key;
+            last_tile = found.get();
+        }
+        return (*last_tile)[(p - floor_div(p) * Size) * Size + (q - floor_div(q) * Size)];
+    }
+
+    memory_cell<Edge> peek(long p, long q) const {
+        const auto found = tiles.find(key_of(p, q));
+        if (found == tiles.end())
+            return {};
+        return (*found->second)[(p - floor_div(p) * Size) * Size + (q - floor_div(q) * Size)];
+    }
+
+    // the distance from the origin is largest at a corner of a tile
+    long rings() const {
+        long max_ring = 0;
+        for (const auto &[key, cells] : tiles) {
+            const long p = (int32_t)(key >> 32) * Size, q = (int32_t)key * Size;
+            for (const long corner : {detail::ring_of(p, q), detail::ring_of(p + Size - 1, q),
+                                      detail::ring_of(p, q + Size - 1), detail::ring_of(p + Size - 1, q + Size - 1)})
+                max_ring = corner > max_ring ? corner : max_ring;
+        }
+        return max_ring + 1;
+    }
+};
+
+// The first Rings rings of the spiral in an array that never grows, for programs known to stay close to the origin.
+// Going further throws std::length_error, and fails to compile in a constant expression.
+template <class Edge, long Rings> struct fixed_memory {
+    using edge = Edge;
+
+    std::array<memory_cell<Edge>, detail::ring_size(Rings)> cells{};
+
+    constexpr memory_cell<Edge> &cell(long p, long q) {
+        const size_t index = detail::axial_to_mem_index(p, q);
+        if (index >= cells.size())
+            detail::memory_rings_exceeded();
+        return cells[index];
+    }
+
+    constexpr memory_cell<Edge> peek(long p, long q) const {
+        const size_t index = detail::axial_to_mem_index(p, q);
+        return index < cells.size() ? cells[index] : memory_cell<Edge>{};
+    }
+
+    constexpr long rings() const {
+        return Rings;
+    }
+};
+
+// I/O policies have peek() return the next byte of input or EOF, next() consume it, and write() take output.
+
+// input from a buffer and output to a string
+struct buffer_io {
+    std::string_view input;
+    size_t position = 0;
+    std::string output;
+
+    constexpr buffer_io(std::string_view input = {}) : input(input) {}
+
+    constexpr int peek() const {
+        return position < input.size() ? (unsigned char)input[position] : EOF;
+    }
+
+    constexpr void next() {
+        position++;
+    }
+
+    constexpr void write(const char *data, size_t length) {
+        output.append(data, length);
+    }
+};
+
+// stdin and stdout, or any other pair of streams
+struct stdio_io {
+    FILE *in = stdin;
+    FILE *out = stdout;
+
+    int peek() const {
+        const int c = getc(in);
+        return c == EOF ? EOF : ungetc(c, in);
+    }
+
+    void next() {
+        getc(in);
+    }
+
+    void write(const char *data, size_t length) {
+        fwrite(data, 1, length, out);
+    }
+};
+
+// input and output that are never used, for programs run for their memory or step count
+struct null_io {
+    constexpr int peek() const {
+        return EOF;
+    }
+
+    constexpr void next() {}
+
+    constexpr void write(const char *, size_t) {}
+};
+
+// characters in an array of fixed size, which can be the result of a constant expression
+template <size_t Capacity> struct fixed_string {
+    std::array<char, Capacity> data{};
+    size_t length = 0;
+
+    constexpr std::string_view view() const {
+        return {data.data(), length};
+    }
+
+    constexpr bool operator==(std::string_view other) const {
+        return view() == other;
+    }
+};
+
+// input from a buffer and output to a fixed_string, for evaluating programs at compile time
+template <size_t Capacity> struct fixed_io {
+    std::string_view input;
+    size_t position = 0;
+    fixed_string<Capacity> output;
+
+    constexpr fixed_io(std::string_view input = {}) : input(input) {}
+
+    constexpr int peek() const {
+        return position < input.size() ? (unsigned char)input[position] : EOF;
+    }
+
+    constexpr void next() {
+        position++;
+    }
+
+    constexpr void write(const char *data, size_t length) {
+        if (Capacity - output.length < length)
+            detail::output_capacity_exceeded();
+        for (size_t i = 0; i < length; i++)
+            output.data[output.length++] = data[i];
+    }
+};
+
+// Debug policies say which instructions to stop before. on_break() is called before each of them with the vm, and
+// run() returns STOPPED if it returns false.
+
+// no hooks at all, the loop has no trace of them
+struct no_debug {
+    static constexpr bool breakpoints = false; // before the instructions marked with `
+    static constexpr bool every_step = false;  // before every instruction
+};
+
+// calls a function before every instruction marked with `
+template <class Hook> struct break_hook {
+    static constexpr bool breakpoints = true;
+    static constexpr bool every_step = false;
+    Hook on_break;
+};
+
+// calls a function before every instruction, for tracing and single stepping
+template <class Hook> struct step_hook {
+    static constexpr bool breakpoints = true;
+    static constexpr bool every_step = true;
+    Hook on_break;
+};
+
+template <class Edge, class MemoryPolicy = spiral_memory<Edge>, class IoPolicy = buffer_io,
+          class DebugPolicy = no_debug>
+class vm {
+    static_assert(std::is_integral_v<Edge> && std::is_signed_v<Edge>, "memory edges are signed integers");
+    static_assert(std::is_same_v<typename MemoryPolicy::edge, Edge>, "the memory policy must hold Edge");
+
+    using unsigned_edge = std::make_unsigned_t<Edge>;
+
+public:
+    const program *code;
+    std::array<ip, 6> IPs;
+    int IP_index = 0;
+    memory_pointer MP = {0, 0, Z, memory_pointer::OUT};
+    unsigned long steps = 0;
+    bool at_break = false; // the hook has already been called for the current instruction
+
+    MemoryPolicy memory;
+    IoPolicy io;
+    DebugPolicy debug;
+
+    constexpr vm(const program &code, MemoryPolicy memory = {}, IoPolicy io = {}, DebugPolicy debug = {})
+        : code(&code), memory(std::move(memory)), io(std::move(io)), debug(std::move(debug)) {
+        const long rings = code.rings;
+        IPs = {{
+            {          0, -(rings - 1),  E, false}, // NW
+            {-(rings - 1),           0, SE, false}, // NE
+            {-(rings - 1), +(rings - 1), SW, false}, // E
+            {          0, +(rings - 1),  W, false}, // SE
+            {+(rings - 1),           0, NW, false}, // SW
+            {+(rings - 1), -(rings - 1), NE, false}, // W
+        }};
+    }
+
+    [[gnu::always_inline]] constexpr Edge &current_edge() {
+        return memory.cell(MP.p, MP.q)[MP.axis];
+    }
+
+    [[gnu::always_inline]] constexpr Edge &neighbor_edge(enum neighbor neighbor) {
+        long xyz[3] = {MP.p, MP.q, -MP.p - MP.q};
+        const enum axis neighbor_axis = (enum axis)detail::modulo((long)MP.axis + neighbor, 3);
+        if (MP.direction == memory_pointer::OUT) {
+            ++xyz[MP.axis];
+            --xyz[neighbor_axis];
+        }
+        return memory.cell(xyz[X], xyz[Y])[neighbor_axis];
+    }
+
+    // Runs until the program halts, a debug hook stops it, or steps reaches step_limit. As in vm_run(), the limit
+    // is checked only where a straight line run of instructions ends.
+    constexpr status run(unsigned long step_limit = ULONG_MAX) {
+        const long program_rings = code->rings;
+        const program_cell *cells = code->cells.data();
+        while (true) {
+            ip &IP = IPs[IP_index];
+            bool trace_end = false;
+            if (IP.ignore_next) {
+                IP.ignore_next = false;
+            } else {
+                const program_cell &instruction = cells[detail::axial_to_index(IP.p, IP.q, program_rings)];
+                if constexpr (DebugPolicy::breakpoints) {
+                    if ((DebugPolicy::every_step || instruction.debug) && !at_break) {
+                        at_break = true;
+                        if (!debug.on_break(*this))
+                            return STOPPED;
+                    }
+                }
+                if (!execute(instruction.value, IP, trace_end)) {
+                    at_break = false;
+                    return instruction.value == '@' ? HALTED : DIVIDED;
+                }
+            }
+            if constexpr (DebugPolicy::breakpoints)
+                at_break = false;
+            steps++;
+            move(IP, program_rings, trace_end);
+            if (trace_end && steps >= step_limit)
+                return YIELD;
+        }
+    }
+
+private:
+    static constexpr Edge wrap(unsigned_edge value) {
+        return static_cast<Edge>(value);
+    }
+
+    // the outgoing direction for each incoming one, as in the tables of vm.c
+    static constexpr enum direction slash[6] = {E, NE, NW, W, SW, SE};
+    static constexpr enum direction backslash[6] = {NW, W, SW, SE, E, NE};
+    static constexpr enum direction underscore[6] = {SW, SE, E, NE, NW, W};
+    static constexpr enum direction pipe[6] = {NE, NW, W, SW, SE, E};
+    static constexpr enum direction less[6] = {W, SW, E, NW, W, E};    // E branches
+    static constexpr enum direction greater[6] = {SE, E, W, E, NE, W}; // W branches
+
+    // axial offsets for each direction
+    static constexpr long offset[6][2] = {{0, -1}, {-1, 0}, {-1, 1}, {0, 1}, {1, 0}, {1, -1}};
+
+    constexpr void move_mp(enum neighbor neighbor) {
+        long xyz[3] = {MP.p, MP.q, -MP.p - MP.q};
+        const enum axis neighbor_axis = (enum axis)detail::modulo((long)MP.axis + neighbor, 3);
+        if (MP.direction == memory_pointer::OUT) {
+            ++xyz[MP.axis];
+            --xyz[neighbor_axis];
+            MP.direction = memory_pointer::IN;
+        } else {
+            MP.direction = memory_pointer::OUT;
+        }
+        MP.axis = neighbor_axis;
+        MP.p = xyz[X];
+        MP.q = xyz[Y];
+    }
+
+    constexpr void reverse_mp() {
+        MP.direction = MP.direction == memory_pointer::IN ? memory_pointer::OUT : memory_pointer::IN;
+    }
+
+    // reads the number for '?', see scan_number() in vm.c
+    constexpr Edge read_number() {
+        int c;
+        while ((c = io.peek()) != EOF && !detail::is_digit(c) && c != '+' && c != '-')
+            io.next();
+        bool negative = false;
+        if (c == '+' || c == '-') {
+            negative = c == '-';
+            io.next();
+        }
+        unsigned_edge value = 0;
+        while (detail::is_digit(c = io.peek())) {
+            value = value * 10 + (c - '0');
+            io.next();
+        }
+        return wrap(negative ? 0 - value : value);
+    }
+
+    constexpr void write_decimal(Edge value) {
+        char decimal[sizeof(Edge) * 3 + 2];
+        size_t start = sizeof(decimal);
+        unsigned_edge magnitude = value < 0 ? 0 - (unsigned_edge)value : (unsigned_edge)value;
+        do {
+            decimal[--start] = '0' + magnitude % 10;
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (value < 0)
+            decimal[--start] = '-';
+        io.write(decimal + start, sizeof(decimal) - start);
+    }
+
+    // executes one instruction, returns false for '@' and for a division by zero, which is not executed
+    [[gnu::always_inline]] constexpr bool execute(char instruction, ip &IP, bool &trace_end) {
+        if (detail::is_letter(instruction)) {
+            current_edge() = instruction;
+            return true;
+        }
+        if (detail::is_digit(instruction)) {
+            Edge &edge = current_edge();
+            const Edge shifted = wrap((unsigned_edge)edge * 10);
+            const unsigned_edge digit = instruction - '0';
+            edge = wrap(shifted < 0 ? (unsigned_edge)shifted - digit : (unsigned_edge)shifted + digit);
+            return true;
+        }
+        switch (instruction) {
+        case '@':
+            return false;
+
+        case ')': {
+            Edge &edge = current_edge();
+            edge = wrap((unsigned_edge)edge + 1);
+        }   break;
+        case '(': {
+            Edge &edge = current_edge();
+            edge = wrap((unsigned_edge)edge - 1);
+        }   break;
+        case '~': {
+            Edge &edge = current_edge();
+            edge = wrap(0 - (unsigned_edge)edge);
+        }   break;
+
+        case '+': {
+            const Edge left = neighbor_edge(LEFT), right = neighbor_edge(RIGHT);
+            current_edge() = wrap((unsigned_edge)left + (unsigned_edge)right);
+        }   break;
+        case '-': {
+            const Edge left = neighbor_edge(LEFT), right = neighbor_edge(RIGHT);
+            current_edge() = wrap((unsigned_edge)left - (unsigned_edge)right);
+        }   break;
+        case '*': {
+            const Edge left = neighbor_edge(LEFT), right = neighbor_edge(RIGHT);
+            current_edge() = wrap((unsigned_edge)left * (unsigned_edge)right);
+        }   break;
+        case ':': {
+            const Edge left = neighbor_edge(LEFT), right = neighbor_edge(RIGHT);
+            if (right == 0)
+                return false;
+            // the smallest edge by -1 wraps around like the C vm, where the division itself would overflow
+            current_edge() = right == -1 ? wrap(0 - (unsigned_edge)left) : left / right;
+        }   break;
+        case '%': {
+            const Edge left = neighbor_edge(LEFT), right = neighbor_edge(RIGHT);
+            if (right == 0)
+                return false;
+            current_edge() = right == -1 ? 0 : left % right;
+        }   break;
+
+        case ',': {
+            const int c = io.peek();
+            if (c != EOF)
+                io.next();
+            current_edge() = c;
+        }   break;
+
+        case '?': {
+            const Edge value = read_number();
+            current_edge() = value;
+        }   break;
+
+        case ';': {
+            const char byte = (char)detail::modulo(current_edge(), 256);
+            io.write(&byte, 1);
+        }   break;
+
+        case '!':
+            write_decimal(current_edge());
+            break;
+
+        case '$':
+            IP.ignore_next = true;
+            break;
+
+        case '/':
+            trace_end = true;
+            IP.direction = slash[IP.direction];
+            break;
+        case '\\':
+            trace_end = true;
+            IP.direction = backslash[IP.direction];
+            break;
+        case '_':
+            trace_end = true;
+            IP.direction = underscore[IP.direction];
+            break;
+        case '|':
+            trace_end = true;
+            IP.direction = pipe[IP.direction];
+            break;
+        case '<':
+            trace_end = true;
+            if (IP.direction == E)
+                IP.direction = current_edge() > 0 ? SE : NE;
+            else
+                IP.direction = less[IP.direction];
+            break;
+        case '>':
+            trace_end = true;
+            if (IP.direction == W)
+                IP.direction = current_edge() > 0 ? NW : SW;
+            else
+                IP.direction = greater[IP.direction];
+            break;
+
+        case '[':
+            IP_index = detail::modulo(IP_index - 1, 6);
+            trace_end = true;
+            break;
+        case ']':
+            IP_index = detail::modulo(IP_index + 1, 6);
+            trace_end = true;
+            break;
+        case '#':
+            IP_index = detail::modulo(current_edge(), 6);
+            trace_end = true;
+            break;
+
+        case '{': move_mp(LEFT); break;
+        case '}': move_mp(RIGHT); break;
+        case '"': reverse_mp(); move_mp(RIGHT); reverse_mp(); break;
+        case '\'': reverse_mp(); move_mp(LEFT); reverse_mp(); break;
+        case '=': reverse_mp(); break;
+        case '^': move_mp(current_edge() <= 0 ? LEFT : RIGHT); break;
+
+        case '&': {
+            const Edge value = neighbor_edge(current_edge() <= 0 ? LEFT : RIGHT);
+            current_edge() = value;
+        }   break;
+        }
+        return true;
+    }
+
+    // moves the IP on, wrapping around the edges of the hexagon as vm_run() does
+    [[gnu::always_inline]] constexpr void move(ip &IP, long program_rings, bool &trace_end) {
+        long np = IP.p + offset[IP.direction][0];
+        long nq = IP.q + offset[IP.direction][1];
+        const long nr = -np - nq;
+        if (detail::absolute(np) + detail::absolute(nq) + detail::absolute(nr) >= 2 * program_rings) {
+            trace_end = true;
+            enum axis reflection = X;
+            if (np == 0)
+                reflection = current_edge() > 0 ? Y : Z;
+            else if (nq == 0)
+                reflection = current_edge() > 0 ? Z : X;
+            else if (nr == 0)
+                reflection = current_edge() > 0 ? X : Y;
+            else if (nq * nr > 0)
+                reflection = X;
+            else if (nr * np > 0)
+                reflection = Y;
+            else if (np * nq > 0)
+                reflection = Z;
+            switch (reflection) {
+            case X: np = -IP.p; nq = IP.p + IP.q; break;
+            case Y: np = IP.p + IP.q; nq = -IP.q; break;
+            case Z: np = -IP.q; nq = -IP.p; break;
+            }
+        }
+        IP.p = np;
+        IP.q = nq;
+    }
+};
+
+// Runs a program on an input and returns its output, in a constant expression as well as at run time:
+//
+//     constexpr auto table = hexagony::evaluate<256>(generator_source);
+//     static_assert(hexagony::evaluate<16>("H;i;@") == "Hi");
+//
+// Memory is fixed_memory with MemoryRings rings and output a fixed_string of OutputCapacity characters. A program
+// that leaves that memory, writes more output or does not halt within step_limit steps does not compile, the error
+// names detail::memory_rings_exceeded(), detail::output_capacity_exceeded() or detail::step_limit_exceeded(), and
+// one that divides by zero names detail::division_by_zero(). Compilers also limit the work of a constant expression,
+// gcc stops after about a million steps unless -fconstexpr-ops-limit raises its limit.
+template <size_t OutputCapacity, long MemoryRings = 16, class Edge = int32_t>
+constexpr fixed_string<OutputCapacity> evaluate(std::string_view source, std::string_view input = {},
+                                                unsigned long step_limit = 100000) {
+    // Compilers limit the iterations of any one loop in a constant expression, gcc to 262144 by default, so the
+    // steps run in chunks with a fresh call to run() for each.
+    constexpr unsigned long chunk = 100000;
+    const program code = parse(source);
+    vm<Edge, fixed_memory<Edge, MemoryRings>, fixed_io<OutputCapacity>> machine(code, {}, {input});
+    while (true) {
+        const unsigned long limit = step_limit - machine.steps > chunk ? machine.steps + chunk : step_limit;
+        const status result = machine.run(limit);
+        if (result == HALTED)
+            return machine.io.output;
+        if (result == DIVIDED)
+            detail::division_by_zero();
+        if (machine.steps >= step_limit)
+            detail::step_limit_exceeded();
+    }
+}
+
+} // namespace hexagony
+
+#endif
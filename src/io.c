@@ -0,0 +1,194 @@
+// compiled once for each width of memory edges, like vm.c, io-wide.c builds wide_vm_run_io()
+#include "io.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#if MEMORY_EDGE_BITS == 32
+
+#ifndef IO_BUFFER_SIZE
+#define IO_BUFFER_SIZE 65536 // at least the longest '!' of the wide vm
+#endif
+
+bool io_init(struct vm_io *io, const char *input, size_t length,
+             bool (*next_input)(void *context, const char **input, size_t *length),
+             bool (*write_output)(void *context, const char *output, size_t length), void *context) {
+    *io = (struct vm_io){
+        .input = input,
+        .input_length = length,
+        .next_input = next_input,
+        .write_output = write_output,
+        .context = context,
+        .output = malloc(IO_BUFFER_SIZE),
+        .output_capacity = IO_BUFFER_SIZE,
+        .input_fd = -1,
+        .output_fd = -1,
+    };
+    return io->output != NULL;
+}
+
+static bool read_fd(void *context, const char **input, size_t *length) {
+    struct vm_io *io = context;
+    ssize_t n;
+    while ((n = read(io->input_fd, io->read_buffer, IO_BUFFER_SIZE)) < 0 && errno == EINTR)
+        ;
+    *input = io->read_buffer;
+    *length = n > 0 ? n : 0;
+    return n >= 0;
+}
+
+static bool write_fd(void *context, const char *output, size_t length) {
+    const struct vm_io *io = context;
+    for (size_t written = 0; written < length;) {
+        const ssize_t n = write(io->output_fd, output + written, length - written);
+        if (n < 0 && errno != EINTR)
+            return false;
+        if (n > 0)
+            written += n;
+    }
+    return true;
+}
+
+bool io_init_fds(struct vm_io *io, int input_fd, int output_fd) {
+    if (!io_init(io, NULL, 0, read_fd, write_fd, io))
+        return false;
+    io->input_fd = input_fd;
+    io->output_fd = output_fd;
+    io->read_buffer = malloc(IO_BUFFER_SIZE);
+    if (io->read_buffer == NULL) {
+        io_free(io);
+        return false;
+    }
+    return true;
+}
+
+bool io_init_async(struct vm_io *io, int input_fd, int output_fd) {
+    if (!io_init_fds(io, input_fd, output_fd))
+        return false;
+    struct writer *writer = malloc(sizeof(struct writer));
+    char *output = writer != NULL ? writer_start(writer, output_fd) : NULL;
+    if (output == NULL) {
+        free(writer);
+        io_free(io);
+        return false;
+    }
+    free(io->output);
+    io->output = output;
+    io->output_capacity = WRITER_BUFFER_SIZE;
+    io->writer = writer;
+    return true;
+}
+
+void io_free(struct vm_io *io) {
+    if (io->writer != NULL) {
+        writer_stop(io->writer);
+        free(io->writer);
+    } else {
+        free(io->output);
+    }
+    free(io->read_buffer);
+    io->output = io->read_buffer = NULL;
+    io->writer = NULL;
+}
+
+bool io_flush(struct vm_io *io) {
+    if (io->writer != NULL) {
+        const bool submitted = writer_submit(io->writer, &io->output, io->output_length);
+        io->output_length = 0;
+        return writer_drain(io->writer) && submitted;
+    }
+    if (io->write_output == NULL || io->output_length == 0)
+        return true;
+    const bool written = io->write_output(io->context, io->output, io->output_length);
+    io->output_length = 0;
+    return written;
+}
+
+#endif
+
+// makes room in the output buffer once the vm has filled it
+static bool make_room(struct vm_io *io) {
+    if (io->writer != NULL) {
+        const bool submitted = writer_submit(io->writer, &io->output, io->output_length);
+        io->output_length = 0;
+        return submitted;
+    }
+    if (io->write_output != NULL)
+        return io_flush(io);
+    char *output = realloc(io->output, 2 * io->output_capacity);
+    if (output == NULL)
+        return false;
+    io->output = output;
+    io->output_capacity *= 2;
+    return true;
+}
+
+// hands on output with make_room() or io_flush(), as a span of the trace if there is one
+static bool flush_traced(struct vm_io *io, bool (*flush)(struct vm_io *io)) {
+    if (io->trace == NULL || (io->writer == NULL && (io->write_output == NULL || io->output_length == 0)))
+        return flush(io);
+    const size_t length = io->output_length;
+    const double start = trace_now(io->trace);
+    const bool flushed = flush(io);
+    trace_span(io->trace, TRACE_HOST, "flush", start, "bytes", length);
+    return flushed;
+}
+
+// the span to give a vm that asks for input
+static bool next_span(struct vm_io *io, const char **input, size_t *length) {
+    if (io->input != NULL) {
+        *input = io->input;
+        *length = io->input_length;
+        io->input = NULL;
+        return true;
+    }
+    if (io->next_input == NULL) {
+        *length = 0;
+        return true;
+    }
+    if (io->trace == NULL)
+        return io->next_input(io->context, input, length);
+    const double start = trace_now(io->trace);
+    const bool read = io->next_input(io->context, input, length);
+    trace_span(io->trace, TRACE_HOST, "read", start, "bytes", read ? *length : 0);
+    return read;
+}
+
+enum vm_status vm_run_io(struct vm *vm, struct vm_io *io) {
+    vm->output = io->output;
+    vm->output_capacity = io->output_capacity;
+    vm->output_length = io->output_length;
+    while (true) {
+        const enum vm_status status = vm_run(vm);
+        io->output_length = vm->output_length;
+        if (status == VM_OUTPUT) {
+            if (!flush_traced(io, make_room))
+                return VM_OUTPUT;
+            vm->output = io->output;
+            vm->output_capacity = io->output_capacity;
+            vm->output_length = io->output_length;
+        } else if (status == VM_INPUT) {
+            // whatever the program wrote before it reads goes out first, it may be a prompt
+            const char *input;
+            size_t length;
+            if (!flush_traced(io, io_flush))
+                return VM_OUTPUT;
+            // the writer thread hands back another buffer
+            vm->output = io->output;
+            vm->output_length = io->output_length;
+            if (!next_span(io, &input, &length))
+                return VM_INPUT;
+            if (length > 0)
+                vm_set_input(vm, input, length);
+            else
+                vm_close_input(vm);
+        } else {
+            if (!flush_traced(io, io_flush))
+                return VM_OUTPUT;
+            vm->output = io->output;
+            vm->output_length = io->output_length;
+            return status;
+        }
+    }
+}
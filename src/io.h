@@ -0,0 +1,54 @@
+#ifndef HEXAGONY_IO_H
+#define HEXAGONY_IO_H
+
+#include "trace.h"
+#include "vm-wide.h"
+#include "writer.h"
+
+// Where the input of a vm comes from and where its output goes, for hosts that would rather not handle VM_INPUT and
+// VM_OUTPUT themselves. The vm reads every span of input in place and writes its output into the buffer of the io,
+// which is handed on as a whole whenever it fills and whenever the vm stops.
+struct vm_io {
+    // the first span of input, given to the vm as is
+    const char *input;
+    size_t input_length;
+    // Gives the next span once the vm has consumed the last one, with length 0 at the end of the input. Without it
+    // the input ends after the first span.
+    bool (*next_input)(void *context, const char **input, size_t *length);
+    // Takes a run of output. Without it the buffer grows instead, and holds all of the output of the run.
+    bool (*write_output)(void *context, const char *output, size_t length);
+    void *context;
+
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+
+    // file descriptors of io_init_fds() and the buffer it reads into
+    int input_fd, output_fd;
+    char *read_buffer;
+    // the writer thread of io_init_async(), which owns the output buffers
+    struct writer *writer;
+    // a trace that gets a span for every read of input and flush of output, or NULL
+    struct trace *trace;
+};
+
+// Sets up an io on spans the host provides, either of the callbacks may be NULL. Returns false if no memory is left.
+bool io_init(struct vm_io *io, const char *input, size_t length,
+             bool (*next_input)(void *context, const char **input, size_t *length),
+             bool (*write_output)(void *context, const char *output, size_t length), void *context);
+// sets up an io that reads input_fd and writes output_fd directly, in batches the size of their buffers
+bool io_init_fds(struct vm_io *io, int input_fd, int output_fd);
+// Like io_init_fds(), but the output is written by a thread of its own while the vm fills the next buffer. Flushing
+// waits for it.
+bool io_init_async(struct vm_io *io, int input_fd, int output_fd);
+void io_free(struct vm_io *io);
+// hands the buffered output to write_output or the writer thread, if there is one
+bool io_flush(struct vm_io *io);
+
+// Runs a vm until it returns something other than VM_INPUT or VM_OUTPUT, which the io handles, with the output
+// flushed. VM_INPUT and VM_OUTPUT are returned only when reading or writing fails, with errno set. The vm is
+// attached to the io on every call, and can carry on with another io.
+enum vm_status vm_run_io(struct vm *vm, struct vm_io *io);
+enum vm_status wide_vm_run_io(struct wide_vm *vm, struct vm_io *io);
+
+#endif
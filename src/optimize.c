@@ -0,0 +1,361 @@
+#include "optimize.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FOLDED_DIGITS 3 // letters have at most three digits
+#define CHECK_INTERVAL 256  // steps between memory checks of a rewritten program
+
+// how much memory a rewritten program may use before it is given up on, so that one that walks off in a straight
+// line does not grow memory by a ring every step until it runs out of steps
+static long memory_allowed(long original_rings) {
+    return 2 * original_rings + 16;
+}
+
+// one IP on one cell, as the static analysis follows it
+struct state {
+    int IP;
+    long p, q;
+    enum direction direction;
+    bool ignore_next;
+};
+
+static size_t state_index(const struct state *state, const struct program *program) {
+    const size_t cell = axial_to_index(state->p, state->q, program->rings);
+    return ((state->IP * program->size + cell) * 6 + state->direction) * 2 + state->ignore_next;
+}
+
+bool find_live_cells(const struct program *program, bool *live) {
+    struct vm vm; // only for where the IPs start
+    const size_t count = 6 * program->size * 6 * 2;
+    bool *visited = calloc(count, sizeof(bool));
+    struct state *stack = malloc(count * sizeof(struct state));
+    if (visited == NULL || stack == NULL || !vm_init(&vm, program)) {
+        free(visited);
+        free(stack);
+        return false;
+    }
+    vm_free(&vm);
+    memset(live, 0, program->size * sizeof(bool));
+
+    // IP 0 starts out running, the others once something switches to them, which can be found after their turn
+    bool active[6] = {true};
+    bool again = true;
+    while (again) {
+        again = false;
+        for (int IP = 0; IP < 6; IP++) {
+            const struct state start = {IP, vm.IPs[IP].p, vm.IPs[IP].q, vm.IPs[IP].direction, false};
+            if (!active[IP] || visited[state_index(&start, program)])
+                continue;
+            again = true;
+            visited[state_index(&start, program)] = true;
+            size_t top = 0;
+            stack[top++] = start;
+            while (top > 0) {
+                const struct state state = stack[--top];
+                const ssize_t cell = axial_to_index(state.p, state.q, program->rings);
+                enum direction directions[2] = {state.direction};
+                int turns = 1;
+                bool ignore_next = false;
+                if (!state.ignore_next) {
+                    const char instruction = program->cells[cell].value;
+                    live[cell] = true;
+                    if (instruction == '@')
+                        continue;
+                    // the branches of < and > go either way
+                    directions[0] = ip_turn(instruction, state.direction, false);
+                    directions[1] = ip_turn(instruction, state.direction, true);
+                    turns = directions[1] != directions[0] ? 2 : 1;
+                    ignore_next = instruction == '$';
+                    if (instruction == '[')
+                        active[(state.IP + 5) % 6] = true;
+                    if (instruction == ']')
+                        active[(state.IP + 1) % 6] = true;
+                    if (instruction == '#')
+                        memset(active, true, sizeof(active));
+                }
+                for (int t = 0; t < turns; t++) {
+                    struct IP next[2] = {{state.p, state.q, directions[t], false}};
+                    int moves = 1;
+                    if (ip_step(program->rings, next) == IP_CORNER) { // which can wrap either way too
+                        next[1] = next[0];
+                        ip_wrap(next, false);
+                        ip_wrap(next + 1, true);
+                        moves = 2;
+                    }
+                    for (int m = 0; m < moves; m++) {
+                        const struct state successor = {state.IP, next[m].p, next[m].q, directions[t], ignore_next};
+                        const size_t index = state_index(&successor, program);
+                        if (!visited[index]) {
+                            visited[index] = true;
+                            stack[top++] = successor;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    free(visited);
+    free(stack);
+    return true;
+}
+
+bool record_samples(const struct program *program, struct sample *samples, size_t count, unsigned long step_limit) {
+    struct vm vm;
+    if (!vm_init(&vm, program))
+        return false;
+    char output[BUFSIZ];
+    bool success = true;
+    for (size_t i = 0; success && i < count; i++) {
+        struct sample *sample = samples + i;
+        success = vm_reset(&vm);
+        vm_set_input(&vm, sample->input, sample->input_length);
+        vm_close_input(&vm);
+        vm_set_output(&vm, output, sizeof(output));
+        vm.step_limit = step_limit;
+        sample->output = NULL;
+        sample->output_length = 0;
+        bool running = success;
+        while (running) {
+            const enum vm_status status = vm_run(&vm);
+            if (status == VM_OUTPUT || status == VM_HALTED) {
+                char *grown = realloc(sample->output, sample->output_length + vm.output_length + 1);
+                if (grown == NULL) {
+                    success = running = false;
+                    break;
+                }
+                sample->output = grown;
+                memcpy(sample->output + sample->output_length, vm.output, vm.output_length);
+                sample->output_length += vm.output_length;
+                vm.output_length = 0;
+            }
+            if (status == VM_HALTED)
+                running = false;
+            else if (status == VM_YIELD || status == VM_INPUT || status == VM_MISMATCH || status == VM_DIVIDE_BY_ZERO)
+                success = running = false;
+        }
+        sample->steps = vm.steps;
+        sample->memory_rings = vm.memory_rings;
+    }
+    vm_free(&vm);
+    return success;
+}
+
+// Runs a rewritten program on every sample, each within the steps the best program so far took. Returns true if it
+// halts with the original output on all of them, with the steps it took in steps. Unless branches is NULL, the
+// outcomes of every run are counted into it, one site per cell.
+static bool check_samples(const char *code, size_t length, const struct sample *samples, size_t count,
+                          unsigned long *steps, struct branch_site *branches) {
+    struct program program;
+    if (!parse_program(&program, code, length))
+        return false;
+    struct vm vm;
+    if (!vm_init(&vm, &program)) {
+        free_program(&program);
+        return false;
+    }
+    size_t capacity = DECIMAL_LENGTH;
+    for (size_t i = 0; i < count; i++) {
+        if (samples[i].output_length + DECIMAL_LENGTH > capacity)
+            capacity = samples[i].output_length + DECIMAL_LENGTH;
+    }
+    char *output = malloc(capacity);
+    bool same = output != NULL;
+    for (size_t i = 0; same && i < count; i++) {
+        const struct sample *sample = samples + i;
+        same = vm_reset(&vm);
+        vm_set_input(&vm, sample->input, sample->input_length);
+        vm_close_input(&vm);
+        // output never gets past the original output, so this is never too small
+        vm_set_output(&vm, output, sample->output_length + DECIMAL_LENGTH);
+        vm_set_expected_output(&vm, sample->output, sample->output_length);
+        vm.branch_profile = branches;
+        // the limit is the steps before '@', which a yield could come right before
+        const unsigned long step_limit = sample->steps + 1;
+        vm.step_limit = CHECK_INTERVAL < step_limit ? CHECK_INTERVAL : step_limit;
+        enum vm_status status;
+        while ((status = vm_run(&vm)) == VM_BREAK ||
+               (status == VM_YIELD && vm.steps < step_limit && vm.memory_rings <= memory_allowed(sample->memory_rings)))
+            vm.step_limit = vm.steps + CHECK_INTERVAL < step_limit ? vm.steps + CHECK_INTERVAL : step_limit;
+        same = same && status == VM_HALTED && vm.expect_position == sample->output_length &&
+               vm.steps <= sample->steps;
+        steps[i] = vm.steps;
+    }
+    free(output);
+    vm_free(&vm);
+    free_program(&program);
+    return same;
+}
+
+// Replaces the cells that can never run with no-ops and drops the ones the program ends in, as far as that keeps the
+// size of the hexagon.
+static bool remove_dead_cells(char *code, size_t *length) {
+    struct program program;
+    if (!parse_program(&program, code, *length))
+        return false;
+    bool *live = malloc(program.size * sizeof(bool));
+    const bool found = live != NULL && find_live_cells(&program, live);
+    for (size_t i = 0; found && i < *length; i++) {
+        if (!live[i])
+            code[i] = '.';
+    }
+    free(live);
+    free_program(&program);
+    const size_t inner = 3 * (program.rings - 1) * (program.rings - 2) + 1; // cells of the next smaller hexagon
+    while (*length > inner && code[*length - 1] == '.')
+        --*length;
+    return found;
+}
+
+// Replaces every '#' that switched to the same IP relative to the one executing it on all of the samples with the
+// instruction that always does: a no-op, ']' or '['. Those can be laid out like any other instruction, and unlike '#'
+// they do not make every IP live. Each replacement is kept if the samples still give the same output.
+static bool specialize_switches(char *code, size_t length, const struct sample *samples, size_t count,
+                                unsigned long *steps) {
+    struct branch_site *branches = calloc(length, sizeof(struct branch_site));
+    if (branches == NULL)
+        return false;
+    static const char specialized[6] = {'.', ']', 0, 0, 0, '['};
+    const bool profiled = check_samples(code, length, samples, count, steps, branches);
+    for (size_t i = 0; profiled && i < length; i++) {
+        if (code[i] != '#')
+            continue;
+        int targets = 0, offset = 0;
+        for (int o = 0; o < 6; o++) {
+            if (branches[i].instruction[o] > 0) {
+                targets++;
+                offset = o;
+            }
+        }
+        if (targets != 1 || specialized[offset] == 0)
+            continue;
+        code[i] = specialized[offset];
+        if (!check_samples(code, length, samples, count, steps, NULL))
+            code[i] = '#';
+    }
+    free(branches);
+    return profiled;
+}
+
+// the size of the hexagon the code is laid out on
+static long rings(size_t length) {
+    long rings = 1;
+    while ((size_t)(3 * rings * (rings - 1) + 1) < length)
+        rings++;
+    return rings;
+}
+
+// Candidate rewrites of the code, each one edit: the i'th no-op removed, or the digits starting at the i'th cell
+// folded into a letter. Writes the candidate and returns its length, or returns 0 if there is no such rewrite.
+static size_t rewrite(const char *code, size_t length, size_t edit, char *candidate) {
+    const size_t cell = edit / (MAX_FOLDED_DIGITS + 1);
+    const size_t digits = edit % (MAX_FOLDED_DIGITS + 1);
+    size_t removed = 0;
+    char letter = 0;
+    if (digits == 0) {
+        if (code[cell] != '.')
+            return 0;
+        removed = 1;
+    } else if (digits == 1) {
+        // a leading zero does nothing to a zero edge
+        if (cell + 1 >= length || code[cell] != '0' || !isdigit((unsigned char)code[cell + 1]))
+            return 0;
+        removed = 1;
+    } else {
+        // digits building the value of a letter on a zero edge, which the letter sets on any edge
+        int value = 0;
+        for (size_t i = 0; i < digits; i++) {
+            if (cell + i >= length || !isdigit((unsigned char)code[cell + i]))
+                return 0;
+            value = value * 10 + code[cell + i] - '0';
+        }
+        if (value > 127 || !isalpha(value))
+            return 0;
+        letter = value;
+        removed = digits - 1;
+    }
+    memcpy(candidate, code, cell);
+    size_t written = cell;
+    if (letter != 0)
+        candidate[written++] = letter;
+    memcpy(candidate + written, code + cell + removed + (letter != 0), length - cell - removed - (letter != 0));
+    return length - removed;
+}
+
+bool optimize_program(struct program *program, struct sample *samples, size_t count) {
+    size_t length = program->size;
+    char *code = malloc(length);
+    char *candidate = malloc(length);
+    char *best = malloc(length);
+    unsigned long *steps = malloc((count + 1) * sizeof(unsigned long));
+    unsigned long *best_steps = malloc((count + 1) * sizeof(unsigned long));
+    bool success = code != NULL && candidate != NULL && best != NULL && steps != NULL && best_steps != NULL;
+    if (!success) {
+        free(code);
+        free(candidate);
+        free(best);
+        free(steps);
+        free(best_steps);
+        return false;
+    }
+    for (size_t i = 0; i < length; i++)
+        code[i] = program->cells[i].value;
+
+    // dead cells never run, so removing them cannot change what the program does, and the switches the samples
+    // need can leave more of them dead
+    success = remove_dead_cells(code, &length) && specialize_switches(code, length, samples, count, steps)
+           && remove_dead_cells(code, &length) && check_samples(code, length, samples, count, steps, NULL);
+    bool improved = success;
+    while (improved) {
+        // the rewrite that takes the fewest steps, then the one on the smallest hexagon, then the shortest
+        unsigned long total = 0;
+        for (size_t i = 0; i < count; i++)
+            total += samples[i].steps;
+        unsigned long best_total = total;
+        long best_rings = rings(length);
+        size_t best_length = length;
+        for (size_t edit = 0; edit < length * (MAX_FOLDED_DIGITS + 1); edit++) {
+            const size_t candidate_length = rewrite(code, length, edit, candidate);
+            if (candidate_length == 0 || !check_samples(candidate, candidate_length, samples, count, steps, NULL))
+                continue;
+            unsigned long candidate_total = 0;
+            for (size_t i = 0; i < count; i++)
+                candidate_total += steps[i];
+            const long candidate_rings = rings(candidate_length);
+            if (candidate_total < best_total ||
+                (candidate_total == best_total &&
+                 (candidate_rings < best_rings || (candidate_rings == best_rings && candidate_length < best_length)))) {
+                best_total = candidate_total;
+                best_rings = candidate_rings;
+                best_length = candidate_length;
+                memcpy(best, candidate, candidate_length);
+                memcpy(best_steps, steps, count * sizeof(unsigned long));
+            }
+        }
+        improved = best_length != length || best_total != total;
+        if (improved) {
+            memcpy(code, best, best_length);
+            length = best_length;
+            for (size_t i = 0; i < count; i++)
+                samples[i].steps = best_steps[i];
+            success = remove_dead_cells(code, &length);
+            improved = success;
+        }
+    }
+
+    struct program optimized;
+    if (success && parse_program(&optimized, code, length)) {
+        free_program(program);
+        *program = optimized;
+    } else {
+        success = false;
+    }
+    free(code);
+    free(candidate);
+    free(best);
+    free(steps);
+    free(best_steps);
+    return success;
+}
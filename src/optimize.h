@@ -0,0 +1,32 @@
+#ifndef HEXAGONY_OPTIMIZE_H
+#define HEXAGONY_OPTIMIZE_H
+
+#include "vm.h"
+
+// an input the optimized program has to behave the same on
+struct sample {
+    const char *input;
+    size_t input_length;
+    char *output; // of the original program
+    size_t output_length;
+    unsigned long steps; // taken by the best program so far
+    long memory_rings;   // used by the original program
+};
+
+// Marks the cells some IP can execute, following both ways of every branch and corner and every IP a switch can
+// activate. Anything not marked can never run on any input.
+bool find_live_cells(const struct program *program, bool *live);
+
+// Runs the program on every sample, recording its output and step count. Returns false unless it halts on all of
+// them within step_limit steps.
+bool record_samples(const struct program *program, struct sample *samples, size_t count, unsigned long step_limit);
+
+// Rewrites the program into an equivalent one that takes fewer steps on the samples: a '#' that always switched the
+// same way on a branch profile of the samples becomes the instruction that does, cells that can never run become
+// no-ops, runs of digits that build a constant become the letter with that value, and no-ops are removed where the
+// shorter layout still behaves the same, which shortens paths and can shrink the hexagon. Every rewrite is kept only
+// if the program still halts with the original output on every sample, in fewer steps or on a smaller hexagon.
+// The program is replaced by the result and the samples hold its step counts.
+bool optimize_program(struct program *program, struct sample *samples, size_t count);
+
+#endif
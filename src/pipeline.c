@@ -0,0 +1,366 @@
+#include "pipeline.h"
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "scheduler.h"
+
+#ifndef RING_SIZE
+#define RING_SIZE (1 << 16) // bytes buffered between two stages, must be a power of two
+#endif
+
+// Single producer, single consumer byte queue. The producing vm writes straight into the free space and the
+// consuming vm reads straight out of the filled space, so bytes are never copied between stages.
+struct ring {
+    char buffer[RING_SIZE];
+    _Alignas(64) atomic_size_t head; // total bytes consumed, only written by the consumer
+    _Alignas(64) atomic_size_t tail; // total bytes produced, only written by the producer
+    atomic_bool closed;              // the producer has halted
+    atomic_bool abandoned;           // the consumer has halted
+    // counts every change to the four above, a futex that a stage waiting for the other side sleeps on
+    _Alignas(64) atomic_uint changes;
+    atomic_uint sleepers;
+};
+
+struct stage {
+    pthread_t thread;
+    struct task *task; // when the stages share a thread
+    struct vm *vm;
+    enum vm_status status; // what the vm stopped for last
+    bool waiting;          // for the stage before or after to serve it
+    struct ring *in;       // NULL for the first stage, which reads the input file descriptor
+    struct ring *out;      // NULL for the last stage, which writes the output file
+    int input;
+    FILE *output;
+    char input_buffer[BUFSIZ];
+    char output_buffer[BUFSIZ];
+    char straddle[32]; // a '!' whose digits straddle the end of the ring buffer
+};
+
+// what a stage does after it has been served
+enum serve { SERVE_RUN, SERVE_WAIT, SERVE_END };
+
+// wakes the stages sleeping until the ring changes, after it has
+static void ring_changed(struct ring *ring) {
+    atomic_fetch_add(&ring->changes, 1);
+    if (atomic_load(&ring->sleepers) > 0)
+        syscall(SYS_futex, &ring->changes, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+// Waits for the other side of a ring to make progress. Spins for a while, then sleeps until the ring has changed
+// since changes was read, so that a stage waiting on a slow neighbour does not keep a core busy.
+static void backoff(struct ring *ring, unsigned changes, unsigned *spins) {
+    if (++*spins <= 64)
+        return;
+    atomic_fetch_add(&ring->sleepers, 1);
+    syscall(SYS_futex, &ring->changes, FUTEX_WAIT_PRIVATE, changes, NULL, NULL, 0);
+    atomic_fetch_sub(&ring->sleepers, 1);
+}
+
+// Gives the vm the longest contiguous readable run of the input ring. Once the producer has halted and everything it
+// wrote has been read, closes the input of the vm instead. Returns false if there is nothing to read yet.
+static bool acquire_input(struct ring *ring, struct vm *vm) {
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    // the producer may write its last bytes just before closing, so closed is read first
+    const bool closed = atomic_load_explicit(&ring->closed, memory_order_acquire);
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (tail != head) {
+        const size_t offset = head & (RING_SIZE - 1);
+        const size_t length = tail - head < RING_SIZE - offset ? tail - head : RING_SIZE - offset;
+        vm_set_input(vm, ring->buffer + offset, length);
+        return true;
+    }
+    if (closed)
+        vm_close_input(vm);
+    return closed;
+}
+
+static void release_input(struct ring *ring, struct vm *vm) {
+    if (vm->input_position > 0) {
+        atomic_fetch_add_explicit(&ring->head, vm->input_position, memory_order_release);
+        ring_changed(ring);
+    }
+    vm_set_input(vm, NULL, 0);
+}
+
+// the longest contiguous free run of a ring, which is empty if the ring is full
+static size_t free_run(struct ring *ring, char **start) {
+    const size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    const size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    const size_t offset = tail & (RING_SIZE - 1);
+    const size_t free = RING_SIZE - (tail - head);
+    *start = ring->buffer + offset;
+    return free < RING_SIZE - offset ? free : RING_SIZE - offset;
+}
+
+// Gives the vm the longest contiguous free run of the output ring. Returns false if the ring is full.
+static bool acquire_output(struct ring *ring, struct vm *vm) {
+    char *start;
+    const size_t length = free_run(ring, &start);
+    if (length > 0)
+        vm_set_output(vm, start, length);
+    return length > 0;
+}
+
+static void release_output(struct ring *ring, struct vm *vm) {
+    if (vm->output_length > 0) {
+        atomic_fetch_add_explicit(&ring->tail, vm->output_length, memory_order_release);
+        ring_changed(ring);
+    }
+    vm_set_output(vm, NULL, 0);
+}
+
+// Copies as much of the straddle buffer into the output ring as there is room for, and keeps the rest at its start.
+// Returns false if some of it is left.
+static bool flush_straddle(struct stage *stage) {
+    struct vm *vm = stage->vm;
+    size_t written = 0;
+    char *start;
+    size_t length;
+    while (written < vm->output_length && (length = free_run(stage->out, &start)) > 0) {
+        if (length > vm->output_length - written)
+            length = vm->output_length - written;
+        memcpy(start, stage->straddle + written, length);
+        atomic_fetch_add_explicit(&stage->out->tail, length, memory_order_release);
+        ring_changed(stage->out);
+        written += length;
+    }
+    memmove(stage->straddle, stage->straddle + written, vm->output_length - written);
+    vm->output_length -= written;
+    return vm->output_length == 0;
+}
+
+// writes out what is left of the output and closes the rings of the stage
+static enum serve end_stage(struct stage *stage) {
+    struct vm *vm = stage->vm;
+    const bool abandoned = stage->out != NULL && atomic_load_explicit(&stage->out->abandoned, memory_order_acquire);
+    if (stage->out == NULL)
+        fwrite(vm->output, 1, vm->output_length, stage->output);
+    else if (vm->output == stage->straddle && !abandoned && !flush_straddle(stage))
+        return SERVE_WAIT;
+    else if (vm->output != stage->straddle)
+        release_output(stage->out, vm);
+
+    if (stage->out != NULL) {
+        atomic_store_explicit(&stage->out->closed, true, memory_order_release);
+        ring_changed(stage->out);
+    }
+    if (stage->in != NULL) {
+        atomic_store_explicit(&stage->in->abandoned, true, memory_order_release);
+        ring_changed(stage->in);
+    }
+    // the buffers are not the vm's to keep
+    vm_set_input(vm, NULL, 0);
+    vm_set_output(vm, NULL, 0);
+    return SERVE_END;
+}
+
+// Serves whatever the vm of a stage stopped for. Returns SERVE_WAIT if that has to wait for the stage before or
+// after it, and can then be called again until it does not.
+static enum serve serve_stage(struct stage *stage) {
+    struct vm *vm = stage->vm;
+    switch (stage->status) {
+    case VM_HALTED:
+    case VM_YIELD:          // reached the step limit of the vm
+    case VM_DIVIDE_BY_ZERO: // the next stage sees the end of its input
+        return end_stage(stage);
+
+    case VM_OUTPUT:
+        if (stage->out == NULL) {
+            fwrite(vm->output, 1, vm->output_length, stage->output);
+            vm->output_length = 0;
+            return SERVE_RUN;
+        }
+        if (atomic_load_explicit(&stage->out->abandoned, memory_order_acquire))
+            return end_stage(stage); // the output would never be read
+        if (vm->output == stage->straddle) {
+            if (!flush_straddle(stage))
+                return SERVE_WAIT;
+        } else if (vm->output_length == 0 && vm->output_capacity > 0) {
+            // the end of the ring is too short for the next '!', write it through a small buffer instead
+            vm_set_output(vm, stage->straddle, sizeof(stage->straddle));
+            return SERVE_RUN;
+        } else {
+            release_output(stage->out, vm);
+        }
+        return acquire_output(stage->out, vm) ? SERVE_RUN : SERVE_WAIT;
+
+    case VM_INPUT:
+        if (stage->in == NULL) {
+            const ssize_t length = read(stage->input, stage->input_buffer, sizeof(stage->input_buffer));
+            if (length > 0)
+                vm_set_input(vm, stage->input_buffer, length);
+            else
+                vm_close_input(vm);
+            return SERVE_RUN;
+        }
+        release_input(stage->in, vm);
+        return acquire_input(stage->in, vm) ? SERVE_RUN : SERVE_WAIT;
+
+    case VM_MISMATCH: // cannot happen, no output is expected
+    case VM_OVERFLOW: // cannot happen, overflows are not trapped
+    case VM_BREAK:    // there is no terminal to debug from, run through breakpoints
+        break;
+    }
+    return SERVE_RUN;
+}
+
+static void *run_stage(void *argument) {
+    struct stage *stage = argument;
+    unsigned spins = 0;
+    while (true) {
+        // the ring it may have to wait on, whose changes are counted from before it is looked at
+        struct ring *ring = stage->status == VM_INPUT ? stage->in : stage->out;
+        const unsigned changes = ring != NULL ? atomic_load(&ring->changes) : 0;
+        const enum serve serve = serve_stage(stage);
+        if (serve == SERVE_END)
+            break;
+        if (serve == SERVE_WAIT) {
+            backoff(ring, changes, &spins);
+        } else {
+            spins = 0;
+            stage->status = vm_run(stage->vm);
+        }
+    }
+    return NULL;
+}
+
+// Connects the vms through rings. Every stage starts out asking for somewhere to write its output to.
+static struct stage *create_stages(struct vm *vms, size_t count, int input, FILE *output, struct ring **rings) {
+    struct stage *stages = calloc(count, sizeof(struct stage));
+    *rings = count > 1 ? calloc(count - 1, sizeof(struct ring)) : NULL;
+    if (stages == NULL || (count > 1 && *rings == NULL)) {
+        free(stages);
+        free(*rings);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++) {
+        stages[i].vm = vms + i;
+        stages[i].status = VM_OUTPUT;
+        stages[i].in = i > 0 ? *rings + i - 1 : NULL;
+        stages[i].out = i + 1 < count ? *rings + i : NULL;
+        stages[i].input = input;
+        stages[i].output = output;
+        if (stages[i].out == NULL)
+            vm_set_output(vms + i, stages[i].output_buffer, sizeof(stages[i].output_buffer));
+    }
+    return stages;
+}
+
+bool run_pipeline_vms(struct vm *vms, enum vm_status *statuses, size_t count, int input, FILE *output) {
+    struct ring *rings;
+    struct stage *stages = create_stages(vms, count, input, output, &rings);
+    if (stages == NULL)
+        return false;
+
+    size_t started = 0;
+    for (; started < count; started++) {
+        if (pthread_create(&stages[started].thread, NULL, run_stage, stages + started) != 0)
+            break;
+    }
+    if (started < count && started > 0) {
+        // let the stages that did start wind down
+        atomic_store(&rings[started - 1].abandoned, true);
+        ring_changed(rings + started - 1);
+    }
+    for (size_t i = 0; i < started; i++) {
+        pthread_join(stages[i].thread, NULL);
+        statuses[i] = stages[i].status;
+    }
+
+    free(stages);
+    free(rings);
+    return started == count;
+}
+
+// Serves the stages that wait for another one until none of them can go on, and wakes those that can run again.
+static bool serve_waiting(struct scheduler *scheduler, struct stage *stages, size_t count) {
+    bool served = true;
+    while (served) {
+        served = false;
+        for (size_t i = 0; i < count; i++) {
+            if (!stages[i].waiting)
+                continue;
+            const enum serve serve = serve_stage(stages + i);
+            if (serve == SERVE_WAIT)
+                continue;
+            stages[i].waiting = false;
+            served = true;
+            if (serve == SERVE_RUN && !scheduler_wake(scheduler, stages[i].task))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool run_pipeline_scheduled(struct vm *vms, enum vm_status *statuses, size_t count, int input, FILE *output,
+                            unsigned long quantum) {
+    struct ring *rings;
+    struct stage *stages = create_stages(vms, count, input, output, &rings);
+    if (stages == NULL)
+        return false;
+
+    struct scheduler scheduler;
+    scheduler_init(&scheduler, quantum);
+    bool success = true;
+    for (size_t i = 0; success && i < count; i++) {
+        // nothing has been written yet, so there is room for the output of every stage
+        serve_stage(stages + i);
+        stages[i].task = scheduler_add(&scheduler, vms + i, 1, stages + i);
+        success = stages[i].task != NULL;
+    }
+    struct task *task;
+    while (success && (task = scheduler_next(&scheduler)) != NULL) {
+        struct stage *stage = task->context;
+        stage->status = task->status;
+        // it is served first, as that is when it gives back what it read and hands on what it wrote
+        const enum serve serve = serve_stage(stage);
+        stage->waiting = serve == SERVE_WAIT;
+        success = (serve != SERVE_RUN || scheduler_wake(&scheduler, task)) && serve_waiting(&scheduler, stages, count);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        statuses[i] = stages[i].status;
+        if (stages[i].task != NULL)
+            scheduler_remove(&scheduler, stages[i].task);
+    }
+    scheduler_free(&scheduler);
+    free(stages);
+    free(rings);
+    return success;
+}
+
+bool run_pipeline(const struct program *programs, size_t count, unsigned long quantum) {
+    struct vm *vms = calloc(count, sizeof(struct vm));
+    enum vm_status *statuses = calloc(count, sizeof(enum vm_status));
+    size_t initialized = 0;
+    while (vms != NULL && statuses != NULL && initialized < count && vm_init(vms + initialized, programs + initialized))
+        initialized++;
+    bool success = initialized == count;
+    if (!success) {
+        perror("Error allocating memory");
+    } else if (quantum > 0 ? !run_pipeline_scheduled(vms, statuses, count, STDIN_FILENO, stdout, quantum)
+                           : !run_pipeline_vms(vms, statuses, count, STDIN_FILENO, stdout)) {
+        perror("Error starting pipeline");
+        success = false;
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            if (statuses[i] == VM_DIVIDE_BY_ZERO) {
+                fputs("Division by zero\n", stderr);
+                success = false;
+            }
+        }
+    }
+    for (size_t i = 0; i < initialized; i++)
+        vm_free(vms + i);
+    free(vms);
+    free(statuses);
+    return success;
+}
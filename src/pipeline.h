@@ -0,0 +1,23 @@
+#ifndef HEXAGONY_PIPELINE_H
+#define HEXAGONY_PIPELINE_H
+
+#include <stdio.h>
+
+#include "vm.h"
+
+// Runs each program on its own thread with the output of each feeding the input of the next, like a shell pipeline.
+// The first program reads stdin and the last writes stdout. With a quantum other than 0, the programs all run on this
+// thread instead, taking turns of that many steps. Returns false if the stages could not be started or a program
+// divided by zero.
+bool run_pipeline(const struct program *programs, size_t count, unsigned long quantum);
+// Runs vms the caller has set up as the stages of a pipeline, the first reading the file descriptor input and the last
+// writing output. A stage ends when its vm halts, divides by zero or reaches its step limit, or with VM_OUTPUT when
+// the next stage has ended, and the status it ended with is stored in statuses. The vms are left in their final state
+// for the caller to free. Returns false if the stages could not be started.
+bool run_pipeline_vms(struct vm *vms, enum vm_status *statuses, size_t count, int input, FILE *output);
+// Like run_pipeline_vms(), but runs the vms on this thread through a scheduler with the quantum. A stage that waits for
+// another one is parked until it is served. Returns false if memory ran out.
+bool run_pipeline_scheduled(struct vm *vms, enum vm_status *statuses, size_t count, int input, FILE *output,
+                            unsigned long quantum);
+
+#endif
@@ -0,0 +1,342 @@
+// The hexagony extension module for CPython: programs are compiled once and run in the calling process. Input is
+// read in place through the buffer protocol and output is written straight into the bytes object that is returned.
+// The GIL is released while a vm runs, so threads run programs in parallel.
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <limits.h>
+#include <stdbool.h>
+
+#include "vm.h"
+
+#define OUTPUT_CAPACITY 4096 // initial size of an output buffer, doubled whenever it fills
+
+struct program_object {
+    PyObject_HEAD
+    struct program program;
+};
+
+struct vm_object {
+    PyObject_HEAD
+    struct program_object *program; // kept alive for the cells the vm points to
+    struct vm vm;
+    Py_buffer input;  // held for the life of the vm, which reads it in place
+    PyObject *output; // bytes object the vm writes into, NULL until the next run after read_output()
+    bool halted;
+    bool running;     // the vm is running in some thread without the GIL
+};
+
+static PyTypeObject program_type;
+static PyObject *step_limit_error;
+
+// raises the Python exception for the division by zero a vm stopped at
+static void raise_division_error(struct vm *vm) {
+    const struct IP *IP = vm->IPs + vm->IP_index;
+    const char instruction = vm->program->cells[axial_to_index(IP->p, IP->q, vm->program->rings)].value;
+    PyErr_Format(PyExc_ZeroDivisionError, "'%c' divides by zero", instruction);
+}
+
+// Runs a vm without the GIL until it halts or has executed target steps, and returns whether it halted, or -1 with
+// an exception set. The step limit is checked where straight line runs end, unless force_debug is set. The vm
+// writes into *output, a bytes object nothing else refers to, which is created here if it is NULL and grows whenever
+// it fills.
+static int execute(struct vm *vm, PyObject **output, unsigned long target) {
+    if (*output == NULL) {
+        *output = PyBytes_FromStringAndSize(NULL, OUTPUT_CAPACITY);
+        if (*output == NULL)
+            return -1;
+        vm_set_output(vm, PyBytes_AS_STRING(*output), OUTPUT_CAPACITY);
+    }
+    vm->step_limit = target;
+    PyThreadState *thread = PyEval_SaveThread();
+    enum vm_status status;
+    while (true) {
+        status = vm_run(vm);
+        if (status == VM_DIVIDE_BY_ZERO) {
+            PyEval_RestoreThread(thread);
+            raise_division_error(vm);
+            return -1;
+        }
+        if (status == VM_HALTED || status == VM_YIELD || (status == VM_BREAK && vm->steps >= target))
+            break;
+        if (status == VM_OUTPUT) {
+            // growing a bytes object needs the GIL
+            PyEval_RestoreThread(thread);
+            const size_t length = vm->output_length;
+            if (_PyBytes_Resize(output, 2 * vm->output_capacity) != 0)
+                return -1;
+            vm_set_output(vm, PyBytes_AS_STRING(*output), PyBytes_GET_SIZE(*output));
+            vm->output_length = length;
+            thread = PyEval_SaveThread();
+        }
+        // a breakpoint is run through, VM_INPUT, VM_MISMATCH and VM_OVERFLOW cannot happen with the input closed,
+        // nothing expected and overflows wrapped around
+    }
+    PyEval_RestoreThread(thread);
+    return status == VM_HALTED;
+}
+
+// hands over the output written so far, shrunk to its length
+static PyObject *take_output(struct vm *vm, PyObject **output) {
+    if (*output == NULL || vm->output_length == 0)
+        return PyBytes_FromStringAndSize(NULL, 0);
+    PyObject *taken = *output;
+    *output = NULL;
+    if (_PyBytes_Resize(&taken, vm->output_length) != 0)
+        taken = NULL;
+    vm->output_length = 0;
+    return taken;
+}
+
+// parses max_steps, None being no limit
+static bool parse_steps(PyObject *argument, unsigned long *steps) {
+    if (argument == Py_None) {
+        *steps = ULONG_MAX;
+        return true;
+    }
+    *steps = PyLong_AsUnsignedLong(argument);
+    return !PyErr_Occurred();
+}
+
+static void program_dealloc(struct program_object *self) {
+    free_program(&self->program);
+    Py_TYPE(self)->tp_free(self);
+}
+
+static PyObject *program_rings(struct program_object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromLong(self->program.rings);
+}
+
+static PyObject *program_size(struct program_object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromSize_t(self->program.size);
+}
+
+static PyGetSetDef program_getset[] = {
+    {"rings", (getter)program_rings, NULL, "number of rings of the hexagon the source is laid out on", NULL},
+    {"size", (getter)program_size, NULL, "number of cells of the hexagon", NULL},
+    {NULL},
+};
+
+static PyTypeObject program_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "hexagony.Program",
+    .tp_doc = "A program laid out on its hexagon, made by compile(). It is immutable and can be run by any number of "
+              "threads at once.",
+    .tp_basicsize = sizeof(struct program_object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_dealloc = (destructor)program_dealloc,
+    .tp_getset = program_getset,
+};
+
+static PyObject *vm_new(PyTypeObject *type, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"program", "input", NULL};
+    PyObject *program;
+    Py_buffer input = {0};
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|y*:VM", keywords, &program_type, &program, &input))
+        return NULL;
+    struct vm_object *self = (struct vm_object *)type->tp_alloc(type, 0);
+    if (self == NULL) {
+        PyBuffer_Release(&input);
+        return NULL;
+    }
+    self->input = input;
+    if (!vm_init(&self->vm, &((struct program_object *)program)->program)) {
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    Py_INCREF(program);
+    self->program = (struct program_object *)program;
+    vm_set_input(&self->vm, self->input.buf, self->input.len);
+    vm_close_input(&self->vm);
+    return (PyObject *)self;
+}
+
+static void vm_dealloc(struct vm_object *self) {
+    vm_free(&self->vm);
+    PyBuffer_Release(&self->input);
+    Py_XDECREF(self->output);
+    Py_XDECREF(self->program);
+    Py_TYPE(self)->tp_free(self);
+}
+
+// runs a vm object up to target steps, executing instruction by instruction if exact is set
+static PyObject *run_vm_object(struct vm_object *self, unsigned long target, bool exact) {
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "the VM is already running in another thread");
+        return NULL;
+    }
+    if (self->halted)
+        Py_RETURN_TRUE;
+    self->running = true;
+    self->vm.force_debug = exact;
+    const int halted = execute(&self->vm, &self->output, target);
+    self->vm.force_debug = false;
+    self->running = false;
+    if (halted < 0)
+        return NULL;
+    self->halted = halted;
+    return PyBool_FromLong(halted);
+}
+
+static PyObject *vm_step(struct vm_object *self, PyObject *args) {
+    unsigned long count = 1;
+    if (!PyArg_ParseTuple(args, "|k:step", &count))
+        return NULL;
+    const unsigned long steps = self->vm.steps;
+    return run_vm_object(self, count > ULONG_MAX - steps ? ULONG_MAX : steps + count, true);
+}
+
+static PyObject *vm_run_method(struct vm_object *self, PyObject *args, PyObject *kwargs) {
+    static char *keywords[] = {"max_steps", NULL};
+    PyObject *max_steps_argument = Py_None;
+    unsigned long max_steps;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|O:run", keywords, &max_steps_argument)
+        || !parse_steps(max_steps_argument, &max_steps))
+        return NULL;
+    const unsigned long steps = self->vm.steps;
+    return run_vm_object(self, max_steps > ULONG_MAX - steps ? ULONG_MAX : steps + max_steps, false);
+}
+
+static PyObject *vm_read_output(struct vm_object *self, PyObject *unused) {
+    (void)unused;
+    if (self->running) {
+        PyErr_SetString(PyExc_RuntimeError, "the VM is running in another thread");
+        return NULL;
+    }
+    return take_output(&self->vm, &self->output);
+}
+
+static PyObject *vm_steps(struct vm_object *self, void *closure) {
+    (void)closure;
+    return PyLong_FromUnsignedLong(self->vm.steps);
+}
+
+static PyObject *vm_halted(struct vm_object *self, void *closure) {
+    (void)closure;
+    return PyBool_FromLong(self->halted);
+}
+
+static PyMethodDef vm_methods[] = {
+    {"step", (PyCFunction)vm_step, METH_VARARGS,
+     "step(count=1)\n--\n\nExecutes count instructions, or fewer if the program halts first, and returns whether it "
+     "has halted."},
+    {"run", (PyCFunction)(void (*)(void))vm_run_method, METH_VARARGS | METH_KEYWORDS,
+     "run(max_steps=None)\n--\n\nRuns until the program halts and returns True, or returns False once it has "
+     "executed at least max_steps more instructions. The limit is checked where the IP turns, wraps around or "
+     "changes, so a run can go a little past it."},
+    {"read_output", (PyCFunction)vm_read_output, METH_NOARGS,
+     "read_output()\n--\n\nReturns the output written since the last call. The bytes object is the buffer the "
+     "program wrote into."},
+    {NULL},
+};
+
+static PyGetSetDef vm_getset[] = {
+    {"steps", (getter)vm_steps, NULL, "number of instructions executed", NULL},
+    {"halted", (getter)vm_halted, NULL, "whether the program has executed '@'", NULL},
+    {NULL},
+};
+
+static PyTypeObject vm_type = {
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "hexagony.VM",
+    .tp_doc = "VM(program, input=b'')\n--\n\nA run of a program that can be stepped through. The input is any "
+              "object with the buffer protocol and is read in place, followed by EOF. A VM is used by one thread at "
+              "a time, but any number of them run in parallel.",
+    .tp_basicsize = sizeof(struct vm_object),
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_new = vm_new,
+    .tp_dealloc = (destructor)vm_dealloc,
+    .tp_methods = vm_methods,
+    .tp_getset = vm_getset,
+};
+
+static PyObject *hexagony_compile(PyObject *module, PyObject *source) {
+    (void)module;
+    Py_buffer buffer;
+    if (PyUnicode_Check(source)) {
+        Py_ssize_t length;
+        const char *utf8 = PyUnicode_AsUTF8AndSize(source, &length);
+        if (utf8 == NULL)
+            return NULL;
+        buffer = (Py_buffer){.buf = (void *)utf8, .len = length};
+    } else if (PyObject_GetBuffer(source, &buffer, PyBUF_SIMPLE) != 0) {
+        return NULL;
+    }
+    struct program_object *self = PyObject_New(struct program_object, &program_type);
+    const bool parsed = self != NULL && parse_program(&self->program, buffer.buf, buffer.len);
+    if (buffer.obj != NULL)
+        PyBuffer_Release(&buffer);
+    if (self != NULL && !parsed) {
+        self->program.cells = NULL;
+        Py_DECREF(self);
+        return PyErr_NoMemory();
+    }
+    return (PyObject *)self;
+}
+
+static PyObject *hexagony_run(PyObject *module, PyObject *args, PyObject *kwargs) {
+    (void)module;
+    static char *keywords[] = {"program", "input", "max_steps", NULL};
+    PyObject *program, *max_steps_argument = Py_None;
+    Py_buffer input = {0};
+    unsigned long max_steps;
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O!|y*O:run", keywords, &program_type, &program, &input,
+                                     &max_steps_argument))
+        return NULL;
+    struct vm vm;
+    PyObject *output = NULL, *result = NULL;
+    if (!parse_steps(max_steps_argument, &max_steps)) {
+        // the error is set
+    } else if (!vm_init(&vm, &((struct program_object *)program)->program)) {
+        PyErr_NoMemory();
+    } else {
+        vm_set_input(&vm, input.buf, input.len);
+        vm_close_input(&vm);
+        const int halted = execute(&vm, &output, max_steps);
+        if (halted > 0)
+            result = take_output(&vm, &output);
+        else if (halted == 0)
+            PyErr_Format(step_limit_error, "the program did not halt within %lu steps", max_steps);
+        vm_free(&vm);
+    }
+    Py_XDECREF(output);
+    PyBuffer_Release(&input);
+    return result;
+}
+
+static PyMethodDef hexagony_methods[] = {
+    {"compile", hexagony_compile, METH_O,
+     "compile(source)\n--\n\nLays out source code, a str or bytes-like object, on the smallest hexagon that fits it, "
+     "and returns a Program."},
+    {"run", (PyCFunction)(void (*)(void))hexagony_run, METH_VARARGS | METH_KEYWORDS,
+     "run(program, input=b'', max_steps=None)\n--\n\nRuns a program on input, any bytes-like object, followed by EOF "
+     "and returns its output as bytes. Raises StepLimitError if it does not halt within about max_steps steps, "
+     "and ZeroDivisionError if it divides by zero."},
+    {NULL},
+};
+
+static struct PyModuleDef hexagony_module = {
+    PyModuleDef_HEAD_INIT,
+    .m_name = "hexagony",
+    .m_doc = "Runs Hexagony programs in the calling process, without holding the GIL.",
+    .m_size = -1,
+    .m_methods = hexagony_methods,
+};
+
+PyMODINIT_FUNC PyInit_hexagony(void) {
+    if (PyType_Ready(&program_type) < 0 || PyType_Ready(&vm_type) < 0)
+        return NULL;
+    PyObject *module = PyModule_Create(&hexagony_module);
+    if (module == NULL)
+        return NULL;
+    step_limit_error = PyErr_NewException("hexagony.StepLimitError", PyExc_RuntimeError, NULL);
+    if (step_limit_error == NULL || PyModule_AddObjectRef(module, "StepLimitError", step_limit_error) < 0
+        || PyModule_AddObjectRef(module, "Program", (PyObject *)&program_type) < 0
+        || PyModule_AddObjectRef(module, "VM", (PyObject *)&vm_type) < 0) {
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
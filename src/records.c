@@ -0,0 +1,228 @@
+#include "records.h"
+#include "simt.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK_SIZE (1 << 16) // bytes read from stdin at a time
+#define LOCKSTEP_RECORDS 4096 // records split off and run in lockstep at a time
+
+// runs one record to completion
+static bool run_record(struct vm *vm, const char *record, size_t length, char *output, size_t capacity) {
+    if (!vm_reset(vm)) {
+        perror("Error allocating memory");
+        return false;
+    }
+    vm_set_input(vm, record, length);
+    vm_close_input(vm);
+    vm_set_output(vm, output, capacity);
+    while (true) {
+        switch (vm_run(vm)) {
+        case VM_HALTED:
+            fwrite(vm->output, 1, vm->output_length, stdout);
+            return true;
+
+        case VM_OUTPUT:
+            fwrite(vm->output, 1, vm->output_length, stdout);
+            vm->output_length = 0;
+            break;
+
+        case VM_DIVIDE_BY_ZERO: // ends the run, like it ends a single run
+            fwrite(vm->output, 1, vm->output_length, stdout);
+            fflush(stdout);
+            fputs("Division by zero\n", stderr);
+            return false;
+
+        case VM_INPUT:    // cannot happen, the input is closed
+        case VM_MISMATCH: // cannot happen, no output is expected
+        case VM_OVERFLOW: // cannot happen, overflows are not trapped
+        case VM_BREAK:    // there is no terminal to debug from, run through breakpoints
+        case VM_YIELD:
+            break;
+        }
+    }
+}
+
+// a record that continues past the end of the chunk it started in
+struct carry {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+static bool append_carry(struct carry *carry, const char *data, size_t length) {
+    if (carry->length + length > carry->capacity) {
+        const size_t capacity = 2 * (carry->length + length);
+        char *grown = realloc(carry->data, capacity);
+        if (grown == NULL) {
+            perror("Error allocating memory");
+            return false;
+        }
+        carry->data = grown;
+        carry->capacity = capacity;
+    }
+    memcpy(carry->data + carry->length, data, length);
+    carry->length += length;
+    return true;
+}
+
+bool read_records(char delimiter, bool (*handle)(void *context, const char *record, size_t length), void *context) {
+    char *chunk = malloc(CHUNK_SIZE);
+    struct carry carry = {0};
+    bool success = chunk != NULL;
+    if (!success)
+        perror("Error allocating memory");
+
+    ssize_t length = 0;
+    while (success && (length = read(STDIN_FILENO, chunk, CHUNK_SIZE)) > 0) {
+        const char *record = chunk;
+        const char *end = chunk + length;
+        const char *delimiter_position;
+        while (success && (delimiter_position = memchr(record, delimiter, end - record)) != NULL) {
+            if (carry.length > 0) { // finish the record carried over from the previous chunk
+                success = append_carry(&carry, record, delimiter_position - record)
+                          && handle(context, carry.data, carry.length);
+                carry.length = 0;
+            } else {
+                success = handle(context, record, delimiter_position - record);
+            }
+            record = delimiter_position + 1;
+        }
+        if (success && record < end)
+            success = append_carry(&carry, record, end - record);
+    }
+    if (success && length < 0) {
+        perror("Error reading input");
+        success = false;
+    }
+    if (success && carry.length > 0) // the last record has no delimiter after it
+        success = handle(context, carry.data, carry.length);
+
+    free(carry.data);
+    free(chunk);
+    return success;
+}
+
+struct per_record {
+    struct vm vm;
+    char output[BUFSIZ];
+    char delimiter;
+    bool delimit_output;
+};
+
+static bool handle_record(void *context, const char *record, size_t length) {
+    struct per_record *per_record = context;
+    if (!run_record(&per_record->vm, record, length, per_record->output, sizeof(per_record->output)))
+        return false;
+    if (per_record->delimit_output)
+        putchar(per_record->delimiter);
+    return true;
+}
+
+bool run_per_record(const struct program *program, char delimiter, bool delimit_output) {
+    struct per_record *per_record = malloc(sizeof(struct per_record));
+    if (per_record == NULL || !vm_init(&per_record->vm, program)) {
+        perror("Error allocating memory");
+        free(per_record);
+        return false;
+    }
+    per_record->delimiter = delimiter;
+    per_record->delimit_output = delimit_output;
+    const bool success = read_records(delimiter, handle_record, per_record);
+    vm_free(&per_record->vm);
+    free(per_record);
+    return success;
+}
+
+// Writes the results of a lockstep run in order and frees them. Returns false if a record divided by zero, which
+// ends the run after its output like it does for run_per_record().
+static bool write_lanes(struct simt_lane *lanes, size_t count, char delimiter, bool delimit_output) {
+    bool divided = false;
+    for (size_t i = 0; i < count; i++) {
+        if (!divided) {
+            fwrite(lanes[i].output, 1, lanes[i].output_length, stdout);
+            divided = lanes[i].status == VM_DIVIDE_BY_ZERO;
+            if (delimit_output && !divided)
+                putchar(delimiter);
+        }
+        free(lanes[i].output);
+    }
+    if (divided) {
+        fflush(stdout);
+        fputs("Division by zero\n", stderr);
+    }
+    return !divided;
+}
+
+static size_t count_delimiters(const char *data, size_t length, char delimiter) {
+    size_t count = 0;
+    for (const char *found; (found = memchr(data, delimiter, length)) != NULL; count++) {
+        length -= found + 1 - data;
+        data = found + 1;
+    }
+    return count;
+}
+
+bool run_per_record_lockstep(const struct program *program, char delimiter, bool delimit_output) {
+    struct simt_lane *lanes = malloc(LOCKSTEP_RECORDS * sizeof(struct simt_lane));
+    struct carry input = {0};
+    char *chunk = malloc(CHUNK_SIZE);
+    bool success = lanes != NULL && chunk != NULL;
+    if (!success)
+        perror("Error allocating memory");
+
+    // Records keep pointing into the input while they run, so a batch is read in full before it is split. The
+    // partial record at the end of a batch is moved to the start of the input and finished by the next one.
+    size_t delimiters = 0; // in the input buffered so far
+    bool ended = false;
+    while (success && !(ended && input.length == 0)) {
+        while (success && !ended && delimiters < LOCKSTEP_RECORDS) {
+            const ssize_t length = read(STDIN_FILENO, chunk, CHUNK_SIZE);
+            if (length < 0) {
+                perror("Error reading input");
+                success = false;
+            } else if (length == 0) {
+                ended = true;
+            } else {
+                success = append_carry(&input, chunk, length);
+                delimiters += count_delimiters(chunk, length, delimiter);
+            }
+        }
+
+        const char *record = input.data;
+        const char *end = input.data + input.length;
+        size_t count = 0;
+        while (success && count < LOCKSTEP_RECORDS && record < end) {
+            const char *delimiter_position = memchr(record, delimiter, end - record);
+            if (delimiter_position == NULL) {
+                if (ended) { // the last record has no delimiter after it
+                    lanes[count++] = (struct simt_lane){.input = record, .input_length = end - record};
+                    record = end;
+                }
+                break;
+            }
+            lanes[count++] = (struct simt_lane){.input = record, .input_length = delimiter_position - record};
+            record = delimiter_position + 1;
+            delimiters--;
+        }
+        if (success && count > 0) {
+            success = simt_run(program, lanes, count, ULONG_MAX);
+            if (success)
+                success = write_lanes(lanes, count, delimiter, delimit_output);
+            else
+                perror("Error allocating memory");
+        }
+        if (success) {
+            input.length = end - record;
+            memmove(input.data, record, input.length);
+        }
+    }
+
+    free(chunk);
+    free(input.data);
+    free(lanes);
+    return success;
+}
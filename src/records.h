@@ -0,0 +1,16 @@
+#ifndef HEXAGONY_RECORDS_H
+#define HEXAGONY_RECORDS_H
+
+#include "vm.h"
+
+// Splits stdin on the delimiter and calls handle for each record. Records are only valid during the call. Stops and
+// returns false as soon as handle returns false.
+bool read_records(char delimiter, bool (*handle)(void *context, const char *record, size_t length), void *context);
+
+// Splits stdin on the delimiter and runs the program once on each record, with a freshly reset vm every time. The
+// outputs are written to stdout in order, each followed by the delimiter if delimit_output is set.
+bool run_per_record(const struct program *program, char delimiter, bool delimit_output);
+// like run_per_record(), but runs batches of records in lockstep through the simt engine
+bool run_per_record_lockstep(const struct program *program, char delimiter, bool delimit_output);
+
+#endif
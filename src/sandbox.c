@@ -0,0 +1,115 @@
+#include "sandbox.h"
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+
+#if defined(__x86_64__)
+#define SANDBOX_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+#define SANDBOX_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+#define SYSCALL_ARGUMENT(n) (offsetof(struct seccomp_data, args) + (n) * sizeof(__u64))
+#define MAX_FILTER 64
+
+// buffers for stdio, so that it does not have to look at the streams with fstat and ioctl once sandboxed
+static char stdin_buffer[BUFSIZ];
+static char stdout_buffer[BUFSIZ];
+
+struct filter {
+    struct sock_filter code[MAX_FILTER];
+    unsigned short length;
+};
+
+static void emit(struct filter *filter, struct sock_filter instruction) {
+    filter->code[filter->length++] = instruction;
+}
+
+// allows a system call outright
+static void allow(struct filter *filter, long number) {
+    emit(filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, number, 0, 1));
+    emit(filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+}
+
+// allows a system call only on one of two file descriptors
+static void allow_on(struct filter *filter, long number, int fd, int other_fd) {
+    emit(filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, number, 0, 5));
+    emit(filter, (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SYSCALL_ARGUMENT(0)));
+    emit(filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, fd, 1, 0));
+    emit(filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, other_fd, 0, 1));
+    emit(filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    emit(filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+}
+
+bool enter_sandbox(unsigned permissions) {
+#ifndef SANDBOX_ARCH
+    (void)permissions;
+    errno = ENOSYS;
+    return false;
+#else
+    if (permissions & SANDBOX_STDIO) {
+        setvbuf(stdin, stdin_buffer, _IOFBF, sizeof(stdin_buffer));
+        setvbuf(stdout, stdout_buffer, _IOFBF, sizeof(stdout_buffer));
+    }
+
+    struct filter filter = {.length = 0};
+    // system calls are only understood for the architecture the filter was written for
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch)));
+    emit(&filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SANDBOX_ARCH, 1, 0));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr)));
+#ifdef __x86_64__
+    // x32 system calls share the architecture but use their own numbers
+    emit(&filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 0x40000000, 0, 1));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+#endif
+
+    if (permissions & SANDBOX_STDIO) {
+        allow_on(&filter, SYS_read, 0, 0);
+        allow_on(&filter, SYS_write, 1, 2);
+    }
+    if (permissions & SANDBOX_FUTEX)
+        allow(&filter, SYS_futex);
+
+    // memory growth, without ever mapping executable pages
+    emit(&filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, SYS_mmap, 0, 4));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SYSCALL_ARGUMENT(2)));
+    emit(&filter, (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, PROT_EXEC, 0, 1));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW));
+    allow(&filter, SYS_munmap);
+    allow(&filter, SYS_mremap);
+    allow(&filter, SYS_madvise);
+    allow(&filter, SYS_brk);
+
+    allow(&filter, SYS_exit);
+    allow(&filter, SYS_exit_group);
+    allow(&filter, SYS_rt_sigreturn);
+    emit(&filter, (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_KILL_PROCESS));
+
+    const struct sock_fprog program = {.len = filter.length, .filter = filter.code};
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+        return false;
+    return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &program) == 0;
+#endif
+}
+
+#else
+
+bool enter_sandbox(unsigned permissions) {
+    (void)permissions;
+    errno = ENOSYS;
+    return false;
+}
+
+#endif
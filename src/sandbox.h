@@ -0,0 +1,16 @@
+#ifndef HEXAGONY_SANDBOX_H
+#define HEXAGONY_SANDBOX_H
+
+#include <stdbool.h>
+
+enum sandbox_permission {
+    SANDBOX_STDIO = 1 << 0, // read stdin, write stdout and stderr
+    SANDBOX_FUTEX = 1 << 1, // wait on semaphores shared with other processes
+};
+
+// Installs a seccomp filter that kills the process on any system call other than growing memory, exiting and the
+// permitted ones. The process can never leave the sandbox again. Returns false with errno set if it could not be
+// entered, for example on systems without seccomp.
+bool enter_sandbox(unsigned permissions);
+
+#endif
@@ -0,0 +1,96 @@
+#include "scheduler.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+void scheduler_init(struct scheduler *scheduler, unsigned long quantum) {
+    *scheduler = (struct scheduler){.quantum = quantum};
+}
+
+void scheduler_free(struct scheduler *scheduler) {
+    free(scheduler->ready);
+    scheduler->ready = NULL;
+    scheduler->capacity = 0;
+    scheduler->count = 0;
+}
+
+static bool enqueue(struct scheduler *scheduler, struct task *task) {
+    if (scheduler->count == scheduler->capacity) {
+        size_t capacity = scheduler->capacity ? scheduler->capacity * 2 : 16;
+        struct task **ready = malloc(capacity * sizeof(struct task *));
+        if (ready == NULL)
+            return false;
+        // unwrap the queue into the start of the new buffer
+        for (size_t i = 0; i < scheduler->count; i++)
+            ready[i] = scheduler->ready[(scheduler->head + i) % scheduler->capacity];
+        free(scheduler->ready);
+        scheduler->ready = ready;
+        scheduler->capacity = capacity;
+        scheduler->head = 0;
+    }
+    scheduler->ready[(scheduler->head + scheduler->count) % scheduler->capacity] = task;
+    scheduler->count++;
+    task->queued = true;
+    return true;
+}
+
+static struct task *dequeue(struct scheduler *scheduler) {
+    struct task *task = scheduler->ready[scheduler->head];
+    scheduler->head = (scheduler->head + 1) % scheduler->capacity;
+    scheduler->count--;
+    task->queued = false;
+    return task;
+}
+
+struct task *scheduler_add(struct scheduler *scheduler, struct vm *vm, unsigned priority, void *context) {
+    struct task *task = malloc(sizeof(struct task));
+    if (task == NULL)
+        return NULL;
+    *task = (struct task){
+        .vm = vm,
+        .priority = priority > 0 ? priority : 1,
+        .step_limit = vm->step_limit,
+        .context = context,
+        .status = VM_YIELD,
+    };
+    if (!enqueue(scheduler, task)) {
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+bool scheduler_wake(struct scheduler *scheduler, struct task *task) {
+    if (task->queued || task->status == VM_HALTED || task->status == VM_DIVIDE_BY_ZERO)
+        return true;
+    task->status = VM_YIELD;
+    return enqueue(scheduler, task);
+}
+
+struct task *scheduler_next(struct scheduler *scheduler) {
+    while (scheduler->count > 0) {
+        struct task *task = dequeue(scheduler);
+        struct vm *vm = task->vm;
+        const unsigned long turn = scheduler->quantum * task->priority;
+        const unsigned long end = vm->steps > ULONG_MAX - turn ? ULONG_MAX : vm->steps + turn;
+        vm->step_limit = end < task->step_limit ? end : task->step_limit;
+        task->status = vm_run(vm);
+        if (task->status != VM_YIELD || vm->steps >= task->step_limit)
+            return task;
+        enqueue(scheduler, task); // cannot fail, the slot it was dequeued from is free
+    }
+    return NULL;
+}
+
+void scheduler_remove(struct scheduler *scheduler, struct task *task) {
+    if (task->queued) {
+        size_t i = 0;
+        while (scheduler->ready[(scheduler->head + i) % scheduler->capacity] != task)
+            i++;
+        for (; i + 1 < scheduler->count; i++)
+            scheduler->ready[(scheduler->head + i) % scheduler->capacity] =
+                scheduler->ready[(scheduler->head + i + 1) % scheduler->capacity];
+        scheduler->count--;
+    }
+    free(task);
+}
@@ -0,0 +1,38 @@
+#ifndef HEXAGONY_SCHEDULER_H
+#define HEXAGONY_SCHEDULER_H
+
+#include "vm.h"
+
+// a vm sharing the thread with other tasks of the same scheduler
+struct task {
+    struct vm *vm;
+    unsigned priority;        // steps per turn are the quantum multiplied by the priority
+    unsigned long step_limit; // the step limit of the vm when it was added, which ends the task
+    void *context;     // owned by the host
+    enum vm_status status;
+    bool queued;
+};
+
+// Runs many vms on one thread. Tasks take turns in round robin order, each running for its share of steps before
+// yielding to the next. Tasks that need the host (input, output, breakpoints or halting) are handed back from
+// scheduler_next() and stay parked until the host calls scheduler_wake() on them.
+struct scheduler {
+    unsigned long quantum;
+    struct task **ready; // circular queue of runnable tasks
+    size_t capacity;
+    size_t head;
+    size_t count;
+};
+
+void scheduler_init(struct scheduler *scheduler, unsigned long quantum);
+void scheduler_free(struct scheduler *scheduler);
+struct task *scheduler_add(struct scheduler *scheduler, struct vm *vm, unsigned priority, void *context);
+// makes a parked task runnable again
+bool scheduler_wake(struct scheduler *scheduler, struct task *task);
+// Runs turns until a task needs the host or reaches its step limit and returns it, or returns NULL once no task is
+// runnable. The task's status tells the host why it stopped, VM_YIELD for the step limit. Halted tasks are not freed,
+// the host destroys them with scheduler_remove().
+struct task *scheduler_next(struct scheduler *scheduler);
+void scheduler_remove(struct scheduler *scheduler, struct task *task);
+
+#endif
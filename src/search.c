@@ -0,0 +1,383 @@
+#include "search.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Run states at trace ends, for finding runs that can never halt. The state is saved at every power of two trace
+// ends and compared against at the ones in between (Brent's cycle detection), so a run that comes back to a state
+// it has been in is caught within twice the length of its loop.
+struct snapshot {
+    struct IP IPs[6];
+    int IP_index;
+    struct memory_pointer MP;
+    size_t input_position;
+    size_t expect_position;
+    struct memory_cell *memory;
+    long memory_rings;
+    size_t capacity; // cells allocated for memory
+    unsigned long trace_ends;
+    unsigned long next_save;
+};
+
+struct shared {
+    const struct search *search;
+    size_t alphabet_size;
+    atomic_int busy; // workers that have an item, the search is over once this drops to zero
+    atomic_bool stop;
+    pthread_mutex_t found_lock;
+    unsigned long solutions;
+    bool failed;
+};
+
+// A worker's item is a block of candidates, written as digits indexing the alphabet, one per free cell, with the
+// first free cell the most significant. digits[0, depth) are fixed, digits[depth] runs up to but excluding hi, and
+// the digits after it take every value. Thieves split off the upper part of the range of digits[depth]. The owner
+// only changes depth, hi and digits up to depth while holding the lock.
+struct worker {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    struct shared *shared;
+    struct program program; // the template with the current candidate filled in
+    struct vm vm;
+    char *output;
+    int *digits;
+    size_t depth;
+    int hi;
+    bool working;
+    ssize_t stolen_depth; // depth the item was split off at, -1 for the one the search starts with
+    unsigned long candidates;
+    struct snapshot snapshot;
+};
+
+static bool same_ip(const struct IP *a, const struct IP *b) {
+    return a->p == b->p && a->q == b->q && a->direction == b->direction && a->ignore_next == b->ignore_next;
+}
+
+static size_t memory_size(long rings) {
+    return 3 * rings * (rings - 1) + 1;
+}
+
+static bool same_state(const struct snapshot *snapshot, const struct vm *vm) {
+    if (vm->IP_index != snapshot->IP_index || vm->MP.p != snapshot->MP.p || vm->MP.q != snapshot->MP.q ||
+        vm->MP.axis != snapshot->MP.axis || vm->MP.direction != snapshot->MP.direction ||
+        vm->input_position != snapshot->input_position || vm->expect_position != snapshot->expect_position ||
+        vm->memory_rings != snapshot->memory_rings)
+        return false;
+    for (int i = 0; i < 6; i++) {
+        if (!same_ip(vm->IPs + i, snapshot->IPs + i))
+            return false;
+    }
+    return memcmp(vm->memory, snapshot->memory, memory_size(vm->memory_rings) * sizeof(struct memory_cell)) == 0;
+}
+
+static bool save_state(struct snapshot *snapshot, const struct vm *vm) {
+    const size_t size = memory_size(vm->memory_rings);
+    if (size > snapshot->capacity) {
+        struct memory_cell *memory = realloc(snapshot->memory, size * sizeof(struct memory_cell));
+        if (memory == NULL)
+            return false;
+        snapshot->memory = memory;
+        snapshot->capacity = size;
+    }
+    memcpy(snapshot->IPs, vm->IPs, sizeof(vm->IPs));
+    snapshot->IP_index = vm->IP_index;
+    snapshot->MP = vm->MP;
+    snapshot->input_position = vm->input_position;
+    snapshot->expect_position = vm->expect_position;
+    snapshot->memory_rings = vm->memory_rings;
+    memcpy(snapshot->memory, vm->memory, size * sizeof(struct memory_cell));
+    return true;
+}
+
+// called at every trace end, returns true if the run is in a state it has been in before
+static bool repeated(struct snapshot *snapshot, const struct vm *vm) {
+    if (snapshot->trace_ends > 0 && same_state(snapshot, vm))
+        return true;
+    if (++snapshot->trace_ends == snapshot->next_save) {
+        // without room for the snapshot the run goes on to its step limit
+        if (save_state(snapshot, vm))
+            snapshot->next_save *= 2;
+        else
+            snapshot->trace_ends = 0;
+    }
+    return false;
+}
+
+// Runs the current candidate on one example. Free cells are marked as breakpoints until they are first executed, so
+// afterwards the cells that were not executed still are.
+static bool run_example(struct worker *worker, const struct example *example) {
+    const struct search *search = worker->shared->search;
+    struct vm *vm = &worker->vm;
+    if (!vm_reset(vm)) {
+        worker->shared->failed = true;
+        atomic_store(&worker->shared->stop, true);
+        return false;
+    }
+    vm_set_input(vm, example->input, example->input_length);
+    vm_close_input(vm);
+    // output never gets past the expected output, so this is never too small
+    vm_set_output(vm, worker->output, example->output_length + DECIMAL_LENGTH);
+    vm_set_expected_output(vm, example->output, example->output_length);
+    vm->step_limit = 1; // yield at every trace end
+    worker->snapshot.trace_ends = 0;
+    worker->snapshot.next_save = 1;
+    while (true) {
+        switch (vm_run(vm)) {
+        case VM_HALTED:
+            return vm->expect_position == example->output_length;
+
+        case VM_BREAK: {
+            const struct IP *IP = vm->IPs + vm->IP_index;
+            worker->program.cells[axial_to_index(IP->p, IP->q, worker->program.rings)].debug = false;
+        }   break;
+
+        case VM_YIELD:
+            if (vm->steps >= search->step_limit || repeated(&worker->snapshot, vm))
+                return false;
+            vm->step_limit = vm->steps + 1;
+            break;
+
+        case VM_MISMATCH:
+        case VM_INPUT:  // input is closed
+        case VM_OUTPUT: // see above
+        case VM_OVERFLOW: // not trapped
+        case VM_DIVIDE_BY_ZERO:
+            return false;
+        }
+    }
+}
+
+static bool run_candidate(struct worker *worker) {
+    const struct search *search = worker->shared->search;
+    for (size_t i = 0; i < search->free_count; i++) {
+        struct program_cell *cell = worker->program.cells + search->free_cells[i];
+        cell->value = search->alphabet[worker->digits[i]];
+        cell->debug = true;
+    }
+    worker->candidates++;
+    for (size_t i = 0; i < search->example_count; i++) {
+        if (!run_example(worker, search->examples + i))
+            return false;
+    }
+    return true;
+}
+
+// Moves the split point down while the range of digits[depth] is down to the value being worked on, so that thieves
+// always have the largest remaining block to split. Must be called with the lock held.
+static void descend(struct worker *worker) {
+    const size_t count = worker->shared->search->free_count;
+    while (worker->digits[worker->depth] + 1 >= worker->hi && worker->depth + 1 < count) {
+        worker->depth++;
+        worker->hi = worker->shared->alphabet_size;
+    }
+}
+
+// the last digit whose free cell the current candidate executed, -1 if it executed none
+static ssize_t last_executed(const struct worker *worker) {
+    const struct search *search = worker->shared->search;
+    ssize_t digit = search->free_count - 1;
+    while (digit >= 0 && worker->program.cells[search->free_cells[digit]].debug)
+        digit--;
+    return digit;
+}
+
+// Moves to the next candidate of the item that is not equivalent to the current one. A candidate behaves the same as
+// every other candidate that differs from it only in free cells its runs did not execute, so all candidates that
+// differ only in digits after the last executed one are skipped. Returns false once the item is exhausted.
+static bool advance(struct worker *worker, ssize_t digit) {
+    const ssize_t depth = worker->depth;
+    bool more = digit >= depth;
+    if (more) {
+        memset(worker->digits + digit + 1, 0, (worker->shared->search->free_count - digit - 1) * sizeof(int));
+        while (digit > depth && ++worker->digits[digit] == (int)worker->shared->alphabet_size)
+            worker->digits[digit--] = 0;
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    if (more && digit == depth)
+        more = ++worker->digits[digit] < worker->hi;
+    if (more)
+        descend(worker);
+    else
+        worker->working = false;
+    pthread_mutex_unlock(&worker->lock);
+    return more;
+}
+
+static void report(struct worker *worker) {
+    struct shared *shared = worker->shared;
+    const struct search *search = shared->search;
+    pthread_mutex_lock(&shared->found_lock);
+    if (!atomic_load(&shared->stop)) {
+        search->found(search->context, &worker->program);
+        if (++shared->solutions == search->max_solutions)
+            atomic_store(&shared->stop, true);
+    }
+    pthread_mutex_unlock(&shared->found_lock);
+}
+
+// Runs the candidates of the worker's item until it is exhausted or the search is stopped. A solution that did not
+// execute the digit its item was split off at is equivalent to one with a lower digit there, outside the item, and
+// is left for the worker that has that one to report.
+static void run_item(struct worker *worker) {
+    bool more = true;
+    while (more && !atomic_load(&worker->shared->stop)) {
+        const bool solved = run_candidate(worker);
+        const ssize_t digit = last_executed(worker);
+        if (solved && digit >= worker->stolen_depth)
+            report(worker);
+        more = advance(worker, digit);
+    }
+    if (more) {
+        pthread_mutex_lock(&worker->lock);
+        worker->working = false;
+        pthread_mutex_unlock(&worker->lock);
+    }
+    atomic_fetch_sub(&worker->shared->busy, 1);
+}
+
+// Takes the upper half of the remaining range of some other worker's split digit. The thief is counted as busy
+// before the victim's lock is released, so the count cannot drop to zero while work changes hands.
+static bool steal(struct worker *thief, struct worker *workers, int count) {
+    const int self = thief - workers;
+    for (int i = 1; i < count; i++) {
+        struct worker *victim = workers + (self + i) % count;
+        pthread_mutex_lock(&victim->lock);
+        const int current = victim->working ? victim->digits[victim->depth] : 0;
+        if (victim->working && victim->hi - current > 1) {
+            const int middle = current + 1 + (victim->hi - current - 1) / 2;
+            const size_t depth = victim->depth;
+            memcpy(thief->digits, victim->digits, depth * sizeof(int));
+            memset(thief->digits + depth, 0, (thief->shared->search->free_count - depth) * sizeof(int));
+            thief->digits[depth] = middle;
+            const int hi = victim->hi;
+            victim->hi = middle;
+            atomic_fetch_add(&thief->shared->busy, 1);
+            pthread_mutex_unlock(&victim->lock);
+
+            pthread_mutex_lock(&thief->lock);
+            thief->depth = depth;
+            thief->stolen_depth = depth;
+            thief->hi = hi;
+            thief->working = true;
+            descend(thief);
+            pthread_mutex_unlock(&thief->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+    return false;
+}
+
+struct worker_context {
+    struct worker *workers;
+    int count;
+    int index;
+};
+
+static void *run_worker(void *argument) {
+    struct worker_context *context = argument;
+    struct worker *worker = context->workers + context->index;
+    struct shared *shared = worker->shared;
+    if (worker->working)
+        run_item(worker);
+    while (!atomic_load(&shared->stop)) {
+        if (steal(worker, context->workers, context->count))
+            run_item(worker);
+        else if (atomic_load(&shared->busy) == 0)
+            break;
+        else
+            sched_yield();
+    }
+    return NULL;
+}
+
+static bool init_worker(struct worker *worker, struct shared *shared, size_t output_capacity) {
+    const struct search *search = shared->search;
+    const struct program *template = search->template;
+    *worker = (struct worker){.shared = shared, .program = *template};
+    worker->program.cells = malloc(template->size * sizeof(struct program_cell));
+    worker->output = malloc(output_capacity);
+    worker->digits = calloc(search->free_count + 1, sizeof(int));
+    if (worker->program.cells == NULL || worker->output == NULL || worker->digits == NULL ||
+        !vm_init(&worker->vm, &worker->program)) {
+        free(worker->program.cells);
+        free(worker->output);
+        free(worker->digits);
+        return false;
+    }
+    for (size_t i = 0; i < template->size; i++)
+        worker->program.cells[i] = (struct program_cell){template->cells[i].value, false};
+    pthread_mutex_init(&worker->lock, NULL);
+    return true;
+}
+
+static void free_worker(struct worker *worker) {
+    pthread_mutex_destroy(&worker->lock);
+    vm_free(&worker->vm);
+    free(worker->program.cells);
+    free(worker->output);
+    free(worker->digits);
+    free(worker->snapshot.memory);
+}
+
+bool run_search(const struct search *search, struct search_statistics *statistics) {
+    struct shared shared = {
+        .search = search,
+        .alphabet_size = strlen(search->alphabet),
+    };
+    *statistics = (struct search_statistics){0};
+    if (search->threads <= 0 || shared.alphabet_size == 0)
+        return false;
+    pthread_mutex_init(&shared.found_lock, NULL);
+    size_t output_capacity = DECIMAL_LENGTH;
+    for (size_t i = 0; i < search->example_count; i++) {
+        if (search->examples[i].output_length + DECIMAL_LENGTH > output_capacity)
+            output_capacity = search->examples[i].output_length + DECIMAL_LENGTH;
+    }
+
+    struct worker *workers = malloc(search->threads * sizeof(struct worker));
+    struct worker_context *contexts = malloc(search->threads * sizeof(struct worker_context));
+    int count = 0;
+    while (workers != NULL && contexts != NULL && count < search->threads &&
+           init_worker(workers + count, &shared, output_capacity))
+        count++;
+    bool success = count == search->threads;
+
+    if (success) {
+        // the first worker starts with every candidate, the others steal from it
+        workers[0].working = true;
+        workers[0].stolen_depth = -1;
+        workers[0].hi = search->free_count > 0 ? shared.alphabet_size : 1;
+        pthread_mutex_lock(&workers[0].lock);
+        descend(workers);
+        pthread_mutex_unlock(&workers[0].lock);
+        atomic_store(&shared.busy, 1);
+        int started = 0;
+        for (; started < count; started++) {
+            contexts[started] = (struct worker_context){workers, count, started};
+            if (pthread_create(&workers[started].thread, NULL, run_worker, contexts + started) != 0)
+                break;
+        }
+        if (started < count) {
+            atomic_store(&shared.stop, true);
+            shared.failed = true;
+        }
+        for (int i = 0; i < started; i++)
+            pthread_join(workers[i].thread, NULL);
+        success = !shared.failed;
+    }
+
+    for (int i = 0; i < count; i++) {
+        statistics->candidates += workers[i].candidates;
+        free_worker(workers + i);
+    }
+    statistics->solutions = shared.solutions;
+    pthread_mutex_destroy(&shared.found_lock);
+    free(workers);
+    free(contexts);
+    return success;
+}
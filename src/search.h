@@ -0,0 +1,42 @@
+#ifndef HEXAGONY_SEARCH_H
+#define HEXAGONY_SEARCH_H
+
+#include "vm.h"
+
+// an input and the output a program has to produce from it
+struct example {
+    char *input;
+    size_t input_length;
+    char *output;
+    size_t output_length;
+};
+
+// What to enumerate. The free cells of the template are filled with every combination of the alphabet, the other
+// cells keep their instruction. A candidate is a solution if it halts with exactly the expected output on every
+// example, each run with its input followed by EOF and within step_limit steps.
+struct search {
+    const struct program *template;
+    const size_t *free_cells; // indices into template->cells
+    size_t free_count;
+    const char *alphabet;
+    const struct example *examples;
+    size_t example_count;
+    unsigned long step_limit;
+    int threads;
+    unsigned long max_solutions; // the search stops after this many, 0 for no limit
+    // called for every solution, never from two threads at once
+    void (*found)(void *context, const struct program *program);
+    void *context;
+};
+
+struct search_statistics {
+    unsigned long candidates; // actually run, the rest were skipped as equivalent to one of them
+    unsigned long solutions;
+};
+
+// Runs the search on the given number of threads, which split the candidates between them by work stealing.
+// Candidates that only differ in cells none of their runs executed behave the same, so only one of them is run and
+// reported. Division by zero rejects a candidate instead of crashing the process.
+bool run_search(const struct search *search, struct search_statistics *statistics);
+
+#endif
@@ -0,0 +1,577 @@
+#include "simt.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// memory cell holding the value of each edge for every lane of the batch
+struct simt_cell {
+    memory_edge value[3][SIMT_LANES];
+};
+
+// Lanes that are currently following the same path. The mask is -1 for member lanes and 0 otherwise, so that
+// arithmetic can be done on all lanes at once and blended into the member lanes.
+struct group {
+    struct IP IPs[6];
+    int IP_index;
+    struct memory_pointer MP;
+    unsigned long steps;
+    bool trace_end; // the last instruction ended a straight line run, see vm_run()
+    memory_edge mask[SIMT_LANES];
+};
+
+struct lane_state {
+    size_t input_position;
+    size_t output_capacity;
+    long step_offset; // steps of the lane minus steps of its group
+};
+
+struct batch {
+    const struct program *program;
+    struct simt_lane *lanes;
+    int lane_count;
+    struct lane_state state[SIMT_LANES];
+
+    struct simt_cell *memory;
+    long memory_rings;
+
+    // there are never more groups than lanes
+    struct group groups[SIMT_LANES];
+    int group_count;
+    bool out_of_memory;
+};
+
+// gets the index of the memory cell at axial p,q and grows memory if it is out of range
+static size_t cell_index(struct batch *batch, long p, long q) {
+    const size_t index = axial_to_mem_index(p, q);
+    size_t size = 3 * batch->memory_rings * (batch->memory_rings - 1) + 1;
+    if (index >= size) {
+        long rings = batch->memory_rings;
+        while (index >= (size_t)(3 * rings * (rings - 1) + 1))
+            rings++;
+        const size_t new_size = 3 * rings * (rings - 1) + 1;
+        struct simt_cell *memory = realloc(batch->memory, new_size * sizeof(struct simt_cell));
+        if (memory == NULL) {
+            batch->out_of_memory = true;
+            return 0;
+        }
+        memset(memory + size, 0, (new_size - size) * sizeof(struct simt_cell));
+        batch->memory = memory;
+        batch->memory_rings = rings;
+    }
+    return index;
+}
+
+static memory_edge *edge_vector(struct batch *batch, size_t index, enum axis axis) {
+    return batch->memory[index].value[axis];
+}
+
+// the cell index and axis of a neighbor of the edge pointed to by ptr, as in get_neighbor()
+static size_t neighbor_index(struct batch *batch, struct memory_pointer ptr, enum neighbor neighbor, enum axis *axis) {
+    long xyz[3] = {ptr.p, ptr.q, -ptr.p - ptr.q};
+    *axis = modulo((long)ptr.axis + neighbor, 3);
+    if (ptr.direction == OUT) {
+        ++xyz[ptr.axis];
+        --xyz[*axis];
+    }
+    return cell_index(batch, xyz[X], xyz[Y]);
+}
+
+// moves the lanes selected by the mask out of the group into a new one on the same path
+static struct group *split(struct batch *batch, struct group *group, const memory_edge *mask) {
+    struct group *split = batch->groups + batch->group_count++;
+    *split = *group;
+    for (int l = 0; l < SIMT_LANES; l++) {
+        split->mask[l] = group->mask[l] & mask[l];
+        group->mask[l] &= ~mask[l];
+    }
+    return split;
+}
+
+// compares everything that decides the future path of a group
+static bool same_path(const struct group *a, const struct group *b) {
+    if (a->IP_index != b->IP_index || a->MP.p != b->MP.p || a->MP.q != b->MP.q || a->MP.axis != b->MP.axis
+        || a->MP.direction != b->MP.direction)
+        return false;
+    for (int i = 0; i < 6; i++) {
+        if (a->IPs[i].p != b->IPs[i].p || a->IPs[i].q != b->IPs[i].q || a->IPs[i].direction != b->IPs[i].direction
+            || a->IPs[i].ignore_next != b->IPs[i].ignore_next)
+            return false;
+    }
+    return true;
+}
+
+static bool empty(const struct group *group) {
+    for (int l = 0; l < SIMT_LANES; l++) {
+        if (group->mask[l])
+            return false;
+    }
+    return true;
+}
+
+// appends to the output of a lane
+static bool emit(struct batch *batch, int lane, const char *data, size_t length) {
+    struct simt_lane *out = batch->lanes + lane;
+    size_t *capacity = &batch->state[lane].output_capacity;
+    if (out->output_length + length > *capacity) {
+        size_t size = *capacity ? *capacity : 16;
+        while (size < out->output_length + length)
+            size *= 2;
+        char *output = realloc(out->output, size);
+        if (output == NULL) {
+            batch->out_of_memory = true;
+            return false;
+        }
+        out->output = output;
+        *capacity = size;
+    }
+    memcpy(out->output + out->output_length, data, length);
+    out->output_length += length;
+    return true;
+}
+
+// the '?' instruction for one lane, see scan_number() and number_value() in vm.c
+static memory_edge read_number(struct batch *batch, int lane) {
+    const struct simt_lane *in = batch->lanes + lane;
+    size_t *position = &batch->state[lane].input_position;
+    while (*position < in->input_length && !isdigit((unsigned char)in->input[*position])
+           && in->input[*position] != '+' && in->input[*position] != '-')
+        ++*position;
+    if (*position == in->input_length)
+        return 0;
+    bool negative = false;
+    if (!isdigit((unsigned char)in->input[*position]))
+        negative = in->input[(*position)++] == '-';
+    unsigned value = 0;
+    while (*position < in->input_length && isdigit((unsigned char)in->input[*position]))
+        value = value * 10 + (in->input[(*position)++] - '0');
+    return negative ? -(memory_edge)value : (memory_edge)value;
+}
+
+// Moves the IP of the group one cell ahead, splitting off lanes that wrap around a corner differently. New groups
+// start from the same position so they are moved as well. Returns true if the IP left the hexagon.
+static bool advance(struct batch *batch, struct group *group, int IP_index) {
+    const long program_rings = batch->program->rings;
+    group->steps++;
+    struct IP *IP = group->IPs + IP_index;
+    switch (ip_step(program_rings, IP)) {
+    case IP_MOVED: return false;
+    case IP_WRAPPED: return true;
+    case IP_CORNER: break;
+    }
+
+    const size_t index = cell_index(batch, group->MP.p, group->MP.q);
+    const memory_edge *edge = edge_vector(batch, index, group->MP.axis);
+    memory_edge is_positive[SIMT_LANES];
+    memory_edge any = 0, all = -1;
+    for (int l = 0; l < SIMT_LANES; l++) {
+        is_positive[l] = -(edge[l] > 0) & group->mask[l];
+        any |= is_positive[l];
+        all &= is_positive[l] | ~group->mask[l];
+    }
+    if (any && !all) {
+        struct group *positive_group = split(batch, group, is_positive);
+        positive_group->trace_end = true;
+        ip_wrap(positive_group->IPs + IP_index, true);
+    }
+    ip_wrap(IP, all != 0);
+    return true;
+}
+
+// Splits the lanes of a group by a per lane value in 0..count-1 into groups[value], or NULL for values no lane has.
+// The lanes with the first value found stay in the original group.
+static void split_by(struct batch *batch, struct group *group, const int *value, int count, struct group **groups) {
+    for (int v = 0; v < count; v++)
+        groups[v] = NULL;
+    bool kept = false;
+    for (int l = 0; l < SIMT_LANES; l++) {
+        if (!group->mask[l] || groups[value[l]] != NULL)
+            continue;
+        if (!kept) {
+            groups[value[l]] = group;
+            kept = true;
+            continue;
+        }
+        memory_edge mask[SIMT_LANES];
+        for (int m = 0; m < SIMT_LANES; m++)
+            mask[m] = -(value[m] == value[l]);
+        groups[value[l]] = split(batch, group, mask);
+    }
+}
+
+// Executes one instruction of a group, along with any groups split off by it. Returns true if the group should be
+// rescheduled because it split, halted or reached the end of a straight line run.
+static bool step(struct batch *batch, struct group *group) {
+    const struct program *program = batch->program;
+    const int first_split = batch->group_count;
+    const int IP_index = group->IP_index;
+    struct IP *IP = group->IPs + IP_index;
+    const memory_edge *mask = group->mask;
+    bool trace_end = false;
+
+    if (IP->ignore_next) {
+        IP->ignore_next = false;
+    } else {
+        const char instruction = program->cells[axial_to_index(IP->p, IP->q, program->rings)].value;
+        const size_t index = cell_index(batch, group->MP.p, group->MP.q);
+        memory_edge *edge = edge_vector(batch, index, group->MP.axis);
+
+        if (isalpha((unsigned char)instruction)) {
+            for (int l = 0; l < SIMT_LANES; l++)
+                edge[l] = mask[l] ? instruction : edge[l];
+
+        } else if (isdigit((unsigned char)instruction)) {
+            const memory_edge digit = instruction - '0';
+            for (int l = 0; l < SIMT_LANES; l++) {
+                const memory_edge shifted = (unsigned)edge[l] * 10;
+                edge[l] = mask[l] ? (memory_edge)((unsigned)shifted + (shifted < 0 ? -digit : digit)) : edge[l];
+            }
+
+        } else switch (instruction) {
+
+            case '@':
+                for (int l = 0; l < SIMT_LANES; l++) {
+                    if (mask[l]) {
+                        batch->lanes[l].status = VM_HALTED;
+                        batch->lanes[l].steps = group->steps + batch->state[l].step_offset;
+                    }
+                }
+                memset(group->mask, 0, sizeof(group->mask));
+                return true;
+
+
+            case ')':
+                for (int l = 0; l < SIMT_LANES; l++)
+                    edge[l] = mask[l] ? (memory_edge)((unsigned)edge[l] + 1) : edge[l];
+                break;
+
+            case '(':
+                for (int l = 0; l < SIMT_LANES; l++)
+                    edge[l] = mask[l] ? (memory_edge)((unsigned)edge[l] - 1) : edge[l];
+                break;
+
+            case '~':
+                for (int l = 0; l < SIMT_LANES; l++)
+                    edge[l] = mask[l] ? (memory_edge)(0u - (unsigned)edge[l]) : edge[l];
+                break;
+
+            case '+':
+            case '-':
+            case '*':
+            case ':':
+            case '%': {
+                enum axis left_axis, right_axis;
+                const size_t left_index = neighbor_index(batch, group->MP, LEFT, &left_axis);
+                const size_t right_index = neighbor_index(batch, group->MP, RIGHT, &right_axis);
+                if (batch->out_of_memory)
+                    return true;
+                // growing memory for the neighbours may have moved it
+                edge = edge_vector(batch, index, group->MP.axis);
+                const memory_edge *left = edge_vector(batch, left_index, left_axis);
+                const memory_edge *right = edge_vector(batch, right_index, right_axis);
+                if (instruction == ':' || instruction == '%') {
+                    // lanes that divide by zero stop at the division, as the vm does
+                    bool stopped = false;
+                    for (int l = 0; l < SIMT_LANES; l++) {
+                        if (mask[l] && right[l] == 0) {
+                            batch->lanes[l].status = VM_DIVIDE_BY_ZERO;
+                            batch->lanes[l].steps = group->steps + batch->state[l].step_offset;
+                            group->mask[l] = 0;
+                            stopped = true;
+                        }
+                    }
+                    if (stopped && empty(group))
+                        return true;
+                }
+                switch (instruction) {
+                case '+':
+                    for (int l = 0; l < SIMT_LANES; l++)
+                        edge[l] = mask[l] ? (memory_edge)((unsigned)left[l] + (unsigned)right[l]) : edge[l];
+                    break;
+                case '-':
+                    for (int l = 0; l < SIMT_LANES; l++)
+                        edge[l] = mask[l] ? (memory_edge)((unsigned)left[l] - (unsigned)right[l]) : edge[l];
+                    break;
+                case '*':
+                    for (int l = 0; l < SIMT_LANES; l++)
+                        edge[l] = mask[l] ? (memory_edge)((unsigned)left[l] * (unsigned)right[l]) : edge[l];
+                    break;
+                case ':': // division has no vector instruction
+                    for (int l = 0; l < SIMT_LANES; l++) {
+                        if (mask[l] && right[l] == -1)
+                            __builtin_mul_overflow(left[l], -1, edge + l); // wraps around like the vm
+                        else if (mask[l])
+                            edge[l] = left[l] / right[l];
+                    }
+                    break;
+                case '%':
+                    for (int l = 0; l < SIMT_LANES; l++) {
+                        if (mask[l])
+                            edge[l] = right[l] == -1 ? 0 : left[l] % right[l];
+                    }
+                    break;
+                }
+            }   break;
+
+            case '&': {
+                enum axis left_axis, right_axis;
+                const size_t left_index = neighbor_index(batch, group->MP, LEFT, &left_axis);
+                const size_t right_index = neighbor_index(batch, group->MP, RIGHT, &right_axis);
+                if (batch->out_of_memory)
+                    return true;
+                edge = edge_vector(batch, index, group->MP.axis);
+                const memory_edge *left = edge_vector(batch, left_index, left_axis);
+                const memory_edge *right = edge_vector(batch, right_index, right_axis);
+                for (int l = 0; l < SIMT_LANES; l++)
+                    edge[l] = mask[l] ? (edge[l] <= 0 ? left[l] : right[l]) : edge[l];
+            }   break;
+
+            case ',':
+                for (int l = 0; l < SIMT_LANES; l++) {
+                    if (!mask[l])
+                        continue;
+                    const struct simt_lane *in = batch->lanes + l;
+                    size_t *position = &batch->state[l].input_position;
+                    edge[l] = *position < in->input_length ? (unsigned char)in->input[(*position)++] : EOF;
+                }
+                break;
+
+            case '?':
+                for (int l = 0; l < SIMT_LANES; l++) {
+                    if (mask[l])
+                        edge[l] = read_number(batch, l);
+                }
+                break;
+
+            case ';':
+                for (int l = 0; l < SIMT_LANES; l++) {
+                    const char byte = modulo(edge[l], 256);
+                    if (mask[l] && !emit(batch, l, &byte, 1))
+                        return true;
+                }
+                break;
+
+            case '!':
+                for (int l = 0; l < SIMT_LANES; l++) {
+                    char decimal[DECIMAL_LENGTH];
+                    if (mask[l] && !emit(batch, l, decimal, snprintf(decimal, sizeof(decimal), "%d", edge[l])))
+                        return true;
+                }
+                break;
+
+            case '$':
+                IP->ignore_next = true;
+                break;
+
+            case '/':
+            case '\\':
+            case '_':
+            case '|':
+                trace_end = true;
+                IP->direction = ip_turn(instruction, IP->direction, false);
+                break;
+
+            case '<':
+            case '>': {
+                trace_end = true;
+                const enum direction branch = instruction == '<' ? E : W;
+                if (IP->direction != branch) {
+                    IP->direction = ip_turn(instruction, IP->direction, false);
+                    break;
+                }
+                int is_positive[SIMT_LANES];
+                for (int l = 0; l < SIMT_LANES; l++)
+                    is_positive[l] = edge[l] > 0;
+                struct group *groups[2];
+                split_by(batch, group, is_positive, 2, groups);
+                if (groups[0] != NULL)
+                    groups[0]->IPs[IP_index].direction = ip_turn(instruction, branch, false);
+                if (groups[1] != NULL)
+                    groups[1]->IPs[IP_index].direction = ip_turn(instruction, branch, true);
+            }   break;
+
+            case '[':
+                trace_end = true;
+                group->IP_index = modulo(group->IP_index - 1, 6);
+                break;
+
+            case ']':
+                trace_end = true;
+                group->IP_index = modulo(group->IP_index + 1, 6);
+                break;
+
+            case '#': {
+                trace_end = true;
+                int target[SIMT_LANES];
+                for (int l = 0; l < SIMT_LANES; l++)
+                    target[l] = modulo(edge[l], 6);
+                struct group *groups[6];
+                split_by(batch, group, target, 6, groups);
+                for (int i = 0; i < 6; i++) {
+                    if (groups[i] != NULL)
+                        groups[i]->IP_index = i;
+                }
+            }   break;
+
+            case '{':
+                move_mp(&group->MP, LEFT);
+                break;
+
+            case '}':
+                move_mp(&group->MP, RIGHT);
+                break;
+
+            case '"':
+                group->MP.direction = group->MP.direction == IN ? OUT : IN;
+                move_mp(&group->MP, RIGHT);
+                group->MP.direction = group->MP.direction == IN ? OUT : IN;
+                break;
+
+            case '\'':
+                group->MP.direction = group->MP.direction == IN ? OUT : IN;
+                move_mp(&group->MP, LEFT);
+                group->MP.direction = group->MP.direction == IN ? OUT : IN;
+                break;
+
+            case '=':
+                group->MP.direction = group->MP.direction == IN ? OUT : IN;
+                break;
+
+            case '^': {
+                int is_positive[SIMT_LANES];
+                for (int l = 0; l < SIMT_LANES; l++)
+                    is_positive[l] = edge[l] > 0;
+                struct group *groups[2];
+                split_by(batch, group, is_positive, 2, groups);
+                if (groups[0] != NULL)
+                    move_mp(&groups[0]->MP, LEFT);
+                if (groups[1] != NULL)
+                    move_mp(&groups[1]->MP, RIGHT);
+            }   break;
+        }
+    }
+
+    // the instruction may have split the group, every part still has to move its IP
+    const int last_split = batch->group_count;
+    group->trace_end = advance(batch, group, IP_index) || trace_end;
+    for (int i = first_split; i < last_split; i++)
+        batch->groups[i].trace_end = advance(batch, batch->groups + i, IP_index) || trace_end;
+    return group->trace_end || last_split > first_split;
+}
+
+// joins a group into another one that is at the same point of the same path
+static void merge(struct batch *batch, struct group *group) {
+    for (int i = 0; i < batch->group_count; i++) {
+        struct group *other = batch->groups + i;
+        if (other == group || empty(other) || !same_path(group, other))
+            continue;
+        for (int l = 0; l < SIMT_LANES; l++) {
+            if (group->mask[l])
+                batch->state[l].step_offset += (long)(group->steps - other->steps);
+            other->mask[l] |= group->mask[l];
+        }
+        memset(group->mask, 0, sizeof(group->mask));
+        return;
+    }
+}
+
+// retires the lanes of a group that have run out of steps, at the same points where vm_run() would yield
+static void limit(struct batch *batch, struct group *group, unsigned long step_limit) {
+    if (!group->trace_end)
+        return;
+    group->trace_end = false;
+    for (int l = 0; l < SIMT_LANES; l++) {
+        if (!group->mask[l])
+            continue;
+        const unsigned long steps = group->steps + batch->state[l].step_offset;
+        if (steps >= step_limit) {
+            batch->lanes[l].status = VM_YIELD;
+            batch->lanes[l].steps = steps;
+            group->mask[l] = 0;
+        }
+    }
+}
+
+static bool run_batch(const struct program *program, struct simt_lane *lanes, int count, unsigned long step_limit) {
+    struct batch *batch = calloc(1, sizeof(struct batch));
+    if (batch == NULL)
+        return false;
+    batch->program = program;
+    batch->lanes = lanes;
+    batch->lane_count = count;
+    batch->memory_rings = 1;
+    batch->memory = calloc(1, sizeof(struct simt_cell));
+
+    // every lane starts on the same path, unused lanes are left out of it
+    struct vm initial;
+    if (batch->memory == NULL || !vm_init(&initial, program)) {
+        free(batch->memory);
+        free(batch);
+        return false;
+    }
+    struct group *group = batch->groups;
+    memcpy(group->IPs, initial.IPs, sizeof(group->IPs));
+    group->IP_index = initial.IP_index;
+    group->MP = initial.MP;
+    vm_free(&initial);
+    for (int l = 0; l < SIMT_LANES; l++)
+        group->mask[l] = -(l < count);
+    batch->group_count = 1;
+    for (int l = 0; l < count; l++) {
+        lanes[l].output = NULL;
+        lanes[l].output_length = 0;
+        lanes[l].memory = NULL;
+    }
+
+    while (batch->group_count > 0 && !batch->out_of_memory) {
+        // run the group that is furthest behind, so that groups on paths that meet again catch up with each other
+        group = batch->groups;
+        for (int i = 1; i < batch->group_count; i++) {
+            if (batch->groups[i].steps < group->steps)
+                group = batch->groups + i;
+        }
+        while (!step(batch, group))
+            ;
+        for (int i = 0; i < batch->group_count; i++)
+            limit(batch, batch->groups + i, step_limit);
+        merge(batch, group);
+        // drop groups whose lanes have all halted, merged or split away
+        for (int i = 0; i < batch->group_count;) {
+            if (empty(batch->groups + i))
+                batch->groups[i] = batch->groups[--batch->group_count];
+            else
+                i++;
+        }
+    }
+
+    const size_t size = 3 * batch->memory_rings * (batch->memory_rings - 1) + 1;
+    for (int l = 0; l < count && !batch->out_of_memory; l++) {
+        if (!lanes[l].keep_memory)
+            continue;
+        lanes[l].memory = malloc(size * sizeof(struct memory_cell));
+        lanes[l].memory_rings = batch->memory_rings;
+        if (lanes[l].memory == NULL) {
+            batch->out_of_memory = true;
+            break;
+        }
+        for (size_t i = 0; i < size; i++) {
+            for (enum axis axis = X; axis <= Z; axis++)
+                lanes[l].memory[i].value[axis] = batch->memory[i].value[axis][l];
+        }
+    }
+
+    const bool success = !batch->out_of_memory;
+    free(batch->memory);
+    free(batch);
+    return success;
+}
+
+bool simt_run(const struct program *program, struct simt_lane *lanes, size_t count, unsigned long step_limit) {
+    for (size_t first = 0; first < count; first += SIMT_LANES) {
+        const int batch_count = count - first < SIMT_LANES ? count - first : SIMT_LANES;
+        if (!run_batch(program, lanes + first, batch_count, step_limit))
+            return false;
+    }
+    return true;
+}
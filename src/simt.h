@@ -0,0 +1,33 @@
+#ifndef HEXAGONY_SIMT_H
+#define HEXAGONY_SIMT_H
+
+#include "vm.h"
+
+#define SIMT_LANES 16 // inputs executed in lockstep, one per vector lane
+
+// one input of a lockstep run and its results
+struct simt_lane {
+    const char *input;
+    size_t input_length;
+
+    // allocated by simt_run(), freed by the caller
+    char *output;
+    size_t output_length;
+
+    unsigned long steps;
+    enum vm_status status; // VM_HALTED, VM_DIVIDE_BY_ZERO, or VM_YIELD if the lane ran into the step limit
+
+    // set by the caller to get a copy of the final memory of the lane, allocated by simt_run() and freed by the
+    // caller. Lanes share their memory layout, so it can have more rings than the lane has touched.
+    bool keep_memory;
+    struct memory_cell *memory;
+    long memory_rings;
+};
+
+// Runs the program on every lane's input with the same semantics as vm_run(). Lanes are processed in batches of
+// SIMT_LANES. Lanes that take the same path through the program share one instruction stream and do their memory
+// arithmetic in vector lanes. They only split when a branch, corner wrap or '#' goes different ways for different
+// lanes, and join up again when their paths meet. Returns false if memory ran out.
+bool simt_run(const struct program *program, struct simt_lane *lanes, size_t count, unsigned long step_limit);
+
+#endif
@@ -0,0 +1,85 @@
+#include "trace.h"
+
+static const char *ip_name[] = {"IP 0", "IP 1", "IP 2", "IP 3", "IP 4", "IP 5"};
+
+// starts the next event of the array
+static void begin_event(struct trace *trace) {
+    if (!trace->empty)
+        fputs(",\n", trace->file);
+    trace->empty = false;
+}
+
+static void write_args(struct trace *trace, const char *key, long value) {
+    if (key != NULL)
+        fprintf(trace->file, ",\"args\":{\"%s\":%ld}", key, value);
+    fputs("}", trace->file);
+}
+
+bool trace_open(struct trace *trace, const char *filename) {
+    *trace = (struct trace){.file = fopen(filename, "w"), .empty = true};
+    if (trace->file == NULL)
+        return false;
+    clock_gettime(CLOCK_MONOTONIC, &trace->start);
+    fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", trace->file);
+    static const char *track_name[] = {[TRACE_VM] = "vm", [TRACE_HOST] = "host"};
+    for (int track = TRACE_VM; track <= TRACE_HOST; track++) {
+        begin_event(trace);
+        fprintf(trace->file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                track, track_name[track]);
+    }
+    return true;
+}
+
+double trace_now(const struct trace *trace) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - trace->start.tv_sec) * 1e6 + (now.tv_nsec - trace->start.tv_nsec) / 1e3;
+}
+
+void trace_span(struct trace *trace, enum trace_track track, const char *name, double start, const char *key,
+                long value) {
+    const double end = trace_now(trace);
+    begin_event(trace);
+    fprintf(trace->file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", name, track,
+            start, end - start);
+    write_args(trace, key, value);
+}
+
+void trace_instant(struct trace *trace, enum trace_track track, const char *name, const char *key, long value) {
+    const double now = trace_now(trace);
+    begin_event(trace);
+    fprintf(trace->file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":%d,\"ts\":%.3f", name, track,
+            now);
+    write_args(trace, key, value);
+}
+
+// ends the span of the active IP and starts the one of the next
+static void switch_ip(struct trace *trace, int ip, unsigned long steps) {
+    trace_span(trace, TRACE_VM, ip_name[trace->ip], trace->ip_since, "steps", steps - trace->ip_steps);
+    trace->ip = ip;
+    trace->ip_since = trace_now(trace);
+    trace->ip_steps = steps;
+}
+
+void trace_event(void *context, enum vm_event event, long value, unsigned long steps) {
+    struct trace *trace = context;
+    switch (event) {
+    case VM_EVENT_SWITCH:
+        // the instruction that switches still counts for the IP executing it
+        switch_ip(trace, value, steps + 1);
+        break;
+
+    case VM_EVENT_GROW:
+        trace_instant(trace, TRACE_VM, "memory grows", "rings", value);
+        break;
+    }
+}
+
+bool trace_close(struct trace *trace, unsigned long steps) {
+    trace_span(trace, TRACE_VM, ip_name[trace->ip], trace->ip_since, "steps", steps - trace->ip_steps);
+    fputs("\n]}\n", trace->file);
+    const bool written = !ferror(trace->file);
+    const bool closed = fclose(trace->file) == 0;
+    trace->file = NULL;
+    return written && closed;
+}
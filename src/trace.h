@@ -0,0 +1,43 @@
+#ifndef HEXAGONY_TRACE_H
+#define HEXAGONY_TRACE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "vm.h"
+
+// the tracks of a trace, the vm runs on the first and waits on the host on the second
+enum trace_track { TRACE_VM = 1, TRACE_HOST = 2 };
+
+// A trace of the phases of a run in the Chrome trace event format, which chrome://tracing and ui.perfetto.dev load.
+// Every span is written to the file as it ends, with timestamps in microseconds since the trace was opened. Each
+// activation of an IP is a span on the vm track, from the instruction that switched to it to the one that switched
+// away, with the steps it took. Memory growth is an instant on the same track. Reads that wait for input, flushes of
+// the output and pauses in the debugger are spans on the host track, which the vm is stopped for.
+struct trace {
+    FILE *file;
+    struct timespec start;
+    bool empty; // no event has been written yet
+    // the active IP, and the time and steps it became active at
+    int ip;
+    double ip_since;
+    unsigned long ip_steps;
+};
+
+// Creates the trace file and starts the span of IP 0. Returns false with errno set if it could not be created.
+bool trace_open(struct trace *trace, const char *filename);
+// microseconds since the trace was opened
+double trace_now(const struct trace *trace);
+// Writes a span that started at start and ends now. Unless key is NULL, the span has an argument with that value.
+void trace_span(struct trace *trace, enum trace_track track, const char *name, double start, const char *key,
+                long value);
+// writes an event that takes no time, with an argument like trace_span()
+void trace_instant(struct trace *trace, enum trace_track track, const char *name, const char *key, long value);
+// the event hook of a vm, with the trace as its context
+void trace_event(void *context, enum vm_event event, long value, unsigned long steps);
+// Ends the span of the active IP after the steps of the run and closes the file. Returns false if anything could not
+// be written.
+bool trace_close(struct trace *trace, unsigned long steps);
+
+#endif
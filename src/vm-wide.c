@@ -0,0 +1,4 @@
+// the vm with 64 bit memory edges, see vm-wide.h
+#define HEXAGONY_VM_WIDE_SOURCE
+#include "vm-wide.h"
+#include "vm.c"
@@ -0,0 +1,52 @@
+#ifndef HEXAGONY_VM_WIDE_H
+#define HEXAGONY_VM_WIDE_H
+
+// The vm with 64 bit memory edges, for programs whose values do not fit in 32 bits. It is vm.c compiled again by
+// vm-wide.c, with every name that depends on the width of an edge prefixed by wide_. This declares both vms.
+
+#include "vm.h"
+
+#define memory_edge wide_memory_edge
+#define memory_cell wide_memory_cell
+#define vm wide_vm
+#define realloc_memory wide_realloc_memory
+#define get_memory_cell wide_get_memory_cell
+#define get_memory_edge wide_get_memory_edge
+#define get_neighbor wide_get_neighbor
+#define vm_init wide_vm_init
+#define vm_reset wide_vm_reset
+#define vm_free wide_vm_free
+#define vm_set_input wide_vm_set_input
+#define vm_close_input wide_vm_close_input
+#define vm_set_output wide_vm_set_output
+#define vm_set_expected_output wide_vm_set_expected_output
+#define vm_run wide_vm_run
+#define vm_run_io wide_vm_run_io
+
+#undef MEMORY_EDGE_BITS
+#define MEMORY_EDGE_BITS 64
+#include "vm.h"
+
+// vm-wide.c keeps the names prefixed for the rest of vm.c, everything else gets both vms by their own names
+#ifndef HEXAGONY_VM_WIDE_SOURCE
+#undef memory_edge
+#undef memory_cell
+#undef vm
+#undef realloc_memory
+#undef get_memory_cell
+#undef get_memory_edge
+#undef get_neighbor
+#undef vm_init
+#undef vm_reset
+#undef vm_free
+#undef vm_set_input
+#undef vm_close_input
+#undef vm_set_output
+#undef vm_set_expected_output
+#undef vm_run
+#undef vm_run_io
+#undef MEMORY_EDGE_BITS
+#define MEMORY_EDGE_BITS 32
+#endif
+
+#endif
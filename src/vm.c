@@ -0,0 +1,676 @@
+#include "vm.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RESET_RINGS_KEPT 64 // vm_reset() clears memory up to this size in place
+
+#if MEMORY_EDGE_BITS == 32
+#define MEMORY_EDGE_MIN INT32_MIN
+#else
+#define MEMORY_EDGE_MIN INT64_MIN
+#endif
+
+// The functions that do not depend on the width of a memory edge are defined once, by the 32 bit build of this file.
+#if MEMORY_EDGE_BITS == 32
+
+// axial offests for each hexagonal direction
+const struct direction_offset direction_offset[] = {
+    [NW] = { 0, -1},
+    [NE] = {-1,  0},
+    [ E] = {-1,  1},
+    [SE] = { 0,  1},
+    [SW] = { 1,  0},
+    [ W] = { 1, -1},
+};
+
+const char *direction_name[] = {
+    [NW] = "NORTH WEST",
+    [NE] = "NORTH EAST",
+    [ E] = "EAST",
+    [SE] = "SOUTH EAST",
+    [SW] = "SOUTH WEST",
+    [ W] = "WEST",
+};
+
+const char *axis_name[] = {
+    [X] = "X",
+    [Y] = "Y",
+    [Z] = "Z",
+};
+
+// mathematical modulus
+long modulo(long a, long b) {
+    const long result = a % labs(b);
+    return (result >= 0 ? result : result + b) * (b >= 0 ? 1 : -1);
+}
+
+// convert x,y axial coordinates to index for sequentially stored rows along the z axis
+ssize_t axial_to_index(long p, long q, long rings) {
+    long x = p;
+    long y = q;
+    long z = -p - q;
+    if (labs(x) + labs(y) + labs(z) > 2 * (rings - 1)) return -1;
+    return (3 * rings * (rings - 1)) / 2
+           + y + -z * (rings * 2 - 1)
+           + z * (labs(z) + 1) / 2;
+}
+
+// convert x,y axial coordinate to a radial index
+size_t axial_to_mem_index(long p, long q) {
+    long x = p;
+    long y = q;
+    long z = -p - q;
+    // The ring number is the hexagonal distance from the origin.
+    // This is the same as half the manhattan distance in cubic coordinates.
+    size_t ring = (labs(x) + labs(y) + labs(z)) / 2;
+    size_t i = ring > 0 ? (3 * ring * (ring - 1) + 1) : 0;
+    // find the clockwise offset from the closest corner of the ring
+    if (x <= 0 && y < 0) i += ring * 0 + labs(x);
+    if (y >= 0 && z > 0) i += ring * 1 + labs(y);
+    if (z <= 0 && x < 0) i += ring * 2 + labs(z);
+    if (x >= 0 && y > 0) i += ring * 3 + labs(x);
+    if (y <= 0 && z < 0) i += ring * 4 + labs(y);
+    if (z >= 0 && x > 0) i += ring * 5 + labs(z);
+    return i;
+}
+
+#endif
+
+// memory is allocated sequentially and grows outwards in rings
+struct memory_cell *realloc_memory(struct memory_cell *memory, long old_rings, long new_rings) {
+    size_t old_size = (3 * old_rings * (old_rings - 1) + 1);
+    size_t new_size = (3 * new_rings * (new_rings - 1) + 1);
+    memory = realloc(memory, new_size * sizeof(struct memory_cell));
+    if (memory == NULL) { // there is no way to continue without the memory, fail loudly instead of corrupting
+        fputs("Out of memory\n", stderr);
+        abort();
+    }
+    for (size_t i = old_size; i < new_size; i++) {
+        memory[i].value[X] = 0;
+        memory[i].value[Y] = 0;
+        memory[i].value[Z] = 0;
+    }
+    return memory;
+}
+
+// gets the memory cell at axial p,q and reallocates memory if the index is out of range
+struct memory_cell *get_memory_cell(long p, long q, struct memory_cell **memory, long *rings) {
+    size_t index = axial_to_mem_index(p, q);
+    while (index >= (3 * *rings * (*rings - 1) + 1)) {
+        *memory = realloc_memory(*memory, *rings, *rings + 1);
+        ++*rings;
+    }
+    return *memory + index;
+}
+
+// get a pointer to the memory edge pointed to by ptr
+memory_edge *get_memory_edge(struct memory_pointer ptr, struct memory_cell **memory, long *rings) {
+    return &get_memory_cell(ptr.p, ptr.q, memory, rings)->value[ptr.axis];
+}
+
+// get a pointer to a neighbor of the edge pointed to by pointer
+memory_edge *get_neighbor(struct memory_pointer ptr, enum neighbor neighbor, struct memory_cell **memory, long *rings) {
+    long xyz[3] = {ptr.p, ptr.q, -ptr.p - ptr.q};
+    enum axis neighbor_axis = modulo((long)ptr.axis + neighbor, 3);
+    if (ptr.direction == OUT) {
+        ++xyz[ptr.axis];
+        --xyz[neighbor_axis];
+    }
+    struct memory_cell *cell = get_memory_cell(xyz[X], xyz[Y], memory, rings);
+    return &cell->value[neighbor_axis];
+}
+
+#if MEMORY_EDGE_BITS == 32
+
+// move memory pointer to its left or right neighbor
+void move_mp(struct memory_pointer *ptr, enum neighbor neighbor) {
+    long xyz[3] = {ptr->p, ptr->q, -ptr->p - ptr->q};
+    enum axis neighbor_axis = modulo((long)ptr->axis + neighbor, 3);
+    if (ptr->direction == OUT) {
+        ++xyz[ptr->axis];
+        --xyz[neighbor_axis];
+        ptr->direction = IN;
+    } else {
+        ptr->direction = OUT;
+    }
+    ptr->axis = neighbor_axis;
+    ptr->p = xyz[X];
+    ptr->q = xyz[Y];
+}
+
+// where mirrors and the non branching cases of < and > send the IP, see the tables in vm_run()
+static const enum direction slash[] = {[NW] = E, [NE] = NE, [E] = NW, [SE] = W, [SW] = SW, [W] = SE};
+static const enum direction backslash[] = {[NW] = NW, [NE] = W, [E] = SW, [SE] = SE, [SW] = E, [W] = NE};
+static const enum direction underscore[] = {[NW] = SW, [NE] = SE, [E] = E, [SE] = NE, [SW] = NW, [W] = W};
+static const enum direction bar[] = {[NW] = NE, [NE] = NW, [E] = W, [SE] = SW, [SW] = SE, [W] = E};
+static const enum direction less[] = {[NW] = W, [NE] = SW, [E] = NE, [SE] = NW, [SW] = W, [W] = E};
+static const enum direction greater[] = {[NW] = SE, [NE] = E, [E] = W, [SE] = E, [SW] = NE, [W] = SW};
+
+enum direction ip_turn(char instruction, enum direction direction, bool positive) {
+    switch (instruction) {
+    case '/': return slash[direction];
+    case '\\': return backslash[direction];
+    case '_': return underscore[direction];
+    case '|': return bar[direction];
+    case '<': return positive && direction == E ? SE : less[direction];
+    case '>': return positive && direction == W ? NW : greater[direction];
+    default: return direction;
+    }
+}
+
+enum ip_move ip_step(long rings, struct IP *IP) {
+    const long np = IP->p + direction_offset[IP->direction].dp;
+    const long nq = IP->q + direction_offset[IP->direction].dq;
+    const long nr = -np - nq;
+    if (labs(np) + labs(nq) + labs(nr) < 2 * rings) {
+        IP->p = np;
+        IP->q = nq;
+        return IP_MOVED;
+    }
+    if (np == 0 || nq == 0 || nr == 0)
+        return IP_CORNER;
+    ip_wrap(IP, false);
+    return IP_WRAPPED;
+}
+
+void ip_wrap(struct IP *IP, bool positive) {
+    const long p = IP->p, q = IP->q;
+    const long np = p + direction_offset[IP->direction].dp;
+    const long nq = q + direction_offset[IP->direction].dq;
+    const long nr = -np - nq;
+    enum axis reflection;
+    if (np == 0)
+        reflection = positive ? Y : Z;
+    else if (nq == 0)
+        reflection = positive ? Z : X;
+    else if (nr == 0)
+        reflection = positive ? X : Y;
+    else if (nq * nr > 0)
+        reflection = X;
+    else if (nr * np > 0)
+        reflection = Y;
+    else
+        reflection = Z;
+    switch (reflection) {
+    case X: IP->p = -p, IP->q = p + q; break;
+    case Y: IP->p = p + q, IP->q = -q; break;
+    case Z: IP->p = -q, IP->q = -p; break;
+    }
+}
+
+bool parse_program(struct program *program, const char *source, size_t length) {
+    program->rings = 1;
+    program->size = (3 * program->rings * (program->rings - 1) + 1); // ring'th centered hexagonal number
+    program->cells = malloc(program->size * sizeof(struct program_cell));
+    if (program->cells == NULL)
+        return false;
+
+    bool debug_next = false;
+    size_t i = 0;
+    for (size_t s = 0; s < length; s++) {
+        const char c = source[s];
+        if (c == '`')
+            debug_next = true;
+        else if (!isspace((unsigned char)c)) {
+            if (i >= program->size) {
+                ++program->rings;
+                program->size = (3 * program->rings * (program->rings - 1) + 1);
+                struct program_cell *cells = realloc(program->cells, program->size * sizeof(struct program_cell));
+                if (cells == NULL) {
+                    free(program->cells);
+                    return false;
+                }
+                program->cells = cells;
+            }
+            program->cells[i].value = c;
+            program->cells[i].debug = debug_next;
+            debug_next = false;
+            i++;
+        }
+    }
+    while (i < program->size) {
+        program->cells[i].value = '.';
+        program->cells[i].debug = false;
+        i++;
+    }
+    return true;
+}
+
+void free_program(struct program *program) {
+    free(program->cells);
+    program->cells = NULL;
+}
+
+#endif
+
+static void init_state(struct vm *vm, const struct program *program, struct memory_cell *memory, long memory_rings) {
+    const long rings = program->rings;
+    *vm = (struct vm){
+        .program = program,
+        .IPs = {
+            {          0, -(rings - 1),  E, false}, // NW
+            {-(rings - 1),           0, SE, false}, // NE
+            {-(rings - 1), +(rings - 1), SW, false}, // E
+            {          0, +(rings - 1),  W, false}, // SE
+            {+(rings - 1),           0, NW, false}, // SW
+            {+(rings - 1), -(rings - 1), NE, false}, // W
+        },
+        .IP_index = 0,
+        .memory_rings = memory_rings,
+        .memory = memory,
+        .MP = {0, 0, Z, OUT},
+        .step_limit = ULONG_MAX,
+    };
+}
+
+bool vm_init(struct vm *vm, const struct program *program) {
+    init_state(vm, program, calloc(1, sizeof(struct memory_cell)), 1);
+    return vm->memory != NULL;
+}
+
+bool vm_reset(struct vm *vm) {
+    struct memory_cell *memory = vm->memory;
+    const long memory_rings = vm->memory_rings;
+    if (memory_rings > RESET_RINGS_KEPT) {
+        // large memory is cheaper to get as freshly zeroed pages than to clear
+        free(memory);
+        return vm_init(vm, vm->program);
+    }
+    // memory only grows when it is touched, so the allocated rings are exactly what needs clearing
+    memset(memory, 0, (3 * memory_rings * (memory_rings - 1) + 1) * sizeof(struct memory_cell));
+    init_state(vm, vm->program, memory, memory_rings);
+    return true;
+}
+
+void vm_free(struct vm *vm) {
+    free(vm->memory);
+    vm->memory = NULL;
+}
+
+void vm_set_input(struct vm *vm, const char *input, size_t length) {
+    vm->input = input;
+    vm->input_length = length;
+    vm->input_position = 0;
+}
+
+void vm_close_input(struct vm *vm) {
+    vm->input_closed = true;
+}
+
+void vm_set_output(struct vm *vm, char *output, size_t capacity) {
+    vm->output = output;
+    vm->output_capacity = capacity;
+    vm->output_length = 0;
+}
+
+void vm_set_expected_output(struct vm *vm, const char *expect, size_t length) {
+    vm->expect = expect;
+    vm->expect_length = length;
+    vm->expect_position = 0;
+}
+
+// checks output about to be written against the expected output
+static bool expected(struct vm *vm, const char *output, size_t length) {
+    if (vm->expect == NULL)
+        return true;
+    for (size_t i = 0; i < length; i++) {
+        if (vm->expect_position + i == vm->expect_length || vm->expect[vm->expect_position + i] != output[i]) {
+            vm->expect_position += i;
+            return false;
+        }
+    }
+    vm->expect_position += length;
+    return true;
+}
+
+static void report(struct vm *vm, enum vm_event event, long value) {
+    if (vm->event_hook != NULL)
+        vm->event_hook(vm->event_context, event, value, vm->steps);
+}
+
+// Memory only grows in get_memory_cell(), and the vm only gets there through these two, which report it.
+static memory_edge *current_edge(struct vm *vm) {
+    const long rings = vm->memory_rings;
+    memory_edge *edge = get_memory_edge(vm->MP, &vm->memory, &vm->memory_rings);
+    if (vm->memory_rings != rings)
+        report(vm, VM_EVENT_GROW, vm->memory_rings);
+    return edge;
+}
+
+static memory_edge *neighbor_edge(struct vm *vm, enum neighbor neighbor) {
+    const long rings = vm->memory_rings;
+    memory_edge *edge = get_neighbor(vm->MP, neighbor, &vm->memory, &vm->memory_rings);
+    if (vm->memory_rings != rings)
+        report(vm, VM_EVENT_GROW, vm->memory_rings);
+    return edge;
+}
+
+// Continues the '?' parse of the current number with the available input. This behaves like skipping to the first
+// digit or sign and then calling scanf("%d"), except that it can be interrupted at any byte. Returns false if the
+// vm needs more input to decide where the number ends.
+static bool scan_number(struct vm *vm) {
+    while (vm->input_position < vm->input_length) {
+        const char c = vm->input[vm->input_position];
+        if (vm->number.state == NUMBER_SKIP) {
+            if (isdigit((unsigned char)c)) {
+                vm->number.state = NUMBER_DIGITS;
+                continue;
+            }
+            if (c == '+' || c == '-') {
+                vm->number.state = NUMBER_SIGN;
+                vm->number.negative = c == '-';
+            }
+        } else if (isdigit((unsigned char)c)) {
+            vm->number.state = NUMBER_DIGITS;
+            vm->number.value = (int64_t)((uint64_t)vm->number.value * 10 + (c - '0'));
+        } else {
+            break; // the terminating character is left for the next read
+        }
+        vm->input_position++;
+    }
+    return vm->input_position < vm->input_length || vm->input_closed;
+}
+
+// the number scan_number() has read, 0 if it found no digits before EOF
+static int64_t number_value(const struct vm *vm) {
+    if (vm->number.state != NUMBER_DIGITS)
+        return 0;
+    return vm->number.negative ? (int64_t)(0 - (uint64_t)vm->number.value) : vm->number.value;
+}
+
+// counts an outcome of the instruction at a cell, if the host asked for a branch profile
+static void count_outcome(struct vm *vm, const struct program_cell *instruction, int outcome) {
+    if (vm->branch_profile != NULL)
+        vm->branch_profile[instruction - vm->program->cells].instruction[outcome]++;
+}
+
+enum vm_status vm_run(struct vm *vm) {
+    const struct program *program = vm->program;
+    const long program_rings = program->rings;
+    while (true) {
+        struct IP *IP = vm->IPs + vm->IP_index;
+        // Set when the IP turns, wraps or control passes to another IP. Every loop passes through one of these
+        // points within a bounded number of steps, so checking the step limit only there keeps it out of the
+        // straight line runs that make up most of the execution.
+        bool trace_end = false;
+        if (IP->ignore_next) {
+            IP->ignore_next = false;
+        } else {
+            const struct program_cell *instruction = program->cells + axial_to_index(IP->p, IP->q, program_rings);
+            if ((instruction->debug || vm->force_debug) && !vm->at_break) {
+                vm->at_break = true;
+                return VM_BREAK;
+            }
+            if (isalpha((unsigned char)instruction->value)) { // set current memory edge to value
+                *current_edge(vm) = instruction->value;
+
+            } else if (isdigit((unsigned char)instruction->value)) {
+                // multiply the current memory edge by 10 and add the corresponding digit.
+                // if the current edge has a negative value, the digit is subtracted instead of added.
+                memory_edge *edge = current_edge(vm);
+                memory_edge shifted, result;
+                const int digit = instruction->value - '0';
+                const bool overflow = __builtin_mul_overflow(*edge, 10, &shifted)
+                                    | __builtin_add_overflow(shifted, shifted < 0 ? -digit : digit, &result);
+                if (overflow && vm->trap_overflow)
+                    return VM_OVERFLOW;
+                *edge = result;
+
+            } else switch (instruction->value) {
+
+                case '.': // no-op.
+                    break;
+
+                case '@': // terminates the program.
+                    vm->at_break = false;
+                    return VM_HALTED;
+
+                case ')': { // increments the current memory edge.
+                    memory_edge *edge = current_edge(vm), result;
+                    if (__builtin_add_overflow(*edge, 1, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *edge = result;
+                }   break;
+
+                case '(': { // decrements the current memory edge.
+                    memory_edge *edge = current_edge(vm), result;
+                    if (__builtin_sub_overflow(*edge, 1, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *edge = result;
+                }   break;
+
+                case '+': { // sets the current memory edge to the sum of the left and right neighbours.
+                    const memory_edge left = *neighbor_edge(vm, LEFT), right = *neighbor_edge(vm, RIGHT);
+                    memory_edge result;
+                    if (__builtin_add_overflow(left, right, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *current_edge(vm) = result;
+                }   break;
+
+                case '-': {  // sets the current memory edge to the difference of the left and right neighbours (left - right).
+                    const memory_edge left = *neighbor_edge(vm, LEFT), right = *neighbor_edge(vm, RIGHT);
+                    memory_edge result;
+                    if (__builtin_sub_overflow(left, right, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *current_edge(vm) = result;
+                }   break;
+
+                case '*': {  // sets the current memory edge to the product of the left and right neighbours.
+                    const memory_edge left = *neighbor_edge(vm, LEFT), right = *neighbor_edge(vm, RIGHT);
+                    memory_edge result;
+                    if (__builtin_mul_overflow(left, right, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *current_edge(vm) = result;
+                }   break;
+
+                case ':': { // sets the current memory edge to the quotient of the left and right neighbours (left / right).
+                    const memory_edge left = *neighbor_edge(vm, LEFT), right = *neighbor_edge(vm, RIGHT);
+                    if (right == 0)
+                        return VM_DIVIDE_BY_ZERO;
+                    if (left == MEMORY_EDGE_MIN && right == -1 && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    // the division instruction traps on that quotient instead of wrapping it around, like '~' does
+                    memory_edge result;
+                    if (right == -1)
+                        __builtin_mul_overflow(left, -1, &result);
+                    else
+                        result = left / right;
+                    *current_edge(vm) = result;
+                }   break;
+
+                case '%': { // sets the current memory edge to the modulo of the left and right neighbours (left % right)
+                    const memory_edge left = *neighbor_edge(vm, LEFT), right = *neighbor_edge(vm, RIGHT);
+                    if (right == 0)
+                        return VM_DIVIDE_BY_ZERO;
+                    // the remainder fits, but the division it comes from overflows like it does for ':'
+                    if (left == MEMORY_EDGE_MIN && right == -1 && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *current_edge(vm) = right == -1 ? 0 : left % right;
+                }   break;
+
+                case '~': { // multiplies the current memory edge by -1.
+                    memory_edge *edge = current_edge(vm), result;
+                    if (__builtin_mul_overflow(*edge, -1, &result) && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *edge = result;
+                }   break;
+
+                // reads a single byte from STDIN and sets the current memory edge to its value, or -1 if EOF reached.
+                case ',':
+                    if (vm->input_position < vm->input_length)
+                        *current_edge(vm) = (unsigned char)vm->input[vm->input_position++];
+                    else if (vm->input_closed)
+                        *current_edge(vm) = EOF;
+                    else
+                        return VM_INPUT;
+                    break;
+
+                // reads and discards from STDIN until a digit, a - or a + is found. Then reads as many characters
+                // as possible to form a valid (signed) decimal integer and sets the current memory edge to its
+                // value. Returns 0 once EOF is reached.
+                case '?': {
+                    if (!scan_number(vm))
+                        return VM_INPUT;
+                    const int64_t value = number_value(vm);
+                    if ((memory_edge)value != value && vm->trap_overflow)
+                        return VM_OVERFLOW;
+                    *current_edge(vm) = (memory_edge)value;
+                    vm->number.state = NUMBER_SKIP;
+                    vm->number.negative = false;
+                    vm->number.value = 0;
+                }   break;
+
+                case ';': { // takes the current memory edge modulo 256 (positive) and writes the corresponding byte to STDOUT.
+                    if (vm->output_length == vm->output_capacity)
+                        return VM_OUTPUT;
+                    const char byte = (char)modulo(*current_edge(vm), 256);
+                    if (!expected(vm, &byte, 1))
+                        return VM_MISMATCH;
+                    vm->output[vm->output_length++] = byte;
+                }   break;
+
+                case '!': { // writes the decimal representation of the current memory edge to STDOUT.
+                    char decimal[DECIMAL_LENGTH];
+                    const int length = snprintf(decimal, sizeof(decimal), "%lld", (long long)*current_edge(vm));
+                    if (vm->output_capacity - vm->output_length < (size_t)length)
+                        return VM_OUTPUT;
+                    if (!expected(vm, decimal, length))
+                        return VM_MISMATCH;
+                    memcpy(vm->output + vm->output_length, decimal, length);
+                    vm->output_length += length;
+                }   break;
+
+                case '$': // is a jump. When executed, the IP completely ignores the next command in its current direction.
+                    IP->ignore_next = true;
+                    break;
+
+                // /, \, _, | are mirrors. They reflect the IP in the direction you'd expect. For completeness, the
+                // following table shows how they deflect an incoming IP. The top row corresponds to the current
+                // direction of the IP, the left column to the mirror, and the table cell shows the outgoing
+                // direction of the IP:
+                //        cmd │ NW NE  E SE SW  W
+                //      ──────┼────────────────────
+                //         /  │  E NE NW  W SW SE
+                //         \  │ NW  W SW SE  E NE
+                //         _  │ SW SE  E NE NW  W
+                //         |  │ NE NW  W SW SE  E
+                case '/':
+                case '\\':
+                case '_':
+                case '|':
+                    trace_end = true;
+                    IP->direction = ip_turn(instruction->value, IP->direction, false);
+                    break;
+
+                // < and > act as either mirrors or branches, depending on the incoming direction. The cells
+                // indicated as ?? are where they act as branches. In these cases, if the current memory edge is
+                // positive, the IP takes a 60° right turn (e.g. < turns E into SE). If the current memory edge is
+                // zero or negative, the IP takes a 60° left turn (e.g. < turns E into NE).
+                //        cmd │ NW NE  E SE SW  W
+                //      ──────┼────────────────────
+                //         <  │  W SW ?? NW  W  E
+                //         >  │ SE  E  W  E NE ??
+                case '<':
+                case '>': {
+                    trace_end = true;
+                    bool positive = false;
+                    if (IP->direction == (instruction->value == '<' ? E : W)) {
+                        positive = *current_edge(vm) > 0;
+                        count_outcome(vm, instruction, positive);
+                    }
+                    IP->direction = ip_turn(instruction->value, IP->direction, positive);
+                }   break;
+
+
+                case '[': // switches to the previous IP
+                    vm->IP_index = modulo(vm->IP_index - 1, 6);
+                    report(vm, VM_EVENT_SWITCH, vm->IP_index);
+                    trace_end = true;
+                    break;
+
+                case ']': // switches to the next IP
+                    vm->IP_index = modulo(vm->IP_index + 1, 6);
+                    report(vm, VM_EVENT_SWITCH, vm->IP_index);
+                    trace_end = true;
+                    break;
+
+                case '#': { // takes the current memory edge modulo 6 and switches to the IP with that index.
+                    const int previous = vm->IP_index;
+                    vm->IP_index = modulo(*current_edge(vm), 6);
+                    count_outcome(vm, instruction, (vm->IP_index - previous + 6) % 6);
+                    if (vm->IP_index != previous)
+                        report(vm, VM_EVENT_SWITCH, vm->IP_index);
+                    trace_end = true;
+                }   break;
+
+                case '{': // moves the MP to the left neighbour.
+                    move_mp(&vm->MP, LEFT);
+                    break;
+
+                case '}': // moves the MP to the right neighbour.
+                    move_mp(&vm->MP, RIGHT);
+                    break;
+
+                case '"': // moves the MP backwards and to the left. This is equivalent to =}=.
+                    vm->MP.direction = vm->MP.direction == IN ? OUT : IN;
+                    move_mp(&vm->MP, RIGHT);
+                    vm->MP.direction = vm->MP.direction == IN ? OUT : IN;
+                    break;
+
+                case '\'': // moves the MP backwards and to the right. This is equivalent to ={=.
+                    vm->MP.direction = vm->MP.direction == IN ? OUT : IN;
+                    move_mp(&vm->MP, LEFT);
+                    vm->MP.direction = vm->MP.direction == IN ? OUT : IN;
+                    break;
+
+                // reverses the direction of the MP. (This doesn't affect the current memory edge, but changes which
+                // edges are considered the left and right neighbour.)
+                case '=':
+                    vm->MP.direction = vm->MP.direction == IN ? OUT : IN;
+                    break;
+
+                // moves the MP to the left neighbour if the current edge is zero or negative and to the right
+                // neighbour if it's positive.
+                case '^': {
+                    const bool positive = *current_edge(vm) > 0;
+                    count_outcome(vm, instruction, positive);
+                    move_mp(&vm->MP, positive ? RIGHT : LEFT);
+                }   break;
+
+                // copies the value of left neighbour into the current edge if the current edge is zero or
+                // negative and the value of the right neighbour if it's positive.
+                case '&': {
+                    const bool positive = *current_edge(vm) > 0;
+                    count_outcome(vm, instruction, positive);
+                    const memory_edge value = *neighbor_edge(vm, positive ? RIGHT : LEFT);
+                    *current_edge(vm) = value;
+                }   break;
+            }
+        }
+        vm->at_break = false;
+        vm->steps++;
+        switch (ip_step(program_rings, IP)) {
+        case IP_MOVED:
+            break;
+
+        case IP_WRAPPED:
+            trace_end = true;
+            break;
+
+        case IP_CORNER: { // which way it wraps depends on the edge
+            trace_end = true;
+            const bool positive = *current_edge(vm) > 0;
+            if (vm->branch_profile != NULL)
+                vm->branch_profile[axial_to_index(IP->p, IP->q, program_rings)].corner[positive]++;
+            ip_wrap(IP, positive);
+        }   break;
+        }
+        if (trace_end && vm->steps >= vm->step_limit)
+            return VM_YIELD;
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef HEXAGONY_VM_H
+#define HEXAGONY_VM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+enum axis { X, Y, Z };
+enum direction { NW, NE, E, SE, SW, W };
+enum neighbor { LEFT = -1, RIGHT = 1 };
+
+struct program_cell {
+    char value;
+    bool debug;
+};
+
+// the source code laid out on a hexagon, stored as sequential rows along the z axis
+struct program {
+    struct program_cell *cells;
+    long rings;
+    size_t size;
+};
+
+struct memory_pointer {
+    long p, q;
+    enum axis axis;
+    enum { IN, OUT } direction;
+};
+
+struct IP {
+    long p, q;
+    enum direction direction;
+    bool ignore_next;
+};
+
+// How often the choices that depend on the current memory edge went each way at one cell of a program. The branch
+// cases of < and >, '^', '&' and the wrap at a corner count 1 for a positive edge and 0 otherwise. '#' counts the IP
+// it switched to relative to the one that executed it, 0 for staying with the same IP and 1 for the next one.
+struct branch_site {
+    unsigned long instruction[6];
+    unsigned long corner[2];
+};
+
+// things a vm reports to its event hook as they happen
+enum vm_event {
+    VM_EVENT_SWITCH, // '[', ']' or '#' made another IP active, the value is its index
+    VM_EVENT_GROW,   // memory grew, the value is the number of rings it has now
+};
+
+// how far an interrupted '?' has got
+enum number_state { NUMBER_SKIP, NUMBER_SIGN, NUMBER_DIGITS };
+
+// reasons for vm_run() to return control to the host
+enum vm_status {
+    VM_HALTED,   // executed '@'
+    VM_INPUT,    // ',' or '?' needs more input than the host has provided
+    VM_OUTPUT,   // ';' or '!' does not fit in the remaining output buffer
+    VM_BREAK,    // about to execute a debug instruction
+    VM_YIELD,    // reached step_limit
+    VM_MISMATCH, // ';' or '!' would write something other than the expected output
+    VM_OVERFLOW, // an arithmetic instruction or '?' would overflow a memory edge and trap_overflow is set
+    VM_DIVIDE_BY_ZERO, // ':' or '%' would divide by zero, which it keeps returning as the vm cannot go on
+};
+
+extern const struct direction_offset {
+    long dp, dq;
+} direction_offset[];
+extern const char *direction_name[];
+extern const char *axis_name[];
+
+// the longest output of a single '!' for the memory_edge it is used with
+#define DECIMAL_LENGTH (sizeof(memory_edge) * 3 + 2)
+
+long modulo(long a, long b);
+ssize_t axial_to_index(long p, long q, long rings);
+size_t axial_to_mem_index(long p, long q);
+void move_mp(struct memory_pointer *ptr, enum neighbor neighbor);
+
+// how ip_step() moved an IP
+enum ip_move {
+    IP_MOVED,   // to the next cell in its direction
+    IP_WRAPPED, // around an edge of the hexagon
+    IP_CORNER,  // not at all, as it leaves through a corner and ip_wrap() needs to know the way
+};
+
+// The direction an IP leaves a mirror or a < or > in, and its direction for any other instruction. Where < and >
+// branch, positive says whether the current memory edge is positive.
+enum direction ip_turn(char instruction, enum direction direction, bool positive);
+// moves an IP one cell in its direction on a hexagon with rings rings, the way vm_run() does
+enum ip_move ip_step(long rings, struct IP *IP);
+// Moves an IP that leaves the hexagon in its direction to where it comes back in. Through a corner it wraps one way
+// if the current memory edge is positive and the other if it is not, elsewhere positive makes no difference.
+void ip_wrap(struct IP *IP, bool positive);
+
+// lays out source code on the smallest hexagon that fits it
+bool parse_program(struct program *program, const char *source, size_t length);
+void free_program(struct program *program);
+
+#endif
+
+// Everything that holds memory edges is compiled once for each width of them, with MEMORY_EDGE_BITS set to 32 or 64
+// before this header is included. The 32 bit vm has the plain names, vm-wide.h declares the 64 bit one with the
+// names prefixed by wide_.
+#ifndef MEMORY_EDGE_BITS
+#define MEMORY_EDGE_BITS 32
+#endif
+
+#if (MEMORY_EDGE_BITS == 32 && !defined(HEXAGONY_VM_32_H)) || (MEMORY_EDGE_BITS == 64 && !defined(HEXAGONY_VM_64_H))
+#if MEMORY_EDGE_BITS == 32
+#define HEXAGONY_VM_32_H
+typedef int32_t memory_edge;
+#else
+#define HEXAGONY_VM_64_H
+typedef int64_t memory_edge;
+#endif
+
+// Memory is defined as an infinite hexagonal grid where each egde is a value.
+// see https://www.redblobgames.com/grids/hexagons/ for terminology
+
+// In this implementation, memory is indexed with the axial coordinates of a
+// hexagonal grid. Each hexagon in the grid stores 3 values, one for each cubic
+// axis.
+
+struct memory_cell {
+    memory_edge value[3];
+};
+
+// The complete state of one running program. The vm never blocks: instructions that cannot complete with the
+// buffers the host has provided return a status instead, and the next call to vm_run() resumes at that instruction.
+struct vm {
+    const struct program *program;
+
+    struct IP IPs[6];
+    int IP_index;
+
+    struct memory_cell *memory;
+    long memory_rings;
+    struct memory_pointer MP;
+
+    // input span borrowed from the host, consumed from input_position
+    const char *input;
+    size_t input_length;
+    size_t input_position;
+    bool input_closed;
+
+    // partially read integer of an interrupted '?'
+    struct {
+        enum number_state state;
+        bool negative;
+        int64_t value; // wider than any memory edge, so that a number too large for one can be detected
+    } number;
+
+    // output buffer borrowed from the host, filled up to output_length
+    char *output;
+    size_t output_capacity;
+    size_t output_length;
+
+    // expected output span borrowed from the host, or NULL. expect_position counts the bytes written so far, and
+    // after VM_MISMATCH it is the offset of the first byte that differs.
+    const char *expect;
+    size_t expect_length;
+    size_t expect_position;
+
+    unsigned long steps;
+    // vm_run() yields once steps reaches this, checked only where a straight line run of instructions ends
+    unsigned long step_limit;
+    bool force_debug; // pause before every instruction
+    bool at_break;    // the current instruction has already been reported as VM_BREAK
+    // Return VM_OVERFLOW instead of wrapping around when a result does not fit in a memory edge, so that the host
+    // can carry on with a wider vm. The instruction is executed on the next call to vm_run() after the host clears
+    // this, with the result wrapped around. That includes ':' and '%' of the smallest edge by -1, which give the
+    // smallest edge and 0.
+    bool trap_overflow;
+    // one site for each cell of the program that the vm counts outcomes in, or NULL
+    struct branch_site *branch_profile;
+    // Called as the active IP changes and as memory grows, with the steps executed before the instruction doing it,
+    // or NULL. The hook must not change the vm.
+    void (*event_hook)(void *context, enum vm_event event, long value, unsigned long steps);
+    void *event_context;
+};
+
+struct memory_cell *realloc_memory(struct memory_cell *memory, long old_rings, long new_rings);
+struct memory_cell *get_memory_cell(long p, long q, struct memory_cell **memory, long *rings);
+memory_edge *get_memory_edge(struct memory_pointer ptr, struct memory_cell **memory, long *rings);
+memory_edge *get_neighbor(struct memory_pointer ptr, enum neighbor neighbor, struct memory_cell **memory, long *rings);
+
+bool vm_init(struct vm *vm, const struct program *program);
+// returns the vm to its initial state, reusing the memory it has already allocated
+bool vm_reset(struct vm *vm);
+void vm_free(struct vm *vm);
+// provide the next span of input, the vm keeps a pointer to it until it is consumed
+void vm_set_input(struct vm *vm, const char *input, size_t length);
+// signal end of input, reads see EOF once the provided input is consumed
+void vm_close_input(struct vm *vm);
+void vm_set_output(struct vm *vm, char *output, size_t capacity);
+// compare all output against the expected span as it is written, which the vm keeps a pointer to
+void vm_set_expected_output(struct vm *vm, const char *expect, size_t length);
+enum vm_status vm_run(struct vm *vm);
+
+#endif
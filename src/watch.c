@@ -0,0 +1,318 @@
+#include "watch.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "file.h"
+#include "io.h"
+
+#ifndef FIRST_CHECKPOINT_INTERVAL
+#define FIRST_CHECKPOINT_INTERVAL (1ul << 16) // steps between checkpoints, doubled whenever they run out
+#endif
+#define POLL_STEPS (1ul << 22)                // steps between looks at the files during a run
+#define POLL_INTERVAL_NS 100000000            // between looks at the files while waiting for a change
+
+// a file and its state when it was last read
+struct watched_file {
+    const char *name;
+    bool exists;
+    struct timespec modified;
+    off_t size;
+};
+
+static struct watched_file look_at(const char *name) {
+    struct watched_file file = {.name = name};
+    struct stat stat_buffer;
+    if (stat(name, &stat_buffer) == 0)
+        file = (struct watched_file){name, true, stat_buffer.st_mtim, stat_buffer.st_size};
+    return file;
+}
+
+static bool changed(const struct watched_file *file) {
+    if (file->name == NULL)
+        return false;
+    const struct watched_file now = look_at(file->name);
+    return now.exists != file->exists || now.size != file->size || now.modified.tv_sec != file->modified.tv_sec
+        || now.modified.tv_nsec != file->modified.tv_nsec;
+}
+
+static size_t memory_cells(long rings) {
+    return 3 * rings * (rings - 1) + 1;
+}
+
+static void free_checkpoints(struct watch *watch, int first) {
+    for (int i = first; i < watch->checkpoint_count; i++)
+        free(watch->checkpoints[i].vm.memory);
+    watch->checkpoint_count = first;
+}
+
+static bool take_checkpoint(struct watch *watch) {
+    if (watch->checkpoint_count == MAX_CHECKPOINTS) {
+        // keep every other checkpoint, twice as far apart
+        for (int i = 1; i < MAX_CHECKPOINTS; i += 2)
+            free(watch->checkpoints[i].vm.memory);
+        for (int i = 2; i < MAX_CHECKPOINTS; i += 2)
+            watch->checkpoints[i / 2] = watch->checkpoints[i];
+        watch->checkpoint_count = MAX_CHECKPOINTS / 2;
+        watch->checkpoint_interval *= 2;
+    }
+    const size_t size = memory_cells(watch->vm.memory_rings) * sizeof(struct memory_cell);
+    struct checkpoint *checkpoint = watch->checkpoints + watch->checkpoint_count;
+    checkpoint->vm = watch->vm;
+    checkpoint->vm.memory = malloc(size);
+    if (checkpoint->vm.memory == NULL)
+        return false;
+    memcpy(checkpoint->vm.memory, watch->vm.memory, size);
+    checkpoint->output_length = watch->io.output_length;
+    watch->checkpoint_count++;
+    return true;
+}
+
+// carries on from a checkpoint, dropping the ones after it
+static bool restore(struct watch *watch, int index) {
+    const struct checkpoint *checkpoint = watch->checkpoints + index;
+    const size_t size = memory_cells(checkpoint->vm.memory_rings) * sizeof(struct memory_cell);
+    struct memory_cell *memory = malloc(size);
+    if (memory == NULL)
+        return false;
+    memcpy(memory, checkpoint->vm.memory, size);
+    vm_free(&watch->vm);
+    watch->vm = checkpoint->vm;
+    watch->vm.memory = memory;
+    watch->io.output_length = checkpoint->output_length;
+    free_checkpoints(watch, index + 1);
+    // cells first executed after the checkpoint have not been executed by the run that carries on from it
+    for (size_t i = 0; i < watch->program.size; i++) {
+        if (watch->first_step[i] != ULONG_MAX && watch->first_step[i] >= checkpoint->vm.steps)
+            watch->first_step[i] = ULONG_MAX;
+    }
+    return true;
+}
+
+// starts a run from step 0
+static bool restart(struct watch *watch) {
+    free_checkpoints(watch, 0);
+    vm_free(&watch->vm);
+    if (!vm_init(&watch->vm, &watch->program))
+        return false;
+    vm_set_input(&watch->vm, watch->input, watch->input_length);
+    vm_close_input(&watch->vm);
+    watch->io.output_length = 0;
+    watch->checkpoint_interval = FIRST_CHECKPOINT_INTERVAL;
+    for (size_t i = 0; i < watch->program.size; i++)
+        watch->first_step[i] = ULONG_MAX;
+    return take_checkpoint(watch);
+}
+
+bool watch_init(struct watch *watch) {
+    *watch = (struct watch){0};
+    return io_init(&watch->io, NULL, 0, NULL, NULL, NULL);
+}
+
+void watch_free(struct watch *watch) {
+    free_checkpoints(watch, 0);
+    vm_free(&watch->vm);
+    io_free(&watch->io);
+    free_program(&watch->program);
+    free(watch->first_step);
+    free(watch->input);
+}
+
+void watch_input(struct watch *watch, char *input, size_t length) {
+    free(watch->input);
+    watch->input = input;
+    watch->input_length = length;
+    free_program(&watch->program);
+}
+
+// The cells that have not been executed yet are breakpoints, so that the first step at which each is executed can
+// be recorded.
+enum watch_end watch_run(struct watch *watch, unsigned long step_limit, bool (*poll)(void *context), void *context) {
+    struct vm *vm = &watch->vm;
+    for (size_t i = 0; i < watch->program.size; i++)
+        watch->program.cells[i].debug = watch->first_step[i] == ULONG_MAX;
+    unsigned long next_checkpoint = watch->checkpoints[watch->checkpoint_count - 1].vm.steps
+                                  + watch->checkpoint_interval;
+    unsigned long next_poll = vm->steps + POLL_STEPS;
+    while (true) {
+        vm->step_limit = next_checkpoint < next_poll ? next_checkpoint : next_poll;
+        if (step_limit < vm->step_limit)
+            vm->step_limit = step_limit;
+        switch (vm_run_io(vm, &watch->io)) {
+        case VM_HALTED:
+            return WATCH_HALTED;
+
+        case VM_DIVIDE_BY_ZERO:
+            return WATCH_DIVIDED;
+
+        case VM_BREAK: {
+            const struct IP *IP = vm->IPs + vm->IP_index;
+            const ssize_t index = axial_to_index(IP->p, IP->q, watch->program.rings);
+            watch->first_step[index] = vm->steps;
+            watch->program.cells[index].debug = false;
+        }   break;
+
+        case VM_YIELD:
+            if (vm->steps >= next_checkpoint) {
+                if (!take_checkpoint(watch))
+                    return WATCH_FAILED;
+                next_checkpoint = vm->steps + watch->checkpoint_interval;
+            }
+            if (vm->steps >= step_limit)
+                return WATCH_STEP_LIMIT;
+            if (vm->steps >= next_poll) {
+                if (poll != NULL && poll(context))
+                    return WATCH_CHANGED;
+                next_poll = vm->steps + POLL_STEPS;
+            }
+            break;
+
+        case VM_INPUT:  // cannot happen, all of the input is there
+        case VM_OUTPUT: // no memory left for the output
+            return WATCH_FAILED;
+
+        case VM_MISMATCH: // cannot happen, no output is expected
+        case VM_OVERFLOW: // cannot happen, overflows are not trapped
+            break;
+        }
+    }
+}
+
+// reads the input again, which makes the next program start again from step 0
+static bool load_input(struct watch *watch, struct watched_file *file) {
+    watch_input(watch, NULL, 0);
+    if (file->name == NULL)
+        return true;
+    *file = look_at(file->name);
+    size_t length;
+    char *input = read_file(file->name, &length);
+    if (input == NULL) {
+        perror(file->name);
+        return false;
+    }
+    watch_input(watch, input, length);
+    return true;
+}
+
+// Reads the program again and works out where the run can carry on from. Returns false if the program cannot be
+// read, and sets *rerun if the output can differ from the last run.
+static bool load_program(struct watch *watch, struct watched_file *file, bool *rerun) {
+    *file = look_at(file->name);
+    size_t length;
+    char *source = read_file(file->name, &length);
+    struct program program;
+    const bool parsed = source != NULL && parse_program(&program, source, length);
+    free(source);
+    if (!parsed) {
+        perror(file->name);
+        return false;
+    }
+    return watch_program(watch, program, rerun);
+}
+
+bool watch_program(struct watch *watch, struct program program, bool *rerun) {
+    if (watch->program.cells == NULL || program.rings != watch->program.rings) {
+        // the cells are laid out differently, nothing of the last run carries over
+        free_program(&watch->program);
+        watch->program = program;
+        free(watch->first_step);
+        watch->first_step = malloc(program.size * sizeof(unsigned long));
+        *rerun = true;
+        return watch->first_step != NULL && restart(watch);
+    }
+
+    unsigned long first_changed = ULONG_MAX;
+    for (size_t i = 0; i < program.size; i++) {
+        if (program.cells[i].value != watch->program.cells[i].value && watch->first_step[i] < first_changed)
+            first_changed = watch->first_step[i];
+    }
+    free_program(&watch->program);
+    watch->program = program;
+    *rerun = first_changed != ULONG_MAX;
+    if (!*rerun)
+        return true;
+    int checkpoint = watch->checkpoint_count - 1;
+    while (watch->checkpoints[checkpoint].vm.steps > first_changed)
+        checkpoint--;
+    return restore(watch, checkpoint);
+}
+
+// the poll of watch_run(), with the files as its context
+static bool files_changed(void *context) {
+    const struct watched_file *files = context;
+    return changed(files + 0) || changed(files + 1);
+}
+
+// waits until one of the files changes
+static void wait_for_change(const struct watched_file *files) {
+    const struct timespec interval = {0, POLL_INTERVAL_NS};
+    while (!changed(files + 0) && !changed(files + 1))
+        nanosleep(&interval, NULL);
+}
+
+static double milliseconds_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+bool run_watch(const char *program_file, const char *input_file, unsigned long step_limit) {
+    struct watch watch;
+    struct watched_file files[2] = {{.name = program_file}, {.name = input_file}};
+    if (!watch_init(&watch)) {
+        perror("Error allocating memory");
+        return false;
+    }
+
+    bool rerun;
+    // whether there is a run to carry on, which needs the input and a program that could be read
+    bool ready = load_input(&watch, files + 1) && load_program(&watch, files + 0, &rerun);
+    bool finished = false;
+    while (true) {
+        if (ready && !finished) {
+            const unsigned long resumed = watch.vm.steps;
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            const enum watch_end end = watch_run(&watch, step_limit, files_changed, files);
+            if (end == WATCH_FAILED) {
+                perror("Error running program");
+                break;
+            }
+            if (end != WATCH_CHANGED) {
+                fwrite(watch.io.output, 1, watch.io.output_length, stdout);
+                fflush(stdout);
+                fprintf(stderr, "\n%s after %lu steps, %lu of them run again in %.1f ms\n",
+                        end == WATCH_HALTED    ? "Halted"
+                        : end == WATCH_DIVIDED ? "Divided by zero"
+                                             : "Stopped at the step limit",
+                        watch.vm.steps,
+                        watch.vm.steps - resumed, milliseconds_since(&start));
+                finished = true;
+                wait_for_change(files);
+            }
+        } else {
+            wait_for_change(files);
+        }
+
+        if (changed(files + 1) || !ready) {
+            // other input, or nothing to carry on from, starts over whether or not the program changed too
+            ready = load_input(&watch, files + 1) && load_program(&watch, files + 0, &rerun);
+            finished = false;
+        } else if (load_program(&watch, files + 0, &rerun)) {
+            // A program that cannot be read leaves the last one in place, so that the run can carry on from where it
+            // was once it can be read again. A run cut short by the change carries on even if none of the cells it
+            // executed changed.
+            if (rerun)
+                finished = false;
+            else if (finished)
+                fputs("None of the cells that were executed changed\n", stderr);
+        }
+    }
+
+    watch_free(&watch);
+    return false;
+}
@@ -0,0 +1,55 @@
+#ifndef HEXAGONY_WATCH_H
+#define HEXAGONY_WATCH_H
+
+#include <stdbool.h>
+
+#include "io.h"
+
+#define MAX_CHECKPOINTS 32
+
+// the state of a run at some step, with a copy of the memory of its own
+struct checkpoint {
+    struct vm vm;
+    size_t output_length;
+};
+
+// A run that is kept between versions of the program, so that the next version can carry on from a checkpoint. The
+// output of the run is in io.
+struct watch {
+    struct program program;
+    char *input;
+    size_t input_length;
+    unsigned long *first_step; // at which each cell was executed first, ULONG_MAX for cells not executed yet
+
+    struct vm vm;
+    struct vm_io io;
+    struct checkpoint checkpoints[MAX_CHECKPOINTS];
+    int checkpoint_count;
+    unsigned long checkpoint_interval;
+};
+
+enum watch_end { WATCH_HALTED, WATCH_DIVIDED, WATCH_STEP_LIMIT, WATCH_CHANGED, WATCH_FAILED };
+
+// Sets up a watch with no input and no program. Returns false if no memory is left.
+bool watch_init(struct watch *watch);
+void watch_free(struct watch *watch);
+// Takes over the input of the runs, which makes the next program start again from step 0.
+void watch_input(struct watch *watch, char *input, size_t length);
+// Takes over the next version of the program and works out where the run can carry on from. Sets *rerun if the
+// output can differ from the last run. Returns false if no memory is left.
+bool watch_program(struct watch *watch, struct program program, bool *rerun);
+// Runs on until the program halts, divides by zero or reaches the step limit. Unless poll is NULL, it is called every
+// few million steps and the run stops with WATCH_CHANGED once it returns true. WATCH_FAILED is for no memory left.
+enum watch_end watch_run(struct watch *watch, unsigned long step_limit, bool (*poll)(void *context), void *context);
+
+// Runs a program on the contents of input_file, or on no input if it is NULL, and runs it again whenever either file
+// changes, until interrupted. Each run prints its output to stdout and a summary to stderr, and stops after
+// step_limit steps if it has not halted.
+//
+// Runs are incremental. Every run records the first step at which each cell is executed and takes checkpoints of
+// the vm as it goes. When only cells of the program change and it still fits on the same hexagon, the run before is
+// correct up to the first step that executed a changed cell, so the new run carries on from the last checkpoint
+// before that step. Changing the input or the size of the hexagon starts again from step 0.
+bool run_watch(const char *program_file, const char *input_file, unsigned long step_limit);
+
+#endif
@@ -0,0 +1,111 @@
+#include "width.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool widen_vm(struct wide_vm *wide, const struct vm *vm) {
+    const size_t cells = 3 * vm->memory_rings * (vm->memory_rings - 1) + 1;
+    struct wide_memory_cell *memory = malloc(cells * sizeof(struct wide_memory_cell));
+    if (memory == NULL)
+        return false;
+    for (size_t i = 0; i < cells; i++) {
+        memory[i].value[X] = vm->memory[i].value[X];
+        memory[i].value[Y] = vm->memory[i].value[Y];
+        memory[i].value[Z] = vm->memory[i].value[Z];
+    }
+    *wide = (struct wide_vm){
+        .program = vm->program,
+        .IP_index = vm->IP_index,
+        .memory = memory,
+        .memory_rings = vm->memory_rings,
+        .MP = vm->MP,
+        .input = vm->input,
+        .input_length = vm->input_length,
+        .input_position = vm->input_position,
+        .input_closed = vm->input_closed,
+        .number = {vm->number.state, vm->number.negative, vm->number.value},
+        .output = vm->output,
+        .output_capacity = vm->output_capacity,
+        .output_length = vm->output_length,
+        .expect = vm->expect,
+        .expect_length = vm->expect_length,
+        .expect_position = vm->expect_position,
+        .steps = vm->steps,
+        .step_limit = vm->step_limit,
+        .force_debug = vm->force_debug,
+        .at_break = vm->at_break,
+        .branch_profile = vm->branch_profile,
+        .event_hook = vm->event_hook,
+        .event_context = vm->event_context,
+    };
+    for (int i = 0; i < 6; i++)
+        wide->IPs[i] = vm->IPs[i];
+    return true;
+}
+
+// strchr() alone would also find the terminating '\0', which is a no-op in a program
+static bool is_one_of(char instruction, const char *instructions) {
+    return instruction != '\0' && strchr(instructions, instruction) != NULL;
+}
+
+static void count_overflows(struct value_profile *profile, __int128 exact) {
+    if (exact < INT32_MIN || exact > INT32_MAX)
+        profile->overflows_32++;
+    if (exact < INT64_MIN || exact > INT64_MAX)
+        profile->overflows_64++;
+}
+
+void profile_instruction(struct value_profile *profile, struct wide_vm *vm) {
+    if (profile->pending) {
+        const int64_t value = *wide_get_memory_edge(profile->last_store, &vm->memory, &vm->memory_rings);
+        if (!profile->stored || value < profile->min)
+            profile->min = value;
+        if (!profile->stored || value > profile->max)
+            profile->max = value;
+        profile->stored = true;
+        profile->pending = false;
+    }
+
+    const struct program *program = vm->program;
+    const struct IP *IP = vm->IPs + vm->IP_index;
+    const char instruction = program->cells[axial_to_index(IP->p, IP->q, program->rings)].value;
+    // reading an edge can allocate memory, so only the edges the instruction reads itself are looked at
+    __int128 current = 0, left = 0, right = 0;
+    if (isdigit((unsigned char)instruction) || is_one_of(instruction, ")(~"))
+        current = *wide_get_memory_edge(vm->MP, &vm->memory, &vm->memory_rings);
+    if (is_one_of(instruction, "+-*:")) {
+        left = *wide_get_neighbor(vm->MP, LEFT, &vm->memory, &vm->memory_rings);
+        right = *wide_get_neighbor(vm->MP, RIGHT, &vm->memory, &vm->memory_rings);
+    }
+    if (isdigit((unsigned char)instruction)) {
+        // the same rule as the vm: a digit is subtracted from a negative edge
+        const __int128 shifted = current * 10;
+        count_overflows(profile, shifted + (shifted < 0 ? -1 : 1) * (instruction - '0'));
+    } else switch (instruction) {
+        case ')': count_overflows(profile, current + 1); break;
+        case '(': count_overflows(profile, current - 1); break;
+        case '~': count_overflows(profile, -current); break;
+        case '+': count_overflows(profile, left + right); break;
+        case '-': count_overflows(profile, left - right); break;
+        case '*': count_overflows(profile, left * right); break;
+        case ':':
+            if (right != 0) // division by zero ends the run
+                count_overflows(profile, left / right);
+            break;
+    }
+
+    // every instruction that writes a value writes it to the current edge, and none of them moves the MP
+    if (isalnum((unsigned char)instruction) || is_one_of(instruction, ")(+-*:%~,?&")) {
+        profile->pending = true;
+        profile->last_store = vm->MP;
+    }
+}
+
+int narrowest_width(const struct value_profile *profile) {
+    if (profile->overflows_64 > 0)
+        return 0;
+    if (profile->overflows_32 > 0 || (profile->stored && (profile->min < INT32_MIN || profile->max > INT32_MAX)))
+        return 64;
+    return 32;
+}
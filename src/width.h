@@ -0,0 +1,28 @@
+#ifndef HEXAGONY_WIDTH_H
+#define HEXAGONY_WIDTH_H
+
+#include "vm-wide.h"
+
+// Copies a vm into a new wide vm that carries on from the same point, usually the instruction the vm returned
+// VM_OVERFLOW on. The wide vm borrows the same input, output and expected output spans and does not trap overflows.
+bool widen_vm(struct wide_vm *wide, const struct vm *vm);
+
+// the values stored by a run of the wide vm
+struct value_profile {
+    bool stored; // whether min and max hold anything
+    int64_t min, max;
+    unsigned long overflows_32; // arithmetic instructions and digits whose result does not fit in 32 bits
+    unsigned long overflows_64; // or in 64 bits, after which the values are no longer exact
+
+    bool pending;                // whether the last instruction stored a value at last_store
+    struct memory_pointer last_store;
+};
+
+// Records the instruction a wide vm running with force_debug is about to execute, and the value the instruction
+// before it stored. Call it on every VM_BREAK.
+void profile_instruction(struct value_profile *profile, struct wide_vm *vm);
+
+// the narrowest width of memory edges that gives the profiled run the same results, 32 or 64, or 0 if neither does
+int narrowest_width(const struct value_profile *profile);
+
+#endif
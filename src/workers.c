@@ -0,0 +1,307 @@
+#include "workers.h"
+#include "records.h"
+#include "sandbox.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SLOT_INPUT_SIZE (1 << 20)  // longest record a worker accepts
+#define SLOT_OUTPUT_SIZE (1 << 20) // longest output kept for a record
+#define WORKER_MEMORY_LIMIT (1L << 30) // address space of a worker, so runaway memory growth only kills the worker
+#define COLLECT_INTERVAL_NS 20000000 // how often dead workers are looked for while waiting for results
+
+enum slot_state { SLOT_IDLE, SLOT_BUSY, SLOT_DONE, SLOT_QUIT };
+
+// one job queue entry per worker, in memory shared between the parent and all workers
+struct slot {
+    sem_t start;
+    atomic_int state;
+    size_t job;
+    size_t input_length;
+    size_t output_length;
+    bool truncated; // the output did not fit in the slot
+    bool divided;   // the run stopped at a division by zero
+    char input[SLOT_INPUT_SIZE];
+    char output[SLOT_OUTPUT_SIZE];
+};
+
+struct shared {
+    sem_t done; // posted by a worker whenever it finishes a job
+    struct slot slots[];
+};
+
+// a finished job waiting for the jobs before it to be written
+struct result {
+    bool ready;
+    char *output;
+    size_t output_length;
+};
+
+struct workers {
+    const struct program *program;
+    struct shared *shared;
+    pid_t *pids;
+    int count;
+    char delimiter;
+    bool delimit_output;
+    bool sandbox;
+
+    size_t next_job;
+    // results of jobs from next_write onwards, indexed relative to next_write
+    size_t next_write;
+    struct result *results;
+    size_t results_capacity;
+    bool failed;
+};
+
+static void run_worker(const struct program *program, struct shared *shared, struct slot *slot, bool sandbox) {
+    const struct rlimit limit = {WORKER_MEMORY_LIMIT, WORKER_MEMORY_LIMIT};
+    setrlimit(RLIMIT_AS, &limit);
+    struct vm vm;
+    if (!vm_init(&vm, program))
+        _exit(EXIT_FAILURE);
+    // a worker only touches the shared slots, so it needs nothing but the semaphores
+    if (sandbox && !enter_sandbox(SANDBOX_FUTEX))
+        _exit(EXIT_FAILURE);
+    while (true) {
+        while (sem_wait(&slot->start) != 0)
+            ;
+        if (atomic_load(&slot->state) == SLOT_QUIT)
+            _exit(EXIT_SUCCESS);
+
+        // the record is read from and the output written to the shared slot directly
+        if (!vm_reset(&vm))
+            _exit(EXIT_FAILURE);
+        vm_set_input(&vm, slot->input, slot->input_length);
+        vm_close_input(&vm);
+        vm_set_output(&vm, slot->output, SLOT_OUTPUT_SIZE);
+        enum vm_status status;
+        while ((status = vm_run(&vm)) == VM_BREAK || status == VM_YIELD)
+            ;
+        slot->output_length = vm.output_length;
+        slot->truncated = status == VM_OUTPUT;
+        slot->divided = status == VM_DIVIDE_BY_ZERO;
+        atomic_store(&slot->state, SLOT_DONE);
+        sem_post(&shared->done);
+    }
+}
+
+static bool start_worker(struct workers *workers, int index) {
+    struct slot *slot = workers->shared->slots + index;
+    if (sem_init(&slot->start, 1, 0) != 0)
+        return false;
+    atomic_store(&slot->state, SLOT_IDLE);
+    const pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+        run_worker(workers->program, workers->shared, slot, workers->sandbox);
+    workers->pids[index] = pid;
+    return true;
+}
+
+// the result entry of a job, growing the reorder buffer as needed
+static struct result *result_of(struct workers *workers, size_t job) {
+    const size_t offset = job - workers->next_write;
+    if (offset >= workers->results_capacity) {
+        size_t capacity = workers->results_capacity ? workers->results_capacity * 2 : 16;
+        while (capacity <= offset)
+            capacity *= 2;
+        struct result *results = realloc(workers->results, capacity * sizeof(struct result));
+        if (results == NULL)
+            return NULL;
+        memset(results + workers->results_capacity, 0,
+               (capacity - workers->results_capacity) * sizeof(struct result));
+        workers->results = results;
+        workers->results_capacity = capacity;
+    }
+    return workers->results + offset;
+}
+
+static void write_result(struct workers *workers, const char *output, size_t length) {
+    fwrite(output, 1, length, stdout);
+    if (workers->delimit_output)
+        putchar(workers->delimiter);
+    workers->next_write++;
+}
+
+// writes out the results that are next in line
+static void write_ready(struct workers *workers) {
+    size_t written = 0;
+    while (written < workers->results_capacity && workers->results[written].ready) {
+        write_result(workers, workers->results[written].output, workers->results[written].output_length);
+        free(workers->results[written].output);
+        written++;
+    }
+    memmove(workers->results, workers->results + written,
+            (workers->results_capacity - written) * sizeof(struct result));
+    memset(workers->results + workers->results_capacity - written, 0, written * sizeof(struct result));
+}
+
+// takes the result of a job, writing it straight from where it is if it is next in line
+static void finish_job(struct workers *workers, size_t job, const char *output, size_t length) {
+    if (job == workers->next_write) {
+        write_result(workers, output, length);
+        if (workers->results_capacity > 0) {
+            memmove(workers->results, workers->results + 1, (workers->results_capacity - 1) * sizeof(struct result));
+            memset(workers->results + workers->results_capacity - 1, 0, sizeof(struct result));
+        }
+        write_ready(workers);
+    } else {
+        struct result *result = result_of(workers, job);
+        char *copy = malloc(length);
+        if (result == NULL || (copy == NULL && length > 0)) {
+            perror("Error allocating memory");
+            free(copy);
+            workers->failed = true;
+        } else {
+            memcpy(copy, output, length);
+            *result = (struct result){.ready = true, .output = copy, .output_length = length};
+        }
+    }
+}
+
+// takes the result of a job out of its slot and frees the slot for the next one
+static void finish_slot(struct workers *workers, struct slot *slot, const char *output, size_t length) {
+    finish_job(workers, slot->job, output, length);
+    atomic_store(&slot->state, SLOT_IDLE);
+}
+
+// Waits until at least one job has finished or a worker has died, then handles every finished job and restarts dead
+// workers. The job of a dead worker produces no output.
+static void collect(struct workers *workers) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += COLLECT_INTERVAL_NS;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    while (sem_timedwait(&workers->shared->done, &deadline) != 0 && errno == EINTR)
+        ;
+
+    for (int i = 0; i < workers->count; i++) {
+        struct slot *slot = workers->shared->slots + i;
+        if (atomic_load(&slot->state) != SLOT_DONE)
+            continue;
+        if (slot->truncated)
+            fprintf(stderr, "Record %zu: output truncated to %d bytes\n", slot->job + 1, SLOT_OUTPUT_SIZE);
+        if (slot->divided)
+            fprintf(stderr, "Record %zu: division by zero\n", slot->job + 1);
+        finish_slot(workers, slot, slot->output, slot->output_length);
+    }
+
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        for (int i = 0; i < workers->count; i++) {
+            if (workers->pids[i] != pid)
+                continue;
+            struct slot *slot = workers->shared->slots + i;
+            if (atomic_load(&slot->state) == SLOT_DONE) // finished right before dying
+                finish_slot(workers, slot, slot->output, slot->output_length);
+            if (atomic_load(&slot->state) == SLOT_BUSY) {
+                if (WIFSIGNALED(status))
+                    fprintf(stderr, "Record %zu: worker killed by signal %d (%s)\n", slot->job + 1, WTERMSIG(status),
+                            strsignal(WTERMSIG(status)));
+                else
+                    fprintf(stderr, "Record %zu: worker exited with status %d\n", slot->job + 1, WEXITSTATUS(status));
+                finish_slot(workers, slot, NULL, 0);
+            }
+            sem_destroy(&slot->start);
+            if (!start_worker(workers, i)) {
+                perror("Error restarting worker");
+                workers->pids[i] = -1;
+                workers->failed = true;
+            }
+        }
+    }
+}
+
+static bool handle_record(void *context, const char *record, size_t length) {
+    struct workers *workers = context;
+    if (length > SLOT_INPUT_SIZE) { // fails like a record that crashes its worker
+        fprintf(stderr, "Record %zu: longer than %d bytes\n", workers->next_job + 1, SLOT_INPUT_SIZE);
+        finish_job(workers, workers->next_job++, NULL, 0);
+        return !workers->failed;
+    }
+    while (!workers->failed) {
+        for (int i = 0; i < workers->count; i++) {
+            struct slot *slot = workers->shared->slots + i;
+            if (workers->pids[i] < 0 || atomic_load(&slot->state) != SLOT_IDLE)
+                continue;
+            slot->job = workers->next_job++;
+            slot->input_length = length;
+            memcpy(slot->input, record, length);
+            atomic_store(&slot->state, SLOT_BUSY);
+            sem_post(&slot->start);
+            return true;
+        }
+        collect(workers);
+    }
+    return false;
+}
+
+bool run_workers(const struct program *program, int count, char delimiter, bool delimit_output, bool sandbox) {
+    const size_t shared_size = sizeof(struct shared) + count * sizeof(struct slot);
+    struct shared *shared = mmap(NULL, shared_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+        perror("Error allocating shared memory");
+        return false;
+    }
+    struct workers workers = {
+        .program = program,
+        .shared = shared,
+        .pids = malloc(count * sizeof(pid_t)),
+        .count = count,
+        .delimiter = delimiter,
+        .delimit_output = delimit_output,
+        .sandbox = sandbox,
+    };
+    bool success = workers.pids != NULL && sem_init(&shared->done, 1, 0) == 0;
+    // output buffered by the parent must not be flushed a second time by every worker
+    fflush(stdout);
+    for (int i = 0; i < count; i++)
+        workers.pids[i] = -1;
+    for (int i = 0; success && i < count; i++)
+        success = start_worker(&workers, i);
+    if (!success)
+        perror("Error starting workers");
+
+    success = success && read_records(delimiter, handle_record, &workers);
+    // wait for the jobs still running
+    bool busy = true;
+    while (busy && !workers.failed) {
+        busy = false;
+        for (int i = 0; i < count; i++)
+            busy |= workers.pids[i] >= 0 && atomic_load(&shared->slots[i].state) != SLOT_IDLE;
+        if (busy)
+            collect(&workers);
+    }
+
+    for (int i = 0; workers.pids != NULL && i < count; i++) {
+        if (workers.pids[i] < 0)
+            continue;
+        atomic_store(&shared->slots[i].state, SLOT_QUIT);
+        sem_post(&shared->slots[i].start);
+        waitpid(workers.pids[i], NULL, 0);
+        sem_destroy(&shared->slots[i].start);
+    }
+    for (size_t i = 0; i < workers.results_capacity; i++)
+        free(workers.results[i].output);
+    free(workers.results);
+    free(workers.pids);
+    sem_destroy(&shared->done);
+    munmap(shared, shared_size);
+    return success && !workers.failed;
+}
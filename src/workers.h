@@ -0,0 +1,12 @@
+#ifndef HEXAGONY_WORKERS_H
+#define HEXAGONY_WORKERS_H
+
+#include "vm.h"
+
+// Like run_per_record(), but every record runs in one of count preforked worker processes. Records and results are
+// passed through shared memory. A record that crashes its worker only loses its own output, and the worker is
+// replaced with a fresh one. A record longer than a slot holds is not run and loses its output the same way. With
+// sandbox set, every worker runs the program under enter_sandbox() while the parent keeps doing the I/O.
+bool run_workers(const struct program *program, int count, char delimiter, bool delimit_output, bool sandbox);
+
+#endif
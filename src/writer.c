@@ -0,0 +1,180 @@
+#ifdef __linux__
+#define _GNU_SOURCE // vmsplice and F_SETPIPE_SZ
+#endif
+#include "writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+static bool write_all(int fd, const char *data, size_t length) {
+    for (size_t written = 0; written < length;) {
+        const ssize_t n = write(fd, data + written, length - written);
+        if (n < 0 && errno != EINTR)
+            return false;
+        if (n > 0)
+            written += n;
+    }
+    return true;
+}
+
+#ifdef F_SETPIPE_SZ
+
+static bool splice_all(int fd, char *data, size_t length) {
+    struct iovec iov = {data, length};
+    while (iov.iov_len > 0) {
+        const ssize_t n = vmsplice(fd, &iov, 1, 0);
+        if (n < 0 && errno != EINTR)
+            return false;
+        if (n > 0) {
+            iov.iov_base = (char *)iov.iov_base + n;
+            iov.iov_len -= n;
+        }
+    }
+    return true;
+}
+
+// whether fd is a pipe that now holds exactly one buffer
+static bool can_splice(int fd) {
+    struct stat stat;
+    return fstat(fd, &stat) == 0 && S_ISFIFO(stat.st_mode)
+        && fcntl(fd, F_SETPIPE_SZ, WRITER_BUFFER_SIZE) == WRITER_BUFFER_SIZE;
+}
+
+#else
+
+static bool splice_all(int fd, char *data, size_t length) {
+    return write_all(fd, data, length);
+}
+
+static bool can_splice(int fd) {
+    (void)fd;
+    return false;
+}
+
+#endif
+
+static void *run_writer(void *argument) {
+    struct writer *writer = argument;
+    pthread_mutex_lock(&writer->lock);
+    while (true) {
+        while (writer->queue_length == 0 && !writer->stopping)
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        if (writer->queue_length == 0)
+            break;
+        const int buffer = writer->queue[writer->queue_head];
+        writer->queue_head = (writer->queue_head + 1) % WRITER_BUFFERS;
+        writer->queue_length--;
+        writer->writing = true;
+        const bool failed = writer->failed;
+        pthread_mutex_unlock(&writer->lock);
+
+        // partial buffers are flushed before input and at the end, and are copied so that they are free at once
+        const bool spliced = !failed && writer->splice && writer->lengths[buffer] == WRITER_BUFFER_SIZE;
+        bool written = true;
+        if (spliced)
+            written = splice_all(writer->fd, writer->buffers[buffer], WRITER_BUFFER_SIZE);
+        else if (!failed)
+            written = write_all(writer->fd, writer->buffers[buffer], writer->lengths[buffer]);
+        const int error = errno;
+
+        pthread_mutex_lock(&writer->lock);
+        writer->writing = false;
+        if (!written && !writer->failed) {
+            writer->failed = true;
+            writer->error = error;
+        }
+        if (spliced && written) {
+            if (writer->in_pipe >= 0)
+                writer->busy[writer->in_pipe] = false;
+            writer->in_pipe = buffer;
+        } else {
+            writer->busy[buffer] = false;
+        }
+        pthread_cond_broadcast(&writer->changed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+char *writer_start(struct writer *writer, int fd) {
+    *writer = (struct writer){.fd = fd, .splice = can_splice(fd), .in_pipe = -1};
+    for (int i = 0; i < WRITER_BUFFERS; i++) {
+        writer->buffers[i] =
+            mmap(NULL, WRITER_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (writer->buffers[i] == MAP_FAILED) {
+            while (i-- > 0)
+                munmap(writer->buffers[i], WRITER_BUFFER_SIZE);
+            return NULL;
+        }
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    if (pthread_create(&writer->thread, NULL, run_writer, writer) != 0) {
+        for (int i = 0; i < WRITER_BUFFERS; i++)
+            munmap(writer->buffers[i], WRITER_BUFFER_SIZE);
+        return NULL;
+    }
+    writer->busy[0] = true;
+    return writer->buffers[0];
+}
+
+bool writer_submit(struct writer *writer, char **buffer, size_t length) {
+    pthread_mutex_lock(&writer->lock);
+    int submitted = 0;
+    while (writer->buffers[submitted] != *buffer)
+        submitted++;
+    if (length > 0) {
+        writer->lengths[submitted] = length;
+        writer->queue[(writer->queue_head + writer->queue_length) % WRITER_BUFFERS] = submitted;
+        writer->queue_length++;
+        pthread_cond_broadcast(&writer->changed);
+    } else {
+        writer->busy[submitted] = false;
+    }
+    int next;
+    while (true) {
+        for (next = 0; next < WRITER_BUFFERS && writer->busy[next]; next++)
+            ;
+        if (next < WRITER_BUFFERS)
+            break;
+        pthread_cond_wait(&writer->changed, &writer->lock);
+    }
+    writer->busy[next] = true;
+    *buffer = writer->buffers[next];
+    const bool failed = writer->failed;
+    pthread_mutex_unlock(&writer->lock);
+    if (failed)
+        errno = writer->error;
+    return !failed;
+}
+
+bool writer_drain(struct writer *writer) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->queue_length > 0 || writer->writing)
+        pthread_cond_wait(&writer->changed, &writer->lock);
+    const bool failed = writer->failed;
+    pthread_mutex_unlock(&writer->lock);
+    if (failed)
+        errno = writer->error;
+    return !failed;
+}
+
+bool writer_stop(struct writer *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->stopping = true;
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+    // pages still in the pipe keep their contents after they are unmapped
+    for (int i = 0; i < WRITER_BUFFERS; i++)
+        munmap(writer->buffers[i], WRITER_BUFFER_SIZE);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->changed);
+    if (writer->failed)
+        errno = writer->error;
+    return !writer->failed;
+}
@@ -0,0 +1,50 @@
+#ifndef HEXAGONY_WRITER_H
+#define HEXAGONY_WRITER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WRITER_BUFFERS 3
+#ifndef WRITER_BUFFER_SIZE
+#define WRITER_BUFFER_SIZE (256 * 1024) // a multiple of the page size
+#endif
+
+// A thread that writes buffers of output to a file descriptor while the vm fills the next buffer. The vm only waits
+// once it has filled its buffer while the thread is still writing the one before.
+//
+// When the file descriptor is a pipe whose capacity can be set to one buffer, full buffers are passed to it with
+// vmsplice(), which maps their pages into the pipe instead of copying them. The pages stay in use until the reader
+// has consumed them, and once the next full buffer has gone into the pipe, all of the one before must have been
+// consumed. So one buffer may be held by the pipe, one is being written and the vm fills the third. A reader that
+// splices the pages on instead of reading them could still see them change, the same as with any use of vmsplice.
+struct writer {
+    int fd;
+    bool splice;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    char *buffers[WRITER_BUFFERS];
+    size_t lengths[WRITER_BUFFERS];
+    bool busy[WRITER_BUFFERS]; // being filled, queued, being written or still in the pipe
+    int queue[WRITER_BUFFERS]; // buffers to write, in order
+    int queue_head, queue_length;
+    bool writing;
+    int in_pipe; // the last buffer passed with vmsplice(), or -1
+    bool stopping;
+    bool failed; // a write failed, with its errno in error, everything after it is dropped
+    int error;
+};
+
+// Starts a writer on fd and returns the first buffer to fill, or NULL if it could not be started.
+char *writer_start(struct writer *writer, int fd);
+// Queues a filled buffer and replaces it with the next one to fill, waiting until one is free. Returns false if a
+// write has failed, with errno set.
+bool writer_submit(struct writer *writer, char **buffer, size_t length);
+// waits until everything queued has been written, and returns false if a write failed, with errno set
+bool writer_drain(struct writer *writer);
+// drains the writer and stops its thread
+bool writer_stop(struct writer *writer);
+
+#endif
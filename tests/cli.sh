@@ -0,0 +1,31 @@
+#!/bin/sh
+# Checks the modes of the interpreter that run records in other processes, which the conformance suite cannot drive
+# from inside one process. `make test` runs it with the interpreter to check.
+hexagony=$1
+failures=0
+
+# check NAME EXPECTED ACTUAL
+check() {
+    if [ "$2" != "$3" ]; then
+        printf '%s: got "%s", expected "%s"\n' "$1" "$3" "$2"
+        failures=$((failures + 1))
+    fi
+}
+
+# prints a record of n copies of x
+record() {
+    head -c "$1" /dev/zero | tr '\0' x
+}
+
+# A record longer than a worker slot fails on its own, and the records around it still run. One that just fits runs.
+errors=$(mktemp)
+output=$({ printf 'ab\n'; record 1048577; printf '\ncd\n'; record 1048576; printf '\n'; } |
+    "$hexagony" --per-record --workers 2 --delimit-output ./test-cases/io.hxg 2> "$errors" | tr '\n' ' ')
+check "oversized record" "a0  c0 x0 " "$output"
+check "oversized record message" "Record 2: longer than 1048576 bytes" "$(cat "$errors")"
+rm -f "$errors"
+
+if [ $failures -gt 0 ]; then
+    exit 1
+fi
+echo "command line: ok"
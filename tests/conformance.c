@@ -0,0 +1,753 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/file.h"
+#include "../src/io.h"
+#include "../src/pipeline.h"
+#include "../src/simt.h"
+#include "../src/vm.h"
+#include "../src/watch.h"
+#include "conformance.h"
+
+#define DEFAULT_PROGRAMS 2000
+#define MAX_INPUTS SIMT_LANES // inputs per generated program, one lockstep batch
+#define MAX_INPUT_LENGTH 32
+#define MAX_STEPS 1000      // step budget of generated programs, which can grow memory a ring per step
+#define CASE_STEPS 10000000 // step budget of the checked-in cases
+#define EDITED_STEPS 100    // steps the watched engine runs an edited program past the change
+
+struct engine {
+    const char *name;
+    run_function *run;
+    bool wide; // only agrees with the reference on runs whose values all fit in 32 bits
+};
+
+static uint64_t random_state;
+
+static uint64_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 7;
+    random_state ^= random_state << 17;
+    return random_state;
+}
+
+static size_t random_below(size_t n) {
+    return next_random() % n;
+}
+
+static void free_results(struct result *results, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(results[i].output);
+        free(results[i].memory);
+    }
+}
+
+// takes over the output and a copy of the memory of a finished vm
+static bool finish(struct vm *vm, enum vm_status status, struct result *result) {
+    const size_t size = 3 * vm->memory_rings * (vm->memory_rings - 1) + 1;
+    *result = (struct result){
+        .status = status,
+        .steps = vm->steps,
+        .output = vm->output,
+        .output_length = vm->output_length,
+        .memory = malloc(size * sizeof(struct memory_cell)),
+        .memory_rings = vm->memory_rings,
+    };
+    if (result->memory != NULL)
+        memcpy(result->memory, vm->memory, size * sizeof(struct memory_cell));
+    vm_free(vm);
+    return result->memory != NULL;
+}
+
+// doubles the output buffer of a vm, keeping what it holds
+static bool grow_output(struct vm *vm) {
+    const size_t capacity = vm->output_capacity ? vm->output_capacity * 2 : 64;
+    char *output = realloc(vm->output, capacity);
+    if (output == NULL)
+        return false;
+    vm->output = output;
+    vm->output_capacity = capacity;
+    return true;
+}
+
+// The reference: every input is given at once, the output buffer grows whenever it is full, and breakpoints are run
+// through. Overflows are trapped only to note that there was one, the run carries on wrapping around.
+static bool run_reference(const struct program *program, const struct input *inputs, size_t count,
+                          unsigned long step_limit, struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        struct vm vm;
+        if (!vm_init(&vm, program))
+            return false;
+        vm_set_input(&vm, inputs[i].data, inputs[i].length);
+        vm_close_input(&vm);
+        vm_set_output(&vm, NULL, 0);
+        vm.step_limit = step_limit;
+        vm.trap_overflow = true;
+        bool overflowed = false;
+        enum vm_status status;
+        while ((status = vm_run(&vm)) != VM_HALTED && status != VM_YIELD && status != VM_DIVIDE_BY_ZERO) {
+            if (status == VM_OUTPUT && !grow_output(&vm)) {
+                free(vm.output);
+                vm_free(&vm);
+                return false;
+            }
+            if (status == VM_OVERFLOW) {
+                overflowed = true;
+                vm.trap_overflow = false;
+            }
+        }
+        if (!finish(&vm, status, results + i))
+            return false;
+        results[i].overflowed = overflowed;
+    }
+    return true;
+}
+
+// Drives the vm through every way it can be suspended and resumed: input arrives one byte at a time, output goes
+// through a one byte buffer that is copied out whenever it is full, and the vm yields every few steps.
+static bool run_resumable(const struct program *program, const struct input *inputs, size_t count,
+                          unsigned long step_limit, struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        struct vm vm;
+        if (!vm_init(&vm, program))
+            return false;
+        char small[1];
+        char decimal[16]; // for '!', which never fits in the small buffer
+        struct result collected = {.output = NULL};
+        size_t capacity = 0;
+        size_t position = 0;
+        unsigned long quantum = 1;
+        vm_set_output(&vm, small, sizeof(small));
+        vm.step_limit = 1;
+        enum vm_status status;
+        while ((status = vm_run(&vm)) != VM_HALTED && status != VM_DIVIDE_BY_ZERO) {
+            if (status == VM_YIELD) {
+                if (vm.steps >= step_limit)
+                    break;
+                quantum = quantum % 7 + 1;
+                vm.step_limit = vm.steps + quantum < step_limit ? vm.steps + quantum : step_limit;
+            } else if (status == VM_INPUT) {
+                if (position < inputs[i].length)
+                    vm_set_input(&vm, inputs[i].data + position++, 1);
+                else
+                    vm_close_input(&vm);
+            } else if (status == VM_OUTPUT) {
+                if (collected.output_length + vm.output_length > capacity) {
+                    capacity = capacity * 2 + vm.output_length + 64;
+                    char *output = realloc(collected.output, capacity);
+                    if (output == NULL) {
+                        free(collected.output);
+                        vm_free(&vm);
+                        return false;
+                    }
+                    collected.output = output;
+                }
+                memcpy(collected.output + collected.output_length, vm.output, vm.output_length);
+                collected.output_length += vm.output_length;
+                if (vm.output_length == 0)
+                    vm_set_output(&vm, decimal, sizeof(decimal));
+                else
+                    vm_set_output(&vm, small, sizeof(small));
+            }
+        }
+        // whatever is still buffered
+        char *output = realloc(collected.output, collected.output_length + vm.output_length + 1);
+        if (output == NULL) {
+            free(collected.output);
+            vm_free(&vm);
+            return false;
+        }
+        memcpy(output + collected.output_length, vm.output, vm.output_length);
+        vm.output = output;
+        vm.output_length += collected.output_length;
+        if (!finish(&vm, status, results + i))
+            return false;
+    }
+    return true;
+}
+
+// all inputs side by side in one lockstep batch
+static bool run_lockstep(const struct program *program, const struct input *inputs, size_t count,
+                         unsigned long step_limit, struct result *results) {
+    struct simt_lane lanes[MAX_INPUTS];
+    for (size_t i = 0; i < count; i++)
+        lanes[i] = (struct simt_lane){.input = inputs[i].data, .input_length = inputs[i].length, .keep_memory = true};
+    const bool success = simt_run(program, lanes, count, step_limit);
+    for (size_t i = 0; i < count; i++) {
+        results[i] = (struct result){
+            .status = lanes[i].status,
+            .steps = lanes[i].steps,
+            .output = lanes[i].output,
+            .output_length = lanes[i].output_length,
+            .memory = lanes[i].memory,
+            .memory_rings = lanes[i].memory_rings,
+        };
+    }
+    return success;
+}
+
+// The vm with 64 bit memory edges, with its memory narrowed to 32 bits. Its output buffer grows through an io.
+static bool run_wide(const struct program *program, const struct input *inputs, size_t count,
+                     unsigned long step_limit, struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        struct wide_vm vm;
+        struct vm_io io;
+        if (!wide_vm_init(&vm, program))
+            return false;
+        if (!io_init(&io, inputs[i].data, inputs[i].length, NULL, NULL, NULL)) {
+            wide_vm_free(&vm);
+            return false;
+        }
+        vm.step_limit = step_limit;
+        enum vm_status status;
+        while ((status = wide_vm_run_io(&vm, &io)) == VM_BREAK)
+            ;
+        const size_t size = 3 * vm.memory_rings * (vm.memory_rings - 1) + 1;
+        results[i] = (struct result){
+            .status = status,
+            .steps = vm.steps,
+            .output = io.output,
+            .output_length = io.output_length,
+            .memory = malloc(size * sizeof(struct memory_cell)),
+            .memory_rings = vm.memory_rings,
+        };
+        io.output = NULL;
+        for (size_t cell = 0; results[i].memory != NULL && cell < size; cell++) {
+            for (enum axis axis = X; axis <= Z; axis++)
+                results[i].memory[cell].value[axis] = (memory_edge)vm.memory[cell].value[axis];
+        }
+        io_free(&io);
+        wide_vm_free(&vm);
+        if (results[i].memory == NULL)
+            return false;
+    }
+    return true;
+}
+
+// the input of one run, handed to the io a few bytes at a time, and the output it hands back
+struct pieces {
+    const struct input *input;
+    size_t position;
+    char *output;
+    size_t output_length;
+    size_t output_capacity;
+};
+
+static bool next_piece(void *context, const char **input, size_t *length) {
+    struct pieces *pieces = context;
+    const size_t left = pieces->input->length - pieces->position;
+    const size_t piece = 1 + pieces->position % 3;
+    *input = pieces->input->data + pieces->position;
+    *length = left < piece ? left : piece;
+    pieces->position += *length;
+    return true;
+}
+
+static bool collect_output(void *context, const char *output, size_t length) {
+    struct pieces *pieces = context;
+    if (pieces->output_length + length > pieces->output_capacity) {
+        const size_t capacity = pieces->output_capacity * 2 + length;
+        char *grown = realloc(pieces->output, capacity);
+        if (grown == NULL)
+            return false;
+        pieces->output = grown;
+        pieces->output_capacity = capacity;
+    }
+    memcpy(pieces->output + pieces->output_length, output, length);
+    pieces->output_length += length;
+    return true;
+}
+
+// Runs through vm_run_io() with the input in pieces of 1 to 3 bytes and the output handed on to a callback. The
+// conformance build makes the buffer of the io small enough that it is handed on whenever it fills.
+static bool run_io(const struct program *program, const struct input *inputs, size_t count, unsigned long step_limit,
+                   struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        struct vm vm;
+        struct vm_io io;
+        struct pieces pieces = {.input = inputs + i};
+        if (!vm_init(&vm, program))
+            return false;
+        if (!io_init(&io, NULL, 0, next_piece, collect_output, &pieces)) {
+            vm_free(&vm);
+            return false;
+        }
+        vm.step_limit = step_limit;
+        enum vm_status status;
+        while ((status = vm_run_io(&vm, &io)) == VM_BREAK)
+            ;
+        io_free(&io);
+        vm.output = pieces.output;
+        vm.output_length = pieces.output_length;
+        if (status == VM_INPUT || status == VM_OUTPUT) {
+            free(pieces.output);
+            vm_free(&vm);
+            return false;
+        }
+        if (!finish(&vm, status, results + i))
+            return false;
+    }
+    return true;
+}
+
+// what the writer thread writes to a pipe, read by a thread of its own so that the pipe never stays full
+struct drain {
+    int fd;
+    char *data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+};
+
+static void *drain_pipe(void *argument) {
+    struct drain *drain = argument;
+    while (!drain->failed) {
+        if (drain->length == drain->capacity) {
+            char *data = realloc(drain->data, drain->capacity = drain->capacity * 2 + 4096);
+            if (data == NULL) {
+                drain->failed = true;
+                break;
+            }
+            drain->data = data;
+        }
+        const ssize_t n = read(drain->fd, drain->data + drain->length, drain->capacity - drain->length);
+        if (n <= 0) {
+            drain->failed = n < 0;
+            break;
+        }
+        drain->length += n;
+    }
+    return NULL;
+}
+
+// Runs through vm_run_io() on an io of io_init_async(), reading a file and writing a pipe. The conformance build
+// makes the buffers of the writer thread a page, so that longer outputs fill them and go into the pipe with
+// vmsplice().
+static bool run_async(const struct program *program, const struct input *inputs, size_t count,
+                      unsigned long step_limit, struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        FILE *input = tmpfile();
+        int fds[2] = {-1, -1};
+        pthread_t thread;
+        struct drain drain = {.fd = -1};
+        bool success = input != NULL && fwrite(inputs[i].data, 1, inputs[i].length, input) == inputs[i].length
+                    && fflush(input) == 0 && fseek(input, 0, SEEK_SET) == 0 && pipe(fds) == 0;
+        drain.fd = fds[0];
+        const bool draining = success && pthread_create(&thread, NULL, drain_pipe, &drain) == 0;
+        struct vm vm;
+        struct vm_io io;
+        const bool initialized = draining && vm_init(&vm, program);
+        success = initialized && io_init_async(&io, fileno(input), fds[1]);
+        enum vm_status status = VM_HALTED;
+        if (success) {
+            vm.step_limit = step_limit;
+            while ((status = vm_run_io(&vm, &io)) == VM_BREAK)
+                ;
+            success = status != VM_INPUT && status != VM_OUTPUT;
+            io_free(&io); // waits for the writer thread to finish
+        }
+        if (fds[1] >= 0)
+            close(fds[1]);
+        if (draining)
+            pthread_join(thread, NULL);
+        if (fds[0] >= 0)
+            close(fds[0]);
+        if (input != NULL)
+            fclose(input);
+        success = success && !drain.failed;
+        if (!success) {
+            free(drain.data);
+            if (initialized)
+                vm_free(&vm);
+            return false;
+        }
+        vm.output = drain.data;
+        vm.output_length = drain.length;
+        if (!finish(&vm, status, results + i))
+            return false;
+    }
+    return true;
+}
+
+// copies its input to its output until the input ends
+static const char cat_source[] = "<)@.;,(";
+
+// The program as the middle stage of a pipeline between two cats, so that both its input and its output go through
+// rings. The conformance build makes the rings small enough that they wrap around all the time. With a quantum the
+// stages take turns on this thread, otherwise each runs on its own.
+static bool run_between_cats(const struct program *program, const struct input *inputs, size_t count,
+                             unsigned long step_limit, struct result *results, unsigned long quantum) {
+    struct program cat;
+    if (!parse_program(&cat, cat_source, strlen(cat_source)))
+        return false;
+    bool success = true;
+    for (size_t i = 0; success && i < count; i++) {
+        // the first stage reads a file descriptor and the last writes a file, which both live in memory here
+        FILE *input = tmpfile();
+        char *output = NULL;
+        size_t output_length = 0;
+        FILE *stream = open_memstream(&output, &output_length);
+        success = input != NULL && stream != NULL
+                  && fwrite(inputs[i].data, 1, inputs[i].length, input) == inputs[i].length && fflush(input) == 0
+                  && fseek(input, 0, SEEK_SET) == 0;
+        struct vm vms[3];
+        enum vm_status statuses[3];
+        size_t initialized = 0;
+        while (success && initialized < 3 && vm_init(vms + initialized, initialized == 1 ? program : &cat))
+            initialized++;
+        success = success && initialized == 3;
+        if (success) {
+            vms[1].step_limit = step_limit;
+            success = quantum > 0 ? run_pipeline_scheduled(vms, statuses, 3, fileno(input), stream, quantum)
+                                  : run_pipeline_vms(vms, statuses, 3, fileno(input), stream);
+        }
+        if (stream != NULL)
+            success &= fclose(stream) == 0;
+        if (input != NULL)
+            fclose(input);
+        for (size_t stage = 0; stage < initialized; stage++) {
+            if (stage != 1 || !success)
+                vm_free(vms + stage);
+        }
+        if (success) {
+            vms[1].output = output;
+            vms[1].output_length = output_length;
+            success = finish(vms + 1, statuses[1], results + i);
+        } else {
+            free(output);
+        }
+    }
+    free_program(&cat);
+    return success;
+}
+
+static bool run_pipelined(const struct program *program, const struct input *inputs, size_t count,
+                          unsigned long step_limit, struct result *results) {
+    return run_between_cats(program, inputs, count, step_limit, results, 0);
+}
+
+// turns of a few steps, so that the stages switch in the middle of reading and writing
+static bool run_scheduled(const struct program *program, const struct input *inputs, size_t count,
+                          unsigned long step_limit, struct result *results) {
+    return run_between_cats(program, inputs, count, step_limit, results, 3);
+}
+
+// a program of its own with the cells of another, where the cell at index holds value
+static bool copy_program(struct program *copy, const struct program *program, ssize_t index, char value) {
+    *copy = *program;
+    copy->cells = malloc(program->size * sizeof(struct program_cell));
+    if (copy->cells == NULL)
+        return false;
+    memcpy(copy->cells, program->cells, program->size * sizeof(struct program_cell));
+    if (index >= 0)
+        copy->cells[index].value = value;
+    return true;
+}
+
+// Runs the program under --watch, then again with the cell it executed last for the first time changed, and once
+// more with the change undone. Each run carries on from a checkpoint of the one before. The edited program can run
+// on for much longer than the original, so it only runs a few steps past the change. The conformance build takes
+// checkpoints every few steps, so that they run out and are thinned all the time.
+static bool run_watched(const struct program *program, const struct input *inputs, size_t count,
+                        unsigned long step_limit, struct result *results) {
+    for (size_t i = 0; i < count; i++) {
+        struct watch watch;
+        char *input = malloc(inputs[i].length + 1);
+        if (input == NULL || !watch_init(&watch)) {
+            free(input);
+            return false;
+        }
+        memcpy(input, inputs[i].data, inputs[i].length);
+        watch_input(&watch, input, inputs[i].length);
+        bool success = true;
+        enum watch_end end = WATCH_FAILED;
+        for (int run = 0; success && run < 3; run++) {
+            ssize_t index = -1;
+            char value = 0;
+            unsigned long limit = step_limit;
+            if (run == 1) {
+                // halting there ends the edited run early, and the cells it did not get to must be run again
+                for (size_t cell = 0; cell < program->size; cell++) {
+                    if (watch.first_step[cell] != ULONG_MAX
+                        && (index < 0 || watch.first_step[cell] > watch.first_step[index]))
+                        index = cell;
+                }
+                if (index >= 0) {
+                    value = program->cells[index].value == '@' ? '.' : '@';
+                    if (watch.first_step[index] + EDITED_STEPS < limit)
+                        limit = watch.first_step[index] + EDITED_STEPS;
+                }
+            }
+            struct program version;
+            bool rerun;
+            success = copy_program(&version, program, index, value) && watch_program(&watch, version, &rerun);
+            if (success && rerun)
+                end = watch_run(&watch, limit, NULL, NULL);
+            success = success && end != WATCH_FAILED;
+        }
+        if (success) {
+            watch.vm.output = watch.io.output;
+            watch.vm.output_length = watch.io.output_length;
+            watch.io.output = NULL;
+            success = finish(&watch.vm,
+                             end == WATCH_HALTED    ? VM_HALTED
+                             : end == WATCH_DIVIDED ? VM_DIVIDE_BY_ZERO
+                                                    : VM_YIELD,
+                             results + i);
+        }
+        watch_free(&watch);
+        if (!success)
+            return false;
+    }
+    return true;
+}
+
+// the reference comes first, every other engine is compared against it
+static const struct engine engines[] = {
+    {"reference", run_reference},
+    {"resumable", run_resumable},
+    {"lockstep", run_lockstep},
+    {"wide", run_wide, true},
+    {"io", run_io},
+    {"async", run_async},
+    {"pipelined", run_pipelined},
+    {"scheduled", run_scheduled},
+    {"watched", run_watched},
+    {"templated", run_templated},
+    {"tiled", run_tiled},
+};
+#define ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// an edge of memory, with cells that were never allocated reading as zero
+static memory_edge edge_at(const struct result *result, size_t index, enum axis axis) {
+    const size_t size = 3 * result->memory_rings * (result->memory_rings - 1) + 1;
+    return index < size ? result->memory[index].value[axis] : 0;
+}
+
+static const char *status_name(enum vm_status status) {
+    return status == VM_HALTED ? "halted" : status == VM_DIVIDE_BY_ZERO ? "division by zero" : "step limit";
+}
+
+// describes the first difference between two results, returns false if there is none
+static bool describe_difference(const struct result *expected, const struct result *actual, char *description,
+                                size_t length) {
+    if (expected->status != actual->status) {
+        snprintf(description, length, "exit reason %s, expected %s", status_name(actual->status),
+                 status_name(expected->status));
+        return true;
+    }
+    if (expected->steps != actual->steps) {
+        snprintf(description, length, "%lu steps, expected %lu", actual->steps, expected->steps);
+        return true;
+    }
+    for (size_t i = 0; i < expected->output_length || i < actual->output_length; i++) {
+        if (i == expected->output_length || i == actual->output_length
+            || expected->output[i] != actual->output[i]) {
+            snprintf(description, length, "output differs at byte %zu (%zu bytes, expected %zu)", i,
+                     actual->output_length, expected->output_length);
+            return true;
+        }
+    }
+    const long rings = expected->memory_rings > actual->memory_rings ? expected->memory_rings : actual->memory_rings;
+    for (size_t i = 0; i < (size_t)(3 * rings * (rings - 1) + 1); i++) {
+        for (enum axis axis = X; axis <= Z; axis++) {
+            if (edge_at(expected, i, axis) != edge_at(actual, i, axis)) {
+                snprintf(description, length, "memory cell %zu edge %s is %d, expected %d", i, axis_name[axis],
+                         edge_at(actual, i, axis), edge_at(expected, i, axis));
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void print_escaped(const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        const unsigned char c = data[i];
+        if (c == '\\' || c == '"')
+            printf("\\%c", c);
+        else if (c >= ' ' && c < 127)
+            putchar(c);
+        else
+            printf("\\x%02x", c);
+    }
+}
+
+// Runs a program on every engine and compares each against the reference. Differences are reported with the
+// program and input, so that they can be reproduced.
+static bool check(const char *name, const char *source, size_t source_length, const struct input *inputs,
+                  size_t count, unsigned long step_limit) {
+    struct program program;
+    if (!parse_program(&program, source, source_length)) {
+        perror("Error parsing program");
+        return false;
+    }
+    static struct result results[ENGINES][MAX_INPUTS];
+    bool success = true;
+    for (size_t e = 0; e < ENGINES; e++) {
+        memset(results[e], 0, sizeof(results[e]));
+        if (!engines[e].run(&program, inputs, count, step_limit, results[e])) {
+            printf("%s: %s ran out of memory\n", name, engines[e].name);
+            success = false;
+        }
+    }
+    for (size_t e = 1; success && e < ENGINES; e++) {
+        for (size_t i = 0; i < count; i++) {
+            char description[128];
+            if (engines[e].wide && results[0][i].overflowed)
+                continue;
+            if (!describe_difference(&results[0][i], &results[e][i], description, sizeof(description)))
+                continue;
+            printf("%s: %s differs from the reference: %s\n  program \"", name, engines[e].name, description);
+            print_escaped(source, source_length);
+            printf("\"\n  input \"");
+            print_escaped(inputs[i].data, inputs[i].length);
+            printf("\"\n  step limit %lu\n", step_limit);
+            success = false;
+            break;
+        }
+    }
+    for (size_t e = 0; e < ENGINES; e++)
+        free_results(results[e], count);
+    free_program(&program);
+    return success;
+}
+
+// every instruction, with no-ops and memory moves weighted up so that programs run for a while
+static const char instructions[] = "......{{}}\"'=)(~+-*:%&^,;!?$/\\_|<>[]#@0123456789abZ";
+// the instructions that do not steer the IP, for the straight parts of structured programs
+static const char straight[] = "{}\"'=)(~+-*:%&^,;!?0123456789abZ";
+
+// a hexagon of instructions picked uniformly
+static size_t generate_random(char *source) {
+    const long rings = 1 + random_below(5);
+    const size_t size = 3 * rings * (rings - 1) + 1;
+    for (size_t i = 0; i < size; i++)
+        source[i] = instructions[random_below(sizeof(instructions) - 1)];
+    return size;
+}
+
+// Mostly no-ops, with a few mirrors and branches that make loops and straight code between them. These run far
+// longer than uniformly random programs before they halt or settle into a short cycle.
+static size_t generate_structured(char *source) {
+    const long rings = 3 + random_below(4);
+    const size_t size = 3 * rings * (rings - 1) + 1;
+    for (size_t i = 0; i < size; i++) {
+        const size_t kind = random_below(16);
+        if (kind < 6)
+            source[i] = '.';
+        else if (kind < 14)
+            source[i] = straight[random_below(sizeof(straight) - 1)];
+        else
+            source[i] = "/\\_|<>$[]#"[random_below(10)];
+    }
+    // a single halt somewhere, so that some of them finish
+    if (random_below(2))
+        source[random_below(size)] = '@';
+    return size;
+}
+
+static size_t generate_input(char *input) {
+    static const char bytes[] = "0123456789-+ \n\tabcXYZ\x01\xff";
+    const size_t length = random_below(MAX_INPUT_LENGTH + 1);
+    for (size_t i = 0; i < length; i++)
+        input[i] = bytes[random_below(sizeof(bytes) - 1)];
+    return length;
+}
+
+static bool check_generated(unsigned long seed, unsigned long programs) {
+    random_state = seed * 0x9E3779B97F4A7C15 + 1;
+    bool success = true;
+    for (unsigned long n = 0; n < programs; n++) {
+        char source[128];
+        const size_t length = n % 2 ? generate_structured(source) : generate_random(source);
+        static char data[MAX_INPUTS][MAX_INPUT_LENGTH];
+        struct input inputs[MAX_INPUTS];
+        const size_t count = 1 + random_below(MAX_INPUTS);
+        for (size_t i = 0; i < count; i++)
+            inputs[i] = (struct input){data[i], generate_input(data[i])};
+        char name[64];
+        snprintf(name, sizeof(name), "program %lu of seed %lu", n, seed);
+        success &= check(name, source, length, inputs, count, random_below(MAX_STEPS));
+    }
+    printf("%lu generated programs with seed %lu: %s\n", programs, seed, success ? "ok" : "FAILED");
+    return success;
+}
+
+// Runs the checked-in cases, every line of the list naming a program, its input or - for none, and the file
+// holding its expected output. Every engine must agree with the reference, and the reference with the file.
+static bool check_cases(const char *filename) {
+    FILE *list = fopen(filename, "r");
+    if (list == NULL) {
+        perror("Error reading cases");
+        return false;
+    }
+    bool success = true;
+    int count = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), list) != NULL) {
+        char program_file[256], input_file[256], expected_file[256];
+        if (line[0] == '#' || sscanf(line, "%255s %255s %255s", program_file, input_file, expected_file) != 3)
+            continue;
+        count++;
+        size_t source_length, input_length = 0, expected_length;
+        char *source = read_file(program_file, &source_length);
+        char *input = strcmp(input_file, "-") != 0 ? read_file(input_file, &input_length) : NULL;
+        char *expected = read_file(expected_file, &expected_length);
+        if (source == NULL || expected == NULL || (input == NULL && strcmp(input_file, "-") != 0)) {
+            printf("%s: error reading its files\n", program_file);
+            success = false;
+        } else {
+            const struct input inputs[] = {{input, input_length}};
+            success &= check(program_file, source, source_length, inputs, 1, CASE_STEPS);
+
+            struct program program;
+            struct result result;
+            if (parse_program(&program, source, source_length)
+                && run_reference(&program, inputs, 1, CASE_STEPS, &result)) {
+                if (result.status != VM_HALTED || result.output_length != expected_length
+                    || memcmp(result.output, expected, expected_length) != 0) {
+                    printf("%s: output differs from %s\n", program_file, expected_file);
+                    success = false;
+                }
+                free_results(&result, 1);
+                free_program(&program);
+            }
+        }
+        free(source);
+        free(input);
+        free(expected);
+    }
+    fclose(list);
+    printf("%d checked-in cases: %s\n", count, success ? "ok" : "FAILED");
+    return success;
+}
+
+int main(int argc, char **argv) {
+    unsigned long seed = 1;
+    unsigned long programs = DEFAULT_PROGRAMS;
+    const char *cases = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--programs") == 0 && i + 1 < argc) {
+            programs = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--cases") == 0 && i + 1 < argc) {
+            cases = argv[++i];
+        } else {
+            fprintf(stderr, "Usage: conformance [--seed N] [--programs N] [--cases FILE]\n");
+            return EXIT_FAILURE;
+        }
+    }
+    bool success = true;
+    if (cases != NULL)
+        success &= check_cases(cases);
+    success &= check_generated(seed, programs);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
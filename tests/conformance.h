@@ -0,0 +1,40 @@
+#ifndef HEXAGONY_CONFORMANCE_H
+#define HEXAGONY_CONFORMANCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "../src/vm.h"
+
+// the final state of one run that engines must agree on
+struct result {
+    enum vm_status status; // VM_HALTED, VM_DIVIDE_BY_ZERO, or VM_YIELD if the step budget ran out
+    unsigned long steps;
+    char *output;
+    size_t output_length;
+    struct memory_cell *memory;
+    long memory_rings;
+    bool overflowed; // a value did not fit in 32 bits, only the reference looks
+};
+
+struct input {
+    const char *data;
+    size_t length;
+};
+
+// Runs a program once for every input and fills in a result for each. Returns false if memory ran out.
+typedef bool run_function(const struct program *program, const struct input *inputs, size_t count,
+                          unsigned long step_limit, struct result *results);
+
+// the C++ engine of hexagony.hpp with the memory of vm.c, and with tiled memory, in templated.cpp
+run_function run_templated, run_tiled;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,73 @@
+// Programs evaluated by hexagony::evaluate() at compile time. There is nothing to run, this compiles only if every
+// static_assert holds.
+
+#include "../src/hexagony.hpp"
+
+// test-cases/HelloWorld.hxg
+static_assert(hexagony::evaluate<32>(R"(
+   H ; e ;
+  l ; d ; *
+ ; r ; o ;`W
+l ; ; o ; * 4
+ 3 3 ; @ . >
+  ; 2 3 < \
+   4 ; * /
+)") == "Hello, World!");
+
+// test-cases/io.hxg, which reads a byte and a number
+static_assert(hexagony::evaluate<16>(R"(
+   , ; {
+  . . . .
+ ? !`@ . .
+  . . . .
+   . . .
+)", "x-42 7\n") == "x-42");
+
+// 64 bit edges keep what 32 bit ones wrap around
+static_assert(hexagony::evaluate<16, 2, int64_t>("?)!@", "2147483647") == "2147483648");
+static_assert(hexagony::evaluate<16, 2, int32_t>("?)!@", "2147483647") == "-2147483648");
+
+// test-cases/Brainfuck.hxg running a Brainfuck program that prints the digits, which loops and branches on memory
+// out to 40 rings for 86444 steps
+constexpr std::string_view brainfuck = R"hxg(
+                \ | $ 9 * \ . . . / < $ . < = }
+               = $ > { , < > { * \ ' ~ . . . } |
+              { . = > . ~ _ 2 4 < _ = > ~ < > _ _
+             . | | \ ' + { = & . < . \ ' . _ $ | /
+            . . $ > ~ + ' ~ 8 * { / . [ > } } * \ .
+           . . | \ ~ { * 2 ' : } = - \ ' . . . | . $
+          . . $ > ~ - ' 3 1 * { _ & < _ | . . . ' . /
+         | . | \ ~ { = \ / * = < > . " < . . . . ' . $
+        . . $ > = } & < . > ' " \ } } = / . . . _ . . _
+       . . _ @ . . . . / * = ' < . . . . > . . < } . _ $
+      . | $ . . . / = * = . " & a ' ) ' \ ( ' \ . { . . _
+     . . _ . . . . > & $ > } { * 8 " - < > ( < | } } . . .
+    . . . . . . . . . . \ & = * = " & a _ ' ' / $ / 1 . . .
+   . / . ] \ . . . J A C K . F O X . 2 0 2 0 . . . . . . . .
+  > $ > . < . H E X A G O N Y . B R A I N F U C K . . . . . |
+ . . \ { } / . . > F # { [ " ) ' . . . . \ . . . . . . . . . '
+  > } { = a & ( < . . > F # { [ " , ' $ \ . . \ . . . . | $ 1
+   . . . " \ . . > ( < . . > F # { [ " ( ' $ \ . . \ . . . }
+    ' < $ . < . @ . . > ( < . . > F # { [ " ; ' $ \ \ . $ }
+     . ~ \ [ . { # F < . . > ( < . . > F # { [ \ . \ . \ }
+      . > ~ < > " [ { # F < . . > ( < / * ' " < . . . $ 1
+       | $ . _ . . . 1 [ { # F < . _ < > " ' . . _ . \ $
+        . . . . . . / = } } \ . . . . . . . . . . . . |
+         > ' = [ ' $ > " . < > = * = { } } * = $ | / =
+          . . . . . > $ / " _ _ " * & ' A & . \ . = $
+           . . . . \ { < > ( < > - " 8 * { { < . [ |
+            . . . . . . \ " ) " * & ' A & _ . / ' .
+             . . . < . . > ( < . . . . . 1 $ . " .
+              . . ' . . \ { { } . . . = < . _ | $
+               / $ . { $ > { } 1 } } \ . . | $ |
+                " . . . \ ] " * = } < . . . " |
+)hxg";
+constexpr auto digits = hexagony::evaluate<16, 40>(brainfuck, "++++++++[>++++++<-]>>++++++++++[<.+>-]");
+static_assert(digits == "0123456789");
+
+// '%' by zero stops the vm at the division, running it again stops there again
+static_assert([] {
+    const hexagony::program code = hexagony::parse("%@");
+    hexagony::vm<int32_t, hexagony::fixed_memory<int32_t, 2>, hexagony::fixed_io<1>> machine(code, {}, {""});
+    return machine.run() == hexagony::DIVIDED && machine.run() == hexagony::DIVIDED && machine.steps == 0;
+}());
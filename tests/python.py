@@ -0,0 +1,59 @@
+# Runs the checked-in cases and the errors of the Python module through import hexagony. `make test` runs it with
+# bin on the module search path.
+import hexagony
+
+
+def read(path):
+    with open(path, "rb") as file:
+        return file.read()
+
+
+def expect_error(error, call):
+    try:
+        call()
+    except error:
+        return
+    raise AssertionError(f"expected {error.__name__}")
+
+
+with open("tests/cases.txt") as cases:
+    for line in cases:
+        if line.startswith("#") or not line.strip():
+            continue
+        program_path, input_path, expected_path = line.split()
+        program = hexagony.compile(read(program_path))
+        input = b"" if input_path == "-" else read(input_path)
+        expected = read(expected_path)
+        assert hexagony.run(program, input) == expected, program_path
+
+        # a vm stepped through part of the way and then run to the end writes the same output
+        vm = hexagony.VM(program, input)
+        assert vm.step(10) or vm.steps == 10
+        output = vm.read_output()
+        assert vm.run()
+        assert vm.halted
+        assert output + vm.read_output() == expected, program_path
+
+hello = hexagony.compile(read("test-cases/HelloWorld.hxg"))
+assert hexagony.compile(read("test-cases/HelloWorld.hxg").decode()).size == hello.size
+vm = hexagony.VM(hello)
+while not vm.step():
+    pass
+assert vm.read_output() == read("tests/expected/HelloWorld.out")
+assert vm.step()
+
+loop = hexagony.compile(".")
+expect_error(hexagony.StepLimitError, lambda: hexagony.run(loop, max_steps=1000))
+vm = hexagony.VM(loop)
+assert not vm.run(max_steps=1000)
+assert vm.steps >= 1000 and not vm.halted
+
+divide = hexagony.compile(":@")
+modulo = hexagony.compile("%@")
+expect_error(ZeroDivisionError, lambda: hexagony.run(divide))
+expect_error(ZeroDivisionError, lambda: hexagony.run(modulo))
+vm = hexagony.VM(divide)
+expect_error(ZeroDivisionError, vm.step)
+# the vm stays at the division
+expect_error(ZeroDivisionError, vm.run)
+assert vm.steps == 0 and not vm.halted
@@ -0,0 +1,98 @@
+// Checks that enter_sandbox() lets a process run a program and write its output, and kills it on any other system
+// call. Each check runs in a child process, as the sandbox cannot be left again.
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/sandbox.h"
+#include "../src/vm.h"
+
+#define UNSUPPORTED 77 // exit status of a child that could not enter the sandbox because the system has none
+
+// runs a program that reads a number and writes the next one, in the sandbox
+static void run_program(void) {
+    const char source[] = "?)!@";
+    const char input[] = "41";
+    struct program program;
+    struct vm vm;
+    char output[64];
+    if (!parse_program(&program, source, strlen(source)) || !vm_init(&vm, &program))
+        _exit(EXIT_FAILURE);
+    if (!enter_sandbox(SANDBOX_STDIO))
+        _exit(errno == ENOSYS ? UNSUPPORTED : EXIT_FAILURE);
+    vm_set_input(&vm, input, strlen(input));
+    vm_close_input(&vm);
+    vm_set_output(&vm, output, sizeof(output));
+    const enum vm_status status = vm_run(&vm);
+    // growing memory past what malloc keeps on the heap is allowed as well
+    vm.MP.p = 200;
+    *get_memory_edge(vm.MP, &vm.memory, &vm.memory_rings) = 1;
+    fwrite(vm.output, 1, vm.output_length, stdout);
+    fflush(stdout);
+    _exit(status == VM_HALTED ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+// makes a system call the sandbox does not allow
+static void open_file(void) {
+    if (!enter_sandbox(SANDBOX_STDIO))
+        _exit(errno == ENOSYS ? UNSUPPORTED : EXIT_FAILURE);
+    open("/dev/null", O_RDONLY);
+    _exit(EXIT_SUCCESS);
+}
+
+// Runs a check in a child with its stdout going to a pipe. Returns its wait status and what it wrote, or -1 if the
+// child could not be started.
+static int run_child(void (*check)(void), char *output, size_t capacity) {
+    int fds[2];
+    if (pipe(fds) != 0)
+        return -1;
+    fflush(stdout);
+    const pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        check();
+    }
+    close(fds[1]);
+    size_t length = 0;
+    ssize_t n;
+    while (length + 1 < capacity && (n = read(fds[0], output + length, capacity - 1 - length)) > 0)
+        length += n;
+    output[length] = '\0';
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    return status;
+}
+
+int main(void) {
+    char output[64];
+    int status = run_child(run_program, output, sizeof(output));
+    if (WIFEXITED(status) && WEXITSTATUS(status) == UNSUPPORTED) {
+        puts("sandbox: not supported here, skipped");
+        return EXIT_SUCCESS;
+    }
+    bool success = true;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS || strcmp(output, "42") != 0) {
+        printf("sandbox: a program wrote \"%s\" and ended with wait status %d, expected \"42\" and exit status 0\n",
+               output, status);
+        success = false;
+    }
+    status = run_child(open_file, output, sizeof(output));
+    if (!WIFSIGNALED(status) || WTERMSIG(status) != SIGSYS) {
+        printf("sandbox: open() ended with wait status %d, expected to be killed by SIGSYS\n", status);
+        success = false;
+    }
+    if (success)
+        puts("sandbox: ok");
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,58 @@
+// The C++ engine of hexagony.hpp as engines of the conformance test. Only what the generated programs use is
+// configured: 32 bit edges, input given all at once and no debug hooks.
+
+#include <cstdlib>
+#include <cstring>
+
+#include "../src/hexagony.hpp"
+#include "conformance.h"
+
+template <class Memory>
+static bool run_engine(const struct program *program, const struct input *inputs, size_t count,
+                       unsigned long step_limit, struct result *results) {
+    hexagony::program code{{}, program->rings};
+    for (size_t i = 0; i < program->size; i++)
+        code.cells.push_back({program->cells[i].value, program->cells[i].debug});
+    for (size_t i = 0; i < count; i++) {
+        hexagony::vm<memory_edge, Memory, hexagony::buffer_io> vm(code, {}, {{inputs[i].data, inputs[i].length}});
+        const hexagony::status status = vm.run(step_limit);
+
+        // the memory in the layout of vm.c, ring by ring
+        const long rings = vm.memory.rings();
+        const size_t size = hexagony::detail::ring_size(rings);
+        results[i] = {
+            .status = status == hexagony::HALTED    ? VM_HALTED
+                      : status == hexagony::DIVIDED ? VM_DIVIDE_BY_ZERO
+                                                    : VM_YIELD,
+            .steps = vm.steps,
+            .output = (char *)malloc(vm.io.output.size() + 1),
+            .output_length = vm.io.output.size(),
+            .memory = (struct memory_cell *)malloc(size * sizeof(struct memory_cell)),
+            .memory_rings = rings,
+        };
+        if (results[i].output == NULL || results[i].memory == NULL)
+            return false;
+        memcpy(results[i].output, vm.io.output.data(), vm.io.output.size());
+        for (long p = -(rings - 1); p < rings; p++) {
+            for (long q = -(rings - 1); q < rings; q++) {
+                if (hexagony::detail::ring_of(p, q) >= rings)
+                    continue;
+                const hexagony::memory_cell<memory_edge> cell = vm.memory.peek(p, q);
+                struct memory_cell *target = results[i].memory + hexagony::detail::axial_to_mem_index(p, q);
+                for (int axis = X; axis <= Z; axis++)
+                    target->value[axis] = cell[axis];
+            }
+        }
+    }
+    return true;
+}
+
+bool run_templated(const struct program *program, const struct input *inputs, size_t count,
+                   unsigned long step_limit, struct result *results) {
+    return run_engine<hexagony::spiral_memory<memory_edge>>(program, inputs, count, step_limit, results);
+}
+
+bool run_tiled(const struct program *program, const struct input *inputs, size_t count, unsigned long step_limit,
+               struct result *results) {
+    return run_engine<hexagony::tiled_memory<memory_edge>>(program, inputs, count, step_limit, results);
+}